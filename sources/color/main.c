@@ -9,42 +9,390 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#if defined( __AVX2__ )
+	#include <immintrin.h>
+	#define SCANNER_NAME "avx2"
+#elif defined( __SSE2__ )
+	#include <emmintrin.h>
+	#define SCANNER_NAME "sse2"
+#else
+	#define SCANNER_NAME "swar"
+#endif
 
 #define TAB_COLOR "\x1b[43m"
 #define SPACE_COLOR "\x1b[46m"
 #define DEFAULT_COLOR "\x1b[0m"
 
+/**
+ * 一度に読み込むバイト数
+ */
+#define INPUT_SIZE ( 1024 * 1024 )
+
+/**
+ * 出力を溜めておくバッファのサイズ
+ */
+#define OUTPUT_SIZE ( 4 * 1024 * 1024 )
+
+/**
+ * 一度に分類するバイト数
+ */
+#define BLOCK_SIZE 64
+
+/**
+ * 変換の速度を計測するオプション
+ * --benchmark=<メガバイト数> の形式で計測に使用するデータの量を指定できる
+ */
+#define BENCHMARK_OPTION "--benchmark"
+
+/**
+ * 計測に使用するデータの量の初期値
+ */
+#define BENCHMARK_SIZE 64
+
 enum { TAB , SPACE , DEFAULT } typedef color;
 
-int main( void ){
-	char buffer[1024] , *position , current;
-	color previous = DEFAULT;
-	while( fgets( buffer , 1024 , stdin ) != NULL ){
-		position = buffer;
-		while( ( current = *position++ ) != '\0' ){
-			if( current == '\t' ){
-				if( previous != TAB ){
-					printf( TAB_COLOR );
-					previous = TAB;
-				}
-				current = 'T';
+/**
+ * 色毎のエスケープシーケンス
+ * 長さを揃えて固定長で書き込めるようにしている
+ */
+static const char sequences[][8] = { TAB_COLOR , SPACE_COLOR , DEFAULT_COLOR };
+
+/**
+ * 色毎のエスケープシーケンスの長さ
+ */
+static const size_t sequenceLengths[] = { sizeof( TAB_COLOR ) - 1 , sizeof( SPACE_COLOR ) - 1 , sizeof( DEFAULT_COLOR ) - 1 };
+
+/**
+ * タブと空白の置き換え後の文字を BLOCK_SIZE 個並べたもの
+ */
+static char letters[2][BLOCK_SIZE];
+
+/**
+ * 出力を溜めておくバッファ
+ */
+static char output[OUTPUT_SIZE];
+
+/**
+ * バッファに溜めているバイト数
+ */
+static size_t used = 0;
+
+/**
+ * 出力先 NULL の場合は書き込まずにハッシュ値だけを求める
+ */
+static FILE *sink = NULL;
+
+/**
+ * 書き込まなかった出力のハッシュ値を求める場合に 1
+ */
+static int hashing = 0;
+
+/**
+ * 書き込まなかった出力のハッシュ値
+ */
+static uint64_t digest = 14695981039346656037ULL;
+
+/**
+ * 直前に出力した色
+ */
+static color previous = DEFAULT;
+
+/**
+ * ブロック内のタブと空白の位置を求める
+ * @param block
+ *	BLOCK_SIZE バイトのブロック
+ * @param tabs
+ *	タブの位置のビットが立った値が格納される
+ * @param spaces
+ *	空白の位置のビットが立った値が格納される
+ */
+static void classify( const unsigned char *block , uint64_t *tabs , uint64_t *spaces );
+
+/**
+ * BLOCK_SIZE に満たないブロック内のタブと空白の位置を求める
+ * @param block
+ *	ブロック
+ * @param length
+ *	ブロックのバイト数
+ * @param tabs
+ *	タブの位置のビットが立った値が格納される
+ * @param spaces
+ *	空白の位置のビットが立った値が格納される
+ */
+static void classifyTail( const unsigned char *block , size_t length , uint64_t *tabs , uint64_t *spaces );
+
+/**
+ * 入力を同じ種類の文字の連続毎に色を付けて出力する
+ * @param input
+ *	入力
+ * @param size
+ *	入力のバイト数
+ */
+static void colorize( const unsigned char *input , size_t size );
+
+/**
+ * 入力を1文字ずつ色を付けて出力する
+ * 計測時の比較に使用する
+ * @param input
+ *	入力
+ * @param size
+ *	入力のバイト数
+ */
+static void colorizeScalar( const unsigned char *input , size_t size );
+
+/**
+ * 同じ種類の文字の連続を出力する
+ * 直前と色が異なる場合のみエスケープシーケンスを出力する
+ * 文字の連続の後ろに BLOCK_SIZE バイト読み込める領域がなければならない
+ * @param current
+ *	文字の種類
+ * @param data
+ *	文字の連続
+ * @param length
+ *	文字数
+ */
+static void emit( color current , const unsigned char *data , size_t length );
+
+/**
+ * 置き換え後の文字を用意する
+ */
+static void prepare( void );
+
+/**
+ * バッファに溜めた出力を書き込む
+ */
+static void flush( void );
+
+/**
+ * 変換の速度を計測して表示する
+ * @param megabytes
+ *	計測に使用するデータのメガバイト数
+ * @return
+ *	終了ステータス
+ */
+static int benchmark( long megabytes );
+
+/**
+ * 単調増加する時刻を秒で取得する
+ * @return
+ *	時刻
+ */
+static double now( void );
+
+int main( int argc , const char *argv[] ){
+	static unsigned char input[INPUT_SIZE + BLOCK_SIZE];
+	size_t count;
+	prepare();
+	if( 1 < argc && strncmp( argv[1] , BENCHMARK_OPTION , strlen( BENCHMARK_OPTION ) ) == 0 ){
+		return benchmark( argv[1][strlen( BENCHMARK_OPTION )] == '=' ? atol( argv[1] + strlen( BENCHMARK_OPTION ) + 1 ) : BENCHMARK_SIZE );
+	}
+	sink = stdout;
+	while( ( count = fread( input , sizeof( char ) , INPUT_SIZE , stdin ) ) != 0 ){
+		colorize( input , count );
+	}
+	memcpy( output + used , DEFAULT_COLOR , strlen( DEFAULT_COLOR ) );
+	used += strlen( DEFAULT_COLOR );
+	flush();
+	return EXIT_SUCCESS;
+}
+
+static void classify( const unsigned char *block , uint64_t *tabs , uint64_t *spaces ){
+#if defined( __AVX2__ )
+	const __m256i tab = _mm256_set1_epi8( '\t' ) , space = _mm256_set1_epi8( ' ' );
+	__m256i low = _mm256_loadu_si256( ( const __m256i * ) block );
+	__m256i high = _mm256_loadu_si256( ( const __m256i * ) ( block + 32 ) );
+	*tabs = ( uint32_t ) _mm256_movemask_epi8( _mm256_cmpeq_epi8( low , tab ) )
+		| ( uint64_t ) ( uint32_t ) _mm256_movemask_epi8( _mm256_cmpeq_epi8( high , tab ) ) << 32;
+	*spaces = ( uint32_t ) _mm256_movemask_epi8( _mm256_cmpeq_epi8( low , space ) )
+		| ( uint64_t ) ( uint32_t ) _mm256_movemask_epi8( _mm256_cmpeq_epi8( high , space ) ) << 32;
+#elif defined( __SSE2__ )
+	const __m128i tab = _mm_set1_epi8( '\t' ) , space = _mm_set1_epi8( ' ' );
+	__m128i data;
+	int index;
+	*tabs = *spaces = 0;
+	for( index = 0 ; index < BLOCK_SIZE ; index += 16 ){
+		data = _mm_loadu_si128( ( const __m128i * ) ( block + index ) );
+		*tabs |= ( uint64_t ) ( uint16_t ) _mm_movemask_epi8( _mm_cmpeq_epi8( data , tab ) ) << index;
+		*spaces |= ( uint64_t ) ( uint16_t ) _mm_movemask_epi8( _mm_cmpeq_epi8( data , space ) ) << index;
+	}
+#else
+	const uint64_t low = 0x7F7F7F7F7F7F7F7FULL , gather = 0x0102040810204080ULL;
+	uint64_t word , match;
+	int index;
+	*tabs = *spaces = 0;
+	for( index = 0 ; index < BLOCK_SIZE ; index += 8 ){
+		memcpy( &word , block + index , sizeof( word ) );
+		// 一致したバイトだけ最上位ビットが立つ
+		match = word ^ 0x0909090909090909ULL;
+		match = ~( ( ( match & low ) + low ) | match | low );
+		*tabs |= ( ( match >> 7 ) * gather >> 56 ) << index;
+		match = word ^ 0x2020202020202020ULL;
+		match = ~( ( ( match & low ) + low ) | match | low );
+		*spaces |= ( ( match >> 7 ) * gather >> 56 ) << index;
+	}
+#endif
+	return;
+}
+
+static void classifyTail( const unsigned char *block , size_t length , uint64_t *tabs , uint64_t *spaces ){
+	size_t index;
+	*tabs = *spaces = 0;
+	for( index = 0 ; index < length ; index++ ){
+		if( block[index] == '\t' ){
+			*tabs |= 1ULL << index;
+		}
+		else if( block[index] == ' ' ){
+			*spaces |= 1ULL << index;
+		}
+	}
+	return;
+}
+
+static void colorize( const unsigned char *input , size_t size ){
+	uint64_t tabs , spaces , change , bit;
+	size_t base , length , offset , end;
+	color current;
+	for( base = 0 ; base < size ; base += length ){
+		length = size - base < BLOCK_SIZE ? size - base : BLOCK_SIZE;
+		if( length == BLOCK_SIZE ){
+			classify( input + base , &tabs , &spaces );
+		}
+		else{
+			classifyTail( input + base , length , &tabs , &spaces );
+		}
+		for( offset = 0 ; offset < length ; offset = end ){
+			bit = 1ULL << offset;
+			if( tabs & bit ){
+				current = TAB;
+				change = ~tabs;
 			}
-			else if( current == ' ' ){
-				if( previous != SPACE ){
-					printf( SPACE_COLOR );
-					previous = SPACE;
-				}
-				current = 'S';
+			else if( spaces & bit ){
+				current = SPACE;
+				change = ~spaces;
 			}
 			else{
-				if( previous != DEFAULT ){
-					printf( DEFAULT_COLOR );
-					previous = DEFAULT;
-				}
+				current = DEFAULT;
+				change = tabs | spaces;
 			}
-			fputc( current , stdout );
+			change &= ~0ULL << offset;
+			end = change == 0 ? BLOCK_SIZE : ( size_t ) __builtin_ctzll( change );
+			if( length < end ){
+				end = length;
+			}
+			emit( current , input + base + offset , end - offset );
 		}
 	}
-	fputs( DEFAULT_COLOR , stdout );
-	return EXIT_SUCCESS;
+	return;
+}
+
+static void colorizeScalar( const unsigned char *input , size_t size ){
+	size_t index;
+	for( index = 0 ; index < size ; index++ ){
+		emit( input[index] == '\t' ? TAB : input[index] == ' ' ? SPACE : DEFAULT , input + index , 1 );
+	}
+	return;
+}
+
+static void emit( color current , const unsigned char *data , size_t length ){
+	// 文字数は BLOCK_SIZE 以下なので、常に固定長で書き込んで必要な分だけ進める
+	if( OUTPUT_SIZE - used < 2 * BLOCK_SIZE ){
+		flush();
+	}
+	if( current != previous ){
+		memcpy( output + used , sequences[current] , sizeof( sequences[current] ) );
+		used += sequenceLengths[current];
+		previous = current;
+	}
+	memcpy( output + used , current == DEFAULT ? ( const char * ) data : letters[current] , BLOCK_SIZE );
+	used += length;
+	return;
+}
+
+static void prepare( void ){
+	memset( letters[TAB] , 'T' , BLOCK_SIZE );
+	memset( letters[SPACE] , 'S' , BLOCK_SIZE );
+	return;
+}
+
+static void flush( void ){
+	size_t index;
+	if( sink != NULL ){
+		fwrite( output , sizeof( char ) , used , sink );
+	}
+	else if( hashing ){
+		for( index = 0 ; index < used ; index++ ){
+			digest = ( digest ^ ( unsigned char ) output[index] ) * 1099511628211ULL;
+		}
+	}
+	used = 0;
+	return;
+}
+
+static int benchmark( long megabytes ){
+	size_t size = ( size_t ) megabytes * 1024 * 1024 , index;
+	unsigned char *input;
+	uint64_t state = 88172645463325252ULL , vectorDigest;
+	double start , vector , scalar;
+	if( megabytes <= 0 || ( input = ( unsigned char * ) calloc( size + BLOCK_SIZE , sizeof( unsigned char ) ) ) == NULL ){
+		fputs( "illegal benchmark size.\n" , stderr );
+		return EXIT_FAILURE;
+	}
+	// Whitespace のソースに近い比率でタブ・空白・改行・コメントを混ぜる
+	for( index = 0 ; index < size ; index++ ){
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		switch( state % 20 ){
+			case 0: case 1: case 2: case 3: case 4: case 5: case 6: case 7: case 8:
+				input[index] = ' ';
+				break;
+
+			case 9: case 10: case 11: case 12: case 13: case 14: case 15:
+				input[index] = '\t';
+				break;
+
+			case 16: case 17:
+				input[index] = '\n';
+				break;
+
+			default:
+				input[index] = ( unsigned char ) ( 'a' + state / 20 % 26 );
+				break;
+		}
+	}
+
+	start = now();
+	colorize( input , size );
+	flush();
+	vector = now() - start;
+	previous = DEFAULT;
+	start = now();
+	colorizeScalar( input , size );
+	flush();
+	scalar = now() - start;
+
+	// 計測とは別に、両方の出力が一致することを確認する
+	hashing = 1;
+	previous = DEFAULT;
+	colorize( input , size );
+	flush();
+	vectorDigest = digest;
+	digest = 14695981039346656037ULL;
+	previous = DEFAULT;
+	colorizeScalar( input , size );
+	flush();
+
+	fprintf( stdout , "%s run-length : %8.1f MB/s\n" , SCANNER_NAME , megabytes / vector );
+	fprintf( stdout , "byte at a time : %8.1f MB/s\n" , megabytes / scalar );
+	fprintf( stdout , "output         : %s\n" , vectorDigest == digest ? "identical" : "MISMATCH" );
+	free( input );
+	return vectorDigest == digest ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static double now( void ){
+	struct timespec time;
+	clock_gettime( CLOCK_MONOTONIC , &time );
+	return time.tv_sec + time.tv_nsec / 1e9;
 }
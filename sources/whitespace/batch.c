@@ -0,0 +1,158 @@
+//
+//  batch.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include "whitespace.h"
+
+/**
+ * 入力ファイル毎の出力を書き込むファイルの接尾辞
+ */
+#define BATCH_OUTPUT_SUFFIX ".out"
+
+/**
+ * 入力命令に達して実行を止めた場合に true
+ * プログラムが入力を読まずに終了した場合は false のまま
+ */
+static bool frozen = false;
+
+/**
+ * 入力命令に達するまでに出力した内容
+ */
+static char *prefix = NULL;
+
+/**
+ * 入力命令に達するまでに出力した内容のバイト数
+ */
+static size_t prefixSize = 0;
+
+/**
+ * 最初の入力命令に達するまでスタックマシンとして実行する
+ * @param instruction
+ *	最初に実行する命令
+ */
+static void executePrefix( Instruction *instruction );
+
+/**
+ * 複製したプロセスで1つの入力ファイルについて残りを実行する
+ * @param path
+ *	入力ファイル
+ * @param reason
+ *	入力命令に達するまでの実行を中断した理由
+ * @param limit
+ *	入力ファイル毎に改めて適用する実行時の資源の上限
+ * @return
+ *	プロセスの終了ステータス
+ */
+static int executeInput( const char *path , Halt reason , Limit *limit );
+
+/**
+ * エラー出力を行う
+ * 出力後、プログラムは終了する
+ * @param message
+ *	エラーメッセージ
+ */
+static void error( char *message );
+
+
+
+int executeBatch( Instruction *instruction , const char **inputs , int count , int workers , Limit *limit ){
+	FILE *output;
+	Halt reason;
+	int index = 0 , running = 0 , status , result = EXIT_SUCCESS , code;
+	if( ( output = open_memstream( &prefix , &prefixSize ) ) == NULL ){
+		error( "batch: out of memory error" );
+	}
+	setStream( stdin , output );
+	reason = executeGoverned( executePrefix , instruction );
+	fclose( output );
+	fflush( stdout );
+	fflush( stderr );
+	while( index < count || 0 < running ){
+		if( index < count && running < ( workers < 1 ? 1 : workers ) ){
+			switch( fork() ){
+				case -1:
+					error( "batch: fork error" );
+					break;
+
+				case 0:
+					exit( executeInput( inputs[index] , reason , limit ) );
+
+				default:
+					break;
+			}
+			index++;
+			running++;
+			continue;
+		}
+		if( wait( &status ) < 0 ){
+			break;
+		}
+		running--;
+		code = WIFEXITED( status ) ? WEXITSTATUS( status ) : EXIT_FAILURE;
+		if( result == EXIT_SUCCESS ){
+			result = code;
+		}
+	}
+	free( prefix );
+	prefix = NULL;
+	prefixSize = 0;
+	return result;
+}
+
+static void executePrefix( Instruction *instruction ){
+	Machine *machine = getMachine();
+	Instruction *current;
+	machine->current = instruction;
+	while( true ){
+		while( ( current = machine->current ) != NULL ){
+			if( current->imp == IO && ( current->c_io == GET_CHAR || current->c_io == GET_NUMBER ) ){
+				frozen = true;
+				return;
+			}
+			if( baseProcess( current ) ){
+				return;
+			}
+		}
+		if( machine->callPointer == 0 ){
+			return;
+		}
+		machine->current = machine->calls[--machine->callPointer];
+	}
+}
+
+static int executeInput( const char *path , Halt reason , Limit *limit ){
+	char name[BUFFER_SIZE];
+	FILE *input , *output;
+	snprintf( name , sizeof( name ) , "%s%s" , path , BATCH_OUTPUT_SUFFIX );
+	if( ( input = fopen( path , "r" ) ) == NULL || ( output = fopen( name , "w" ) ) == NULL ){
+		fprintf( stderr , "batch: %s: open file error\n" , path );
+		return EXIT_FAILURE;
+	}
+	fwrite( prefix , sizeof( char ) , prefixSize , output );
+	if( reason == HALT_NONE && frozen ){
+		// タイマーは複製したプロセスに引き継がれないため、制限は入力毎に掛け直す
+		setLimit( limit );
+		setStream( input , output );
+		reason = executeGoverned( execute , getMachine()->current );
+	}
+	fclose( output );
+	fclose( input );
+	if( reason != HALT_NONE ){
+		fprintf( stderr , "batch: %s: " , path );
+		reportHalt( reason );
+		return reason == HALT_ERROR ? EXIT_FAILURE : LIMIT_EXIT_STATUS;
+	}
+	return EXIT_SUCCESS;
+}
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	exit( EXIT_FAILURE );
+}
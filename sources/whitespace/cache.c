@@ -0,0 +1,698 @@
+//
+//  cache.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include "whitespace.h"
+
+/**
+ * キャッシュの状態の数
+ * スタックの上から 0 個・1 個・2 個の値をレジスタに持つ
+ */
+#define CACHE_STATES 3
+
+/**
+ * 命令とキャッシュの状態の組から分岐先を決める値
+ */
+#define STATE( code , cached ) ( ( code ) * CACHE_STATES + ( cached ) )
+
+/**
+ * キャッシュ付きで実行する命令
+ */
+enum{
+	CACHE_PUSH ,			// 即値をスタックに積む
+	CACHE_DUPLICATE ,		// スタックの1個目の値を積む
+	CACHE_COPY ,			// スタックのn個目の値を積む
+	CACHE_SWAP ,			// スタックの1個目と2個目の値を入れ替える
+	CACHE_DROP ,			// スタックの1個目の値を削除する
+	CACHE_SLIDE ,			// スタックの1個目の値を残してn個取り除く
+	CACHE_ADDTION ,			// 足し算
+	CACHE_SUBTRACTION ,		// 引き算
+	CACHE_MULTIPLICATION ,	// 掛け算
+	CACHE_DIVISION ,		// 割り算
+	CACHE_MODULO ,			// 余剰
+	CACHE_HEAP_STORE ,		// ヒープに値を保存する
+	CACHE_HEAP_LOAD ,		// ヒープの値を積む
+	CACHE_VARIABLE_STORE ,	// 固定スロットに値を保存する
+	CACHE_VARIABLE_LOAD ,	// 固定スロットの値を積む
+	CACHE_JUMP ,			// 無条件ジャンプ
+	CACHE_ZERO_JUMP ,		// スタックの1個目が0の場合にジャンプ
+	CACHE_MINUS_JUMP ,		// スタックの1個目が負の場合にジャンプ
+	CACHE_CALL ,			// サブルーチン呼び出し
+	CACHE_TAIL_CALL ,		// 末尾位置のサブルーチン呼び出し
+	CACHE_RETURN ,			// サブルーチン終了
+	CACHE_FINISH ,			// プログラム終了
+	CACHE_NEXT ,			// 何もせず次の命令に進む
+	CACHE_FALLBACK ,		// キャッシュを書き戻してから元の命令をスタックマシンとして実行する
+	CACHE_END				// 命令列の終わり
+} typedef CacheCode;
+
+/**
+ * キャッシュ付きで実行する命令を保持する構造体
+ * 命令は元の命令の並び順に配列に並べ、次の命令は配列の次の要素になる
+ */
+struct cacheInstruction{
+	CacheCode code;						// 命令
+	long value;							// 即値・スタックの位置・固定スロットの番号
+	bool charge;						// ジャンプする時に命令数を消費する場合に true
+	struct cacheInstruction *jump;		// ジャンプ先
+	Instruction *instruction;			// 元の命令
+} typedef CacheInstruction;
+
+/**
+ * 変換した命令列
+ */
+static CacheInstruction *codes = NULL;
+
+/**
+ * 命令の通し番号から、変換した命令を引くための表
+ */
+static CacheInstruction **entries = NULL;
+
+/**
+ * 実行中の仮想マシン
+ */
+static Machine *machine = NULL;
+
+/**
+ * 命令セットをキャッシュ付きで実行する命令列に変換する
+ * @param instruction
+ *	変換する命令セット
+ * @return
+ *	最初に実行する命令
+ */
+static CacheInstruction *translate( Instruction *instruction );
+
+/**
+ * 変換した命令列を実行する
+ * @param code
+ *	最初に実行する命令
+ */
+static void run( CacheInstruction *code );
+
+/**
+ * 元の命令から変換した命令を取得する
+ * @param instruction
+ *	元の命令 NULL の場合は命令列の終わり
+ * @return
+ *	変換した命令
+ */
+static CacheInstruction *locate( Instruction *instruction );
+
+/**
+ * レジスタに持っている値をスタックに書き戻す
+ * @param first
+ *	スタックの1個目の値
+ * @param second
+ *	スタックの2個目の値
+ * @param cached
+ *	レジスタに持っている値の個数
+ */
+static void settle( long first , long second , int cached );
+
+/**
+ * スタックに値を積む
+ * @param value
+ *	積む値
+ */
+static void spill( long value );
+
+/**
+ * スタックから値を取り出す
+ * @return
+ *	取り出した値
+ */
+static long fill( void );
+
+/**
+ * 固定スロットに値を保存する
+ * 割り当てたアドレスまでヒープを確保していない間は、ヒープを確保して上限を確認する
+ * @param slot
+ *	固定スロットの番号
+ * @param value
+ *	保存する値
+ */
+static void storeVariable( int slot , long value );
+
+/**
+ * 固定スロットの値を取得する
+ * 割り当てたアドレスまでヒープを確保していない間は、ヒープの確保範囲を確認する
+ * @param slot
+ *	固定スロットの番号
+ * @return
+ *	取得した値
+ */
+static long loadVariable( int slot );
+
+/**
+ * スタックの n 番目の値を取得する
+ * @param position
+ *	0 を指定するとスタックに書き戻されている1個目の値が取得される
+ * @return
+ *	取得した値
+ */
+static long peek( long position );
+
+/**
+ * スタックの値を取り除く
+ * @param count
+ *	取り除く値の個数
+ */
+static void discard( long count );
+
+/**
+ * レジスタに持っている値も含めて、スタックの n 番目に値があることを確認する
+ * 値が無い場合は、スタックの深さを正しく報告できるようレジスタの値を書き戻してからエラーにする
+ * @param position
+ *	0 を指定するとスタックの1個目の値を確認する
+ * @param first
+ *	スタックの1個目の値
+ * @param second
+ *	スタックの2個目の値
+ * @param cached
+ *	レジスタに持っている値の個数
+ */
+static void ensure( long position , long first , long second , int cached );
+
+/**
+ * 変換した命令列を破棄する
+ */
+static void clear( void );
+
+/**
+ * プログラムの実行時エラーを通知する
+ */
+static void error( char *message );
+
+
+
+void executeCache( Instruction *instruction ){
+	// 前回の実行が途中で中断されていても、変換した命令列を持ち越さない
+	clear();
+	machine = getMachine();
+	machine->discard = clear;
+	// 実行中の命令は標本を取る割り込みのために分岐する時だけ公開する
+	machine->current = instruction;
+	run( translate( instruction ) );
+	clear();
+	return;
+}
+
+static CacheInstruction *translate( Instruction *instruction ){
+	Instruction *position;
+	CacheInstruction *code;
+	int count = 0 , limit = 0;
+	for( position = instruction ; position != NULL ; position = position->next ){
+		count++;
+		if( limit <= position->index ){
+			limit = position->index + 1;
+		}
+	}
+	codes = ( CacheInstruction * ) calloc( count + 1 , sizeof( CacheInstruction ) );
+	entries = ( CacheInstruction ** ) calloc( limit + 1 , sizeof( CacheInstruction * ) );
+	if( codes == NULL || entries == NULL ){
+		error( "cache: out of memory error" );
+	}
+	for( code = codes , position = instruction ; position != NULL ; position = position->next , code++ ){
+		entries[position->index] = code;
+		code->instruction = position;
+		code->value = position->p_value;
+		switch( position->imp ){
+			case STACK:
+				code->code = ( CacheCode[] ){ CACHE_PUSH , CACHE_DUPLICATE , CACHE_COPY , CACHE_SWAP , CACHE_DROP , CACHE_SLIDE }[position->c_stack];
+				break;
+
+			case OPERATION:
+				code->code = CACHE_ADDTION + position->c_operation;
+				break;
+
+			case HEAP:
+				code->code = ( CacheCode[] ){ CACHE_HEAP_STORE , CACHE_HEAP_LOAD , CACHE_VARIABLE_STORE , CACHE_VARIABLE_LOAD , CACHE_FALLBACK , CACHE_FALLBACK }[position->c_heap];
+				break;
+
+			case FLOW_CONTROL:
+				code->code = ( CacheCode[] ){ CACHE_NEXT , CACHE_CALL , CACHE_JUMP , CACHE_ZERO_JUMP , CACHE_MINUS_JUMP , CACHE_RETURN , CACHE_FINISH , CACHE_TAIL_CALL }[position->c_control];
+				// 命令数の消費はスタックマシンと同じく、分岐とサブルーチンの呼び出しと終了で行う
+				code->charge = machine->governed && ( position->jump != NULL || code->code == CACHE_RETURN );
+				break;
+
+			default:
+				code->code = CACHE_FALLBACK;
+				break;
+		}
+	}
+	code->code = CACHE_END;
+	for( code = codes ; code->code != CACHE_END ; code++ ){
+		if( code->instruction->imp == FLOW_CONTROL && code->instruction->jump != NULL ){
+			code->jump = locate( code->instruction->jump );
+		}
+	}
+	return locate( instruction );
+}
+
+static void run( CacheInstruction *code ){
+	long first = 0 , second = 0 , value;
+	int cached = 0;
+	while( true ){
+		switch( STATE( code->code , cached ) ){
+			case STATE( CACHE_PUSH , 0 ):
+				first = code->value;
+				cached = 1;
+				break;
+			case STATE( CACHE_PUSH , 1 ):
+				second = first;
+				first = code->value;
+				cached = 2;
+				break;
+			case STATE( CACHE_PUSH , 2 ):
+				spill( second );
+				second = first;
+				first = code->value;
+				break;
+
+			case STATE( CACHE_DUPLICATE , 0 ):
+				first = second = fill();
+				cached = 2;
+				break;
+			case STATE( CACHE_DUPLICATE , 1 ):
+				second = first;
+				cached = 2;
+				break;
+			case STATE( CACHE_DUPLICATE , 2 ):
+				spill( second );
+				second = first;
+				break;
+
+			case STATE( CACHE_COPY , 0 ):
+				first = peek( code->value );
+				cached = 1;
+				break;
+			case STATE( CACHE_COPY , 1 ):
+				ensure( code->value , first , second , cached );
+				second = first;
+				first = code->value == 0 ? first : peek( code->value - 1 );
+				cached = 2;
+				break;
+			case STATE( CACHE_COPY , 2 ):
+				ensure( code->value , first , second , cached );
+				value = code->value == 0 ? first : code->value == 1 ? second : peek( code->value - 2 );
+				spill( second );
+				second = first;
+				first = value;
+				break;
+
+			case STATE( CACHE_SWAP , 0 ):
+				second = fill();
+				first = fill();
+				cached = 2;
+				break;
+			case STATE( CACHE_SWAP , 1 ):
+				second = first;
+				first = fill();
+				cached = 2;
+				break;
+			case STATE( CACHE_SWAP , 2 ):
+				value = first;
+				first = second;
+				second = value;
+				break;
+
+			case STATE( CACHE_DROP , 0 ):
+				fill();
+				break;
+			case STATE( CACHE_DROP , 1 ):
+				cached = 0;
+				break;
+			case STATE( CACHE_DROP , 2 ):
+				first = second;
+				cached = 1;
+				break;
+
+			case STATE( CACHE_SLIDE , 0 ):
+				first = fill();
+				discard( code->value );
+				cached = 1;
+				break;
+			case STATE( CACHE_SLIDE , 1 ):
+				ensure( code->value , first , second , cached );
+				discard( code->value );
+				break;
+			case STATE( CACHE_SLIDE , 2 ):
+				ensure( code->value , first , second , cached );
+				if( 0 < code->value ){
+					discard( code->value - 1 );
+					cached = 1;
+				}
+				break;
+
+			case STATE( CACHE_ADDTION , 0 ):
+				value = fill();
+				first = fill() + value;
+				cached = 1;
+				break;
+			case STATE( CACHE_ADDTION , 1 ):
+				first = fill() + first;
+				break;
+			case STATE( CACHE_ADDTION , 2 ):
+				first = second + first;
+				cached = 1;
+				break;
+
+			case STATE( CACHE_SUBTRACTION , 0 ):
+				value = fill();
+				first = fill() - value;
+				cached = 1;
+				break;
+			case STATE( CACHE_SUBTRACTION , 1 ):
+				first = fill() - first;
+				break;
+			case STATE( CACHE_SUBTRACTION , 2 ):
+				first = second - first;
+				cached = 1;
+				break;
+
+			case STATE( CACHE_MULTIPLICATION , 0 ):
+				value = fill();
+				first = fill() * value;
+				cached = 1;
+				break;
+			case STATE( CACHE_MULTIPLICATION , 1 ):
+				first = fill() * first;
+				break;
+			case STATE( CACHE_MULTIPLICATION , 2 ):
+				first = second * first;
+				cached = 1;
+				break;
+
+			case STATE( CACHE_DIVISION , 0 ):
+				value = fill();
+				first = fill() / value;
+				cached = 1;
+				break;
+			case STATE( CACHE_DIVISION , 1 ):
+				first = fill() / first;
+				break;
+			case STATE( CACHE_DIVISION , 2 ):
+				first = second / first;
+				cached = 1;
+				break;
+
+			case STATE( CACHE_MODULO , 0 ):
+				value = fill();
+				first = fill() % value;
+				cached = 1;
+				break;
+			case STATE( CACHE_MODULO , 1 ):
+				first = fill() % first;
+				break;
+			case STATE( CACHE_MODULO , 2 ):
+				first = second % first;
+				cached = 1;
+				break;
+
+			case STATE( CACHE_HEAP_STORE , 0 ):
+				value = fill();
+				setHeapValue( ( int ) fill() , value );
+				break;
+			case STATE( CACHE_HEAP_STORE , 1 ):
+				setHeapValue( ( int ) fill() , first );
+				cached = 0;
+				break;
+			case STATE( CACHE_HEAP_STORE , 2 ):
+				setHeapValue( ( int ) second , first );
+				cached = 0;
+				break;
+
+			case STATE( CACHE_HEAP_LOAD , 0 ):
+				first = getHeapValue( ( int ) fill() );
+				cached = 1;
+				break;
+			case STATE( CACHE_HEAP_LOAD , 1 ):
+				first = getHeapValue( ( int ) first );
+				break;
+			case STATE( CACHE_HEAP_LOAD , 2 ):
+				// 確保していないアドレスの場合にスタックの深さを正しく報告できるよう、残る値を書き戻してから読み込む
+				if( machine->heapAllocation <= ( size_t ) ( int ) first ){
+					spill( second );
+					cached = 1;
+				}
+				first = getHeapValue( ( int ) first );
+				break;
+
+			case STATE( CACHE_VARIABLE_STORE , 0 ):
+				storeVariable( code->value , fill() );
+				break;
+			case STATE( CACHE_VARIABLE_STORE , 1 ):
+				storeVariable( code->value , first );
+				cached = 0;
+				break;
+			case STATE( CACHE_VARIABLE_STORE , 2 ):
+				// ヒープを確保する場合は上限に達することがあるため、残る値を書き戻してから保存する
+				if( machine->heapAllocation < machine->variableLimit ){
+					spill( second );
+					storeVariable( code->value , first );
+					cached = 0;
+					break;
+				}
+				storeVariable( code->value , first );
+				first = second;
+				cached = 1;
+				break;
+
+			case STATE( CACHE_VARIABLE_LOAD , 0 ):
+				first = loadVariable( code->value );
+				cached = 1;
+				break;
+			case STATE( CACHE_VARIABLE_LOAD , 1 ):
+			case STATE( CACHE_VARIABLE_LOAD , 2 ):
+				// 書き込んでいないアドレスの場合にスタックの深さを正しく報告できるよう、書き戻してから読み込む
+				if( machine->heapAllocation < machine->variableLimit ){
+					settle( first , second , cached );
+					first = loadVariable( code->value );
+					cached = 1;
+					break;
+				}
+				if( cached == 2 ){
+					spill( second );
+				}
+				second = first;
+				first = loadVariable( code->value );
+				cached = 2;
+				break;
+
+			case STATE( CACHE_ZERO_JUMP , 0 ):
+			case STATE( CACHE_MINUS_JUMP , 0 ):
+				value = fill();
+				if( code->code == CACHE_ZERO_JUMP ? value != 0 : 0 <= value ){
+					break;
+				}
+				if( code->charge ){
+					chargeFuel( code->instruction , code->instruction->jump );
+				}
+				code = code->jump;
+				machine->current = code->instruction;
+				continue;
+			case STATE( CACHE_ZERO_JUMP , 1 ):
+			case STATE( CACHE_MINUS_JUMP , 1 ):
+				value = first;
+				cached = 0;
+				if( code->code == CACHE_ZERO_JUMP ? value != 0 : 0 <= value ){
+					break;
+				}
+				if( code->charge ){
+					chargeFuel( code->instruction , code->instruction->jump );
+				}
+				code = code->jump;
+				machine->current = code->instruction;
+				continue;
+			case STATE( CACHE_ZERO_JUMP , 2 ):
+			case STATE( CACHE_MINUS_JUMP , 2 ):
+				value = first;
+				first = second;
+				cached = 1;
+				if( code->code == CACHE_ZERO_JUMP ? value != 0 : 0 <= value ){
+					break;
+				}
+				if( code->charge ){
+					// 命令数を使い切った場合にスタックの深さを正しく報告できるよう書き戻す
+					settle( first , second , cached );
+					cached = 0;
+					chargeFuel( code->instruction , code->instruction->jump );
+				}
+				code = code->jump;
+				machine->current = code->instruction;
+				continue;
+
+			case STATE( CACHE_JUMP , 0 ):
+			case STATE( CACHE_JUMP , 1 ):
+			case STATE( CACHE_JUMP , 2 ):
+				if( code->charge ){
+					settle( first , second , cached );
+					cached = 0;
+					chargeFuel( code->instruction , code->instruction->jump );
+				}
+				code = code->jump;
+				machine->current = code->instruction;
+				continue;
+
+			case STATE( CACHE_CALL , 0 ):
+			case STATE( CACHE_CALL , 1 ):
+			case STATE( CACHE_CALL , 2 ):
+			case STATE( CACHE_TAIL_CALL , 0 ):
+			case STATE( CACHE_TAIL_CALL , 1 ):
+			case STATE( CACHE_TAIL_CALL , 2 ):
+				if( code->charge ){
+					settle( first , second , cached );
+					cached = 0;
+					chargeFuel( code->instruction , code->instruction->jump );
+				}
+				if( code->code == CACHE_CALL || machine->callPointer == 0 ){
+					// 呼び出しの深さが上限に達した場合にスタックの深さを正しく報告できるよう書き戻す
+					if( machine->callAllocation == machine->callPointer ){
+						settle( first , second , cached );
+						cached = 0;
+					}
+					pushCall( code->instruction->next );
+				}
+				code = code->jump;
+				machine->current = code->instruction;
+				continue;
+
+			case STATE( CACHE_RETURN , 0 ):
+			case STATE( CACHE_RETURN , 1 ):
+			case STATE( CACHE_RETURN , 2 ):
+				// 命令数を使い切った場合に呼び出しの深さを正しく報告できるよう、戻り先を取り出してから消費する
+				machine->current = 0 < machine->callPointer ? machine->calls[--machine->callPointer] : code->instruction->next;
+				if( code->charge ){
+					settle( first , second , cached );
+					cached = 0;
+					chargeFuel( code->instruction , machine->current );
+				}
+				code = locate( machine->current );
+				continue;
+
+			case STATE( CACHE_NEXT , 0 ):
+			case STATE( CACHE_NEXT , 1 ):
+			case STATE( CACHE_NEXT , 2 ):
+				break;
+
+			case STATE( CACHE_FALLBACK , 0 ):
+			case STATE( CACHE_FALLBACK , 1 ):
+			case STATE( CACHE_FALLBACK , 2 ):
+				settle( first , second , cached );
+				cached = 0;
+				baseProcess( code->instruction );
+				code = locate( machine->current );
+				continue;
+
+			case STATE( CACHE_END , 0 ):
+			case STATE( CACHE_END , 1 ):
+			case STATE( CACHE_END , 2 ):
+				if( 0 < machine->callPointer ){
+					code = locate( machine->calls[--machine->callPointer] );
+					machine->current = code->instruction;
+					continue;
+				}
+				settle( first , second , cached );
+				return;
+
+			case STATE( CACHE_FINISH , 0 ):
+			case STATE( CACHE_FINISH , 1 ):
+			case STATE( CACHE_FINISH , 2 ):
+				settle( first , second , cached );
+				return;
+
+			default:
+				error( "cache: illegal instruction" );
+				break;
+		}
+		code++;
+	}
+}
+
+static CacheInstruction *locate( Instruction *instruction ){
+	CacheInstruction *code;
+	if( instruction == NULL ){
+		for( code = codes ; code->code != CACHE_END ; code++ );
+		return code;
+	}
+	return entries[instruction->index];
+}
+
+static void settle( long first , long second , int cached ){
+	if( cached == 2 ){
+		spill( second );
+	}
+	if( 0 < cached ){
+		spill( first );
+	}
+	return;
+}
+
+static void spill( long value ){
+	if( machine->stackAllocation <= ( size_t ) machine->stackPointer ){
+		reserveStack( 1 );
+	}
+	machine->stack[machine->stackPointer++] = value;
+	return;
+}
+
+static long fill( void ){
+	if( machine->stackPointer == 0 ){
+		error( "do not have value in stack" );
+	}
+	return machine->stack[--machine->stackPointer];
+}
+
+static void storeVariable( int slot , long value ){
+	if( machine->heapAllocation < machine->variableLimit ){
+		setVariableValue( slot , value );
+		return;
+	}
+	machine->variables[slot] = value;
+	return;
+}
+
+static long loadVariable( int slot ){
+	return machine->heapAllocation < machine->variableLimit ? getVariableValue( slot ) : machine->variables[slot];
+}
+
+static long peek( long position ){
+	if( position < 0 || machine->stackPointer <= position ){
+		error( "do not have value in stack" );
+	}
+	return machine->stack[machine->stackPointer - position - 1];
+}
+
+static void discard( long count ){
+	if( count < 0 || machine->stackPointer < count ){
+		error( "do not have value in stack" );
+	}
+	machine->stackPointer -= ( int ) count;
+	return;
+}
+
+static void ensure( long position , long first , long second , int cached ){
+	if( position < 0 || machine->stackPointer + cached <= position ){
+		settle( first , second , cached );
+		error( "do not have value in stack" );
+	}
+	return;
+}
+
+static void clear( void ){
+	free( codes );
+	free( entries );
+	codes = NULL;
+	entries = NULL;
+	return;
+}
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	halt( HALT_ERROR );
+}
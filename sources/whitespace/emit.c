@@ -0,0 +1,1287 @@
+//
+//  emit.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include <limits.h>
+#include <sys/stat.h>
+#include "whitespace.h"
+
+/**
+ * 実行ファイルを読み込む仮想アドレス
+ */
+#define EMIT_BASE_ADDRESS 0x400000UL
+
+/**
+ * ELF ヘッダとプログラムヘッダの大きさ
+ * 機械語はこの直後に置く
+ */
+#define EMIT_HEADER_SIZE ( 64 + 56 )
+
+/**
+ * 実行時に確保するヒープの大きさ
+ * int で表せる非負のアドレス全てを覆い、実際に触れたページだけが割り当てられる
+ */
+#define EMIT_HEAP_SIZE ( 1UL << 34 )
+
+/**
+ * 実行時に確保するスタックの大きさ
+ */
+#define EMIT_STACK_SIZE ( 1UL << 32 )
+
+/**
+ * 実行時に確保するサブルーチンの戻り先を積むスタックの大きさ
+ */
+#define EMIT_CALL_SIZE ( 1UL << 30 )
+
+/**
+ * 出力をまとめて書き込むバッファの大きさ
+ */
+#define EMIT_OUTPUT_SIZE ( 1 << 16 )
+
+/**
+ * 入力をまとめて読み込むバッファの大きさ
+ */
+#define EMIT_INPUT_SIZE ( 1 << 16 )
+
+/**
+ * 入力の状態の中の位置
+ * 読み込んだデータは EMIT_INPUT_DATA の位置から置く
+ */
+#define EMIT_INPUT_POSITION 0
+#define EMIT_INPUT_END 8
+#define EMIT_INPUT_EOF 16
+#define EMIT_INPUT_DATA 64
+
+/**
+ * 入力の状態の後ろに置く実行時の状態の位置
+ * スタックの先頭のアドレスと、インタプリタと同じ単位で確保したことにしたヒープの値の個数を持つ
+ */
+#define EMIT_STACK_BASE 24
+#define EMIT_HEAP_LIMIT 32
+
+/**
+ * 実行時に確保する領域全体の大きさ
+ */
+#define EMIT_REGION_SIZE ( EMIT_HEAP_SIZE + EMIT_STACK_SIZE + EMIT_CALL_SIZE + EMIT_OUTPUT_SIZE + EMIT_INPUT_DATA + EMIT_INPUT_SIZE )
+
+/**
+ * x86-64 の汎用レジスタ
+ */
+enum{
+	RAX , RCX , RDX , RBX , RSP , RBP , RSI , RDI ,
+	R8 , R9 , R10 , R11 , R12 , R13 , R14 , R15
+} typedef Register;
+
+/**
+ * 生成したコードでの役割を固定したレジスタ
+ * システムコールで壊れない callee-saved のレジスタを使う
+ */
+#define HEAP_BASE R12		// ヒープの先頭
+#define STACK_TOP R13		// スタックの次に積む位置
+#define OUTPUT_TOP R14		// 出力バッファの次に書き込む位置
+#define CALL_DEPTH R15		// サブルーチンの呼び出しの深さ
+#define OUTPUT_BASE RBX		// 出力バッファの先頭
+#define INPUT_BASE RBP		// 入力の状態の先頭
+
+/**
+ * 使用する x86-64 の命令コード
+ * 0xFF を超えるものは 0x0F から始まる2バイトの命令コード
+ */
+enum{
+	X86_ADD = 0x01 ,
+	X86_SUB = 0x29 ,
+	X86_XOR = 0x31 ,
+	X86_CMP = 0x3B ,
+	X86_MOVSXD = 0x63 ,
+	X86_TEST = 0x85 ,
+	X86_STORE_BYTE = 0x88 ,
+	X86_STORE = 0x89 ,
+	X86_LOAD_BYTE = 0x8A ,
+	X86_LOAD = 0x8B ,
+	X86_LEA = 0x8D ,
+	X86_CQO = 0x99 ,
+	X86_MOVE_REGISTER = 0xB8 ,
+	X86_MOVE_BYTE_IMMEDIATE = 0xC6 ,
+	X86_MOVE_IMMEDIATE = 0xC7 ,
+	X86_RETURN = 0xC3 ,
+	X86_CALL = 0xE8 ,
+	X86_JUMP = 0xE9 ,
+	X86_UNARY = 0xF7 ,
+	X86_INCREMENT = 0xFF ,
+	X86_SYSCALL = 0x0F05 ,
+	X86_JB = 0x0F82 ,
+	X86_JAE = 0x0F83 ,
+	X86_JZ = 0x0F84 ,
+	X86_JNZ = 0x0F85 ,
+	X86_JBE = 0x0F86 ,
+	X86_JA = 0x0F87 ,
+	X86_JS = 0x0F88 ,
+	X86_JNS = 0x0F89 ,
+	X86_JLE = 0x0F8E ,
+	X86_JG = 0x0F8F ,
+	X86_IMUL = 0x0FAF ,
+	X86_MOVZX_BYTE = 0x0FB6
+} typedef Opcode;
+
+/**
+ * ModRM の reg 欄で命令を選ぶ命令群の番号
+ */
+enum{
+	GROUP_ADD = 0 ,		// 0x81 / 0x83
+	GROUP_OR = 1 ,
+	GROUP_SUB = 5 ,
+	GROUP_CMP = 7 ,
+	GROUP_INC = 0 ,		// 0xFF
+	GROUP_DEC = 1 ,
+	GROUP_NEG = 3 ,		// 0xF7
+	GROUP_MUL = 4 ,
+	GROUP_DIV = 6 ,
+	GROUP_IDIV = 7
+} typedef Group;
+
+/**
+ * 命令の位置が決まってから書き換えるジャンプ先
+ */
+struct{
+	size_t position;		// rel32 を書き込む位置
+	Instruction *target;	// ジャンプ先の命令
+} typedef Fixup;
+
+/**
+ * 生成した機械語
+ */
+static unsigned char *code = NULL;
+
+/**
+ * 生成した機械語の大きさ
+ */
+static size_t codeSize = 0;
+
+/**
+ * 機械語の領域の大きさ
+ */
+static size_t codeAllocation = 0;
+
+/**
+ * 書き換えを待っているジャンプ先
+ */
+static Fixup *fixups = NULL;
+
+/**
+ * 書き換えを待っているジャンプ先の数
+ */
+static int fixupCount = 0;
+
+/**
+ * 書き換えを待っているジャンプ先の領域の数
+ */
+static int fixupAllocation = 0;
+
+/**
+ * 命令の通し番号から、その命令の機械語の位置を引くための表
+ */
+static long *offsets = NULL;
+
+/**
+ * 固定スロットの番号から、割り当てたヒープのアドレスを引くための表
+ */
+static long *slots = NULL;
+
+/**
+ * 実行時ルーチンの位置
+ */
+static size_t flushAt , putCharAt , putNumberAt , getByteAt , getNumberAt , exitAt , failAt , heapErrorAt , stackErrorAt;
+
+/**
+ * 機械語の先頭から実行を始める位置
+ */
+static size_t entryAt;
+
+/**
+ * 実行時に領域を確保できなかった場合に表示するメッセージ
+ */
+static const char failure[] = "do not allocate memory\n";
+
+/**
+ * 負のアドレスや確保していないアドレスでヒープを参照した場合に表示するメッセージ
+ * failure の直後に置く
+ */
+static const char heapFailure[] = "execute: do not allocation in heap\n";
+
+/**
+ * スタックに値が無い場合に表示するメッセージ
+ * heapFailure の直後に置く
+ */
+static const char stackFailure[] = "do not have value in stack\n";
+
+/**
+ * 1バイト書き込む
+ * @param value
+ *	書き込む値
+ */
+static void putByte( int value );
+
+/**
+ * リトルエンディアンで書き込む
+ * @param value
+ *	書き込む値
+ * @param size
+ *	書き込むバイト数
+ */
+static void putValue( unsigned long value , int size );
+
+/**
+ * REX プレフィックスと命令コードを書き込む
+ * @param wide
+ *	64bit で演算する場合は true
+ * @param opcode
+ *	命令コード
+ * @param reg
+ *	ModRM の reg 欄に入れるレジスタ
+ * @param rm
+ *	ModRM の r/m 欄や命令コードに入れるレジスタ
+ */
+static void putOpcode( bool wide , int opcode , int reg , int rm );
+
+/**
+ * レジスタ同士の命令を書き込む
+ * @param wide
+ *	64bit で演算する場合は true
+ * @param opcode
+ *	命令コード
+ * @param reg
+ *	ModRM の reg 欄に入れるレジスタか命令群の番号
+ * @param rm
+ *	ModRM の r/m 欄に入れるレジスタ
+ */
+static void operate( bool wide , int opcode , int reg , int rm );
+
+/**
+ * [base+displacement] を参照する命令を書き込む
+ * @param wide
+ *	64bit で演算する場合は true
+ * @param opcode
+ *	命令コード
+ * @param reg
+ *	ModRM の reg 欄に入れるレジスタか命令群の番号
+ * @param base
+ *	参照するアドレスのレジスタ
+ * @param displacement
+ *	参照するアドレスのずれ
+ */
+static void memory( bool wide , int opcode , int reg , int base , long displacement );
+
+/**
+ * [HEAP_BASE+index*8] を参照する命令を書き込む
+ * インタプリタと同じく、アドレスが負の場合や確保していないアドレスを読み込む場合はヒープのエラーとして終了する
+ * 書き込む場合は HEAP_ALLOCATION_SIZE 単位で確保したことにする rdx を壊す
+ * @param opcode
+ *	命令コード X86_STORE か X86_LOAD
+ * @param reg
+ *	ModRM の reg 欄に入れるレジスタ
+ * @param index
+ *	ヒープのアドレスのレジスタ
+ */
+static void heap( int opcode , int reg , int index );
+
+/**
+ * 固定スロットに割り当てたアドレスを heap と同じく確認する命令を書き込む rdx を壊す
+ * @param store
+ *	書き込む場合は true
+ * @param slot
+ *	固定スロットの番号
+ */
+static void reach( bool store , long slot );
+
+/**
+ * スタックに指定した個数の値が無い場合にエラーとして終了する命令を書き込む rax を壊す
+ * @param count
+ *	必要な値の個数 1 未満の場合は常にエラーとして終了する
+ */
+static void require( long count );
+
+/**
+ * 即値との演算を書き込む
+ * @param wide
+ *	64bit で演算する場合は true
+ * @param group
+ *	命令群の番号
+ * @param rm
+ *	演算するレジスタ
+ * @param value
+ *	即値
+ */
+static void immediate( bool wide , Group group , int rm , long value );
+
+/**
+ * レジスタに即値を設定する命令を書き込む
+ * @param reg
+ *	設定するレジスタ
+ * @param value
+ *	設定する値
+ */
+static void setRegister( int reg , long value );
+
+/**
+ * レジスタを退避する命令を書き込む
+ * @param reg
+ *	退避するレジスタ
+ */
+static void pushRegister( int reg );
+
+/**
+ * 退避したレジスタを戻す命令を書き込む
+ * @param reg
+ *	戻すレジスタ
+ */
+static void popRegister( int reg );
+
+/**
+ * rel32 を取る分岐命令を書き込む
+ * @param opcode
+ *	命令コード
+ * @return
+ *	rel32 を書き込む位置
+ */
+static size_t branch( Opcode opcode );
+
+/**
+ * 分岐命令の rel32 を書き換える
+ * @param position
+ *	rel32 を書き込む位置
+ * @param target
+ *	分岐先の位置
+ */
+static void patch( size_t position , size_t target );
+
+/**
+ * 分岐命令を書き込み、命令の位置が決まってから分岐先を書き換える
+ * @param opcode
+ *	命令コード
+ * @param target
+ *	分岐先の命令
+ */
+static void branchInstruction( Opcode opcode , Instruction *target );
+
+/**
+ * 実行時ルーチンを書き込む
+ */
+static void emitRuntime( void );
+
+/**
+ * 実行を始める時の領域の確保とレジスタの初期化を書き込む
+ */
+static void emitEntry( void );
+
+/**
+ * 1命令分の機械語を書き込む
+ * @param instruction
+ *	書き込む命令
+ */
+static void emitInstruction( Instruction *instruction );
+
+/**
+ * スタック操作命令の機械語を書き込む
+ * @param instruction
+ *	書き込む命令
+ */
+static void emitStack( Instruction *instruction );
+
+/**
+ * 演算命令の機械語を書き込む
+ * @param instruction
+ *	書き込む命令
+ */
+static void emitOperation( Instruction *instruction );
+
+/**
+ * ヒープアクセス命令の機械語を書き込む
+ * @param instruction
+ *	書き込む命令
+ */
+static void emitHeap( Instruction *instruction );
+
+/**
+ * フロー制御命令の機械語を書き込む
+ * @param instruction
+ *	書き込む命令
+ */
+static void emitControl( Instruction *instruction );
+
+/**
+ * 入出力命令の機械語を書き込む
+ * @param instruction
+ *	書き込む命令
+ */
+static void emitIO( Instruction *instruction );
+
+/**
+ * 固定スロットに割り当てたヒープのアドレスからの位置を取得する
+ * @param slot
+ *	固定スロットの番号
+ * @return
+ *	HEAP_BASE からの位置
+ */
+static long getSlotDisplacement( long slot );
+
+/**
+ * ELF ヘッダとプログラムヘッダを作成する
+ * @param header
+ *	EMIT_HEADER_SIZE バイトの書き込み先
+ */
+static void setHeader( unsigned char *header );
+
+/**
+ * リトルエンディアンで書き込む
+ * @param destination
+ *	書き込み先
+ * @param value
+ *	書き込む値
+ * @param size
+ *	書き込むバイト数
+ */
+static void setValue( unsigned char *destination , unsigned long value , int size );
+
+/**
+ * 生成した機械語と表を破棄する
+ */
+static void emitClear( void );
+
+/**
+ * エラー出力を行う
+ * 出力後、プログラムは終了する
+ * @param message
+ *	エラーメッセージ
+ */
+static void error( char *message );
+
+
+
+void emitExecutable( Instruction *instruction , const char *path ){
+	Instruction *position;
+	Machine *machine = getMachine();
+	unsigned char header[EMIT_HEADER_SIZE];
+	FILE *file;
+	int index , count = 0;
+	for( position = instruction ; position != NULL ; position = position->next ){
+		position->index = count++;
+	}
+	if( ( offsets = ( long * ) malloc( sizeof( long ) * ( count + 1 ) ) ) == NULL ){
+		error( "emit: out of memory error" );
+	}
+	if( 0 < machine->variableCount ){
+		if( ( slots = ( long * ) malloc( sizeof( long ) * machine->variableCount ) ) == NULL ){
+			error( "emit: out of memory error" );
+		}
+		for( index = 0 ; index < machine->variableLimit ; index++ ){
+			if( 0 <= machine->variableAt[index] ){
+				slots[machine->variableAt[index]] = index;
+			}
+		}
+	}
+
+	emitRuntime();
+	emitEntry();
+	for( position = instruction ; position != NULL ; position = position->next ){
+		offsets[position->index] = codeSize;
+		emitInstruction( position );
+	}
+	// 命令列の終わりに達した場合、サブルーチンの中なら戻り、そうでなければ終了する
+	operate( true , X86_TEST , CALL_DEPTH , CALL_DEPTH );
+	patch( branch( X86_JZ ) , exitAt );
+	operate( true , X86_INCREMENT , GROUP_DEC , CALL_DEPTH );
+	putByte( X86_RETURN );
+
+	for( index = 0 ; index < fixupCount ; index++ ){
+		if( fixups[index].target->index < 0 || count <= fixups[index].target->index ){
+			error( "emit: jump target is not in program" );
+		}
+		patch( fixups[index].position , offsets[fixups[index].target->index] );
+	}
+
+	setHeader( header );
+	if( ( file = fopen( path , "wb" ) ) == NULL ){
+		error( "emit: open file error" );
+	}
+	if( fwrite( header , sizeof( header ) , 1 , file ) != 1 || fwrite( code , codeSize , 1 , file ) != 1 ){
+		error( "emit: write file error" );
+	}
+	fclose( file );
+	chmod( path , 0755 );
+	emitClear();
+	return;
+}
+
+static void putByte( int value ){
+	if( codeAllocation <= codeSize ){
+		codeAllocation += BUFFER_SIZE * 16;
+		if( ( code = ( unsigned char * ) realloc( code , codeAllocation ) ) == NULL ){
+			error( "emit: out of memory error" );
+		}
+	}
+	code[codeSize++] = ( unsigned char ) value;
+	return;
+}
+
+static void putValue( unsigned long value , int size ){
+	while( size-- ){
+		putByte( value & 0xFF );
+		value >>= 8;
+	}
+	return;
+}
+
+static void putOpcode( bool wide , int opcode , int reg , int rm ){
+	int rex = ( wide ? 0x48 : 0x40 ) | ( reg & 8 ? 0x04 : 0 ) | ( rm & 8 ? 0x01 : 0 );
+	if( rex != 0x40 ){
+		putByte( rex );
+	}
+	if( 0xFF < opcode ){
+		putByte( opcode >> 8 );
+	}
+	putByte( opcode & 0xFF );
+	return;
+}
+
+static void operate( bool wide , int opcode , int reg , int rm ){
+	putOpcode( wide , opcode , reg , rm );
+	putByte( 0xC0 | ( reg & 7 ) << 3 | ( rm & 7 ) );
+	return;
+}
+
+static void memory( bool wide , int opcode , int reg , int base , long displacement ){
+	int mode;
+	if( displacement < -0x80000000L || 0x7FFFFFFFL < displacement ){
+		error( "emit: displacement out of range" );
+	}
+	if( displacement == 0 && ( base & 7 ) != RBP ){
+		mode = 0x00;
+	}
+	else if( -0x80 <= displacement && displacement <= 0x7F ){
+		mode = 0x40;
+	}
+	else{
+		mode = 0x80;
+	}
+	putOpcode( wide , opcode , reg , base );
+	putByte( mode | ( reg & 7 ) << 3 | ( base & 7 ) );
+	if( ( base & 7 ) == RSP ){
+		putByte( 0x24 );
+	}
+	if( mode == 0x40 ){
+		putValue( ( unsigned long ) displacement , 1 );
+	}
+	else if( mode == 0x80 ){
+		putValue( ( unsigned long ) displacement , 4 );
+	}
+	return;
+}
+
+static void heap( int opcode , int reg , int index ){
+	size_t skip;
+	operate( true , X86_TEST , index , index );
+	patch( branch( X86_JS ) , heapErrorAt );
+	memory( true , X86_CMP , index , INPUT_BASE , EMIT_HEAP_LIMIT );
+	if( opcode == X86_LOAD ){
+		patch( branch( X86_JAE ) , heapErrorAt );
+	}
+	else{
+		// インタプリタと同じくアドレスを含む HEAP_ALLOCATION_SIZE 単位の境界まで確保したことにする
+		skip = branch( X86_JB );
+		operate( true , X86_STORE , index , RDX );
+		immediate( true , GROUP_OR , RDX , HEAP_ALLOCATION_SIZE - 1 );
+		immediate( true , GROUP_ADD , RDX , 1 );
+		memory( true , X86_STORE , RDX , INPUT_BASE , EMIT_HEAP_LIMIT );
+		patch( skip , codeSize );
+	}
+	putByte( 0x48 | ( reg & 8 ? 0x04 : 0 ) | ( index & 8 ? 0x02 : 0 ) | ( HEAP_BASE & 8 ? 0x01 : 0 ) );
+	putByte( opcode );
+	putByte( 0x04 | ( reg & 7 ) << 3 );
+	putByte( 0xC0 | ( index & 7 ) << 3 | ( HEAP_BASE & 7 ) );
+	return;
+}
+
+static void reach( bool store , long slot ){
+	long address = getSlotDisplacement( slot ) / ( long ) sizeof( long );
+	size_t skip;
+	memory( true , 0x81 , GROUP_CMP , INPUT_BASE , EMIT_HEAP_LIMIT );
+	putValue( ( unsigned long ) address , 4 );
+	if( ! store ){
+		patch( branch( X86_JBE ) , heapErrorAt );
+		return;
+	}
+	skip = branch( X86_JA );
+	setRegister( RDX , ( address | ( HEAP_ALLOCATION_SIZE - 1 ) ) + 1 );
+	memory( true , X86_STORE , RDX , INPUT_BASE , EMIT_HEAP_LIMIT );
+	patch( skip , codeSize );
+	return;
+}
+
+static void require( long count ){
+	if( count < 1 ){
+		patch( branch( X86_JUMP ) , stackErrorAt );
+		return;
+	}
+	memory( true , X86_LEA , RAX , STACK_TOP , -8 * count );
+	memory( true , X86_CMP , RAX , INPUT_BASE , EMIT_STACK_BASE );
+	patch( branch( X86_JB ) , stackErrorAt );
+	return;
+}
+
+static void immediate( bool wide , Group group , int rm , long value ){
+	if( -0x80 <= value && value <= 0x7F ){
+		operate( wide , 0x83 , group , rm );
+		putValue( ( unsigned long ) value , 1 );
+	}
+	else{
+		operate( wide , 0x81 , group , rm );
+		putValue( ( unsigned long ) value , 4 );
+	}
+	return;
+}
+
+static void setRegister( int reg , long value ){
+	if( 0 <= value && value <= 0xFFFFFFFFL ){
+		putOpcode( false , X86_MOVE_REGISTER + ( reg & 7 ) , 0 , reg );
+		putValue( ( unsigned long ) value , 4 );
+	}
+	else if( -0x80000000L <= value && value < 0 ){
+		operate( true , X86_MOVE_IMMEDIATE , 0 , reg );
+		putValue( ( unsigned long ) value , 4 );
+	}
+	else{
+		putOpcode( true , X86_MOVE_REGISTER + ( reg & 7 ) , 0 , reg );
+		putValue( ( unsigned long ) value , 8 );
+	}
+	return;
+}
+
+static void pushRegister( int reg ){
+	putOpcode( false , 0x50 + ( reg & 7 ) , 0 , reg );
+	return;
+}
+
+static void popRegister( int reg ){
+	putOpcode( false , 0x58 + ( reg & 7 ) , 0 , reg );
+	return;
+}
+
+static size_t branch( Opcode opcode ){
+	size_t position;
+	putOpcode( false , opcode , 0 , 0 );
+	position = codeSize;
+	putValue( 0 , 4 );
+	return position;
+}
+
+static void patch( size_t position , size_t target ){
+	setValue( code + position , ( unsigned long ) ( ( long ) target - ( long ) ( position + 4 ) ) , 4 );
+	return;
+}
+
+static void branchInstruction( Opcode opcode , Instruction *target ){
+	if( target == NULL ){
+		error( "emit: jump target is not in program" );
+	}
+	if( fixupAllocation <= fixupCount ){
+		fixupAllocation += BUFFER_SIZE;
+		if( ( fixups = ( Fixup * ) realloc( fixups , sizeof( Fixup ) * fixupAllocation ) ) == NULL ){
+			error( "emit: out of memory error" );
+		}
+	}
+	fixups[fixupCount].position = branch( opcode );
+	fixups[fixupCount].target = target;
+	fixupCount++;
+	return;
+}
+
+static void emitRuntime( void ){
+	size_t loop , done , skip , next , finish , digits , stop , plus , negative , skips[5] , overflows[2] , counts[2];
+	int index;
+
+	for( index = 0 ; failure[index] != '\0' ; index++ ){
+		putByte( failure[index] );
+	}
+	for( index = 0 ; heapFailure[index] != '\0' ; index++ ){
+		putByte( heapFailure[index] );
+	}
+	for( index = 0 ; stackFailure[index] != '\0' ; index++ ){
+		putByte( stackFailure[index] );
+	}
+
+	// 出力バッファを書き出す rax rcx rdx r11 を壊す
+	flushAt = codeSize;
+	pushRegister( RSI );
+	pushRegister( RDI );
+	operate( true , X86_STORE , OUTPUT_BASE , RSI );
+	operate( true , X86_STORE , OUTPUT_TOP , RDX );
+	operate( true , X86_SUB , OUTPUT_BASE , RDX );
+	loop = codeSize;
+	operate( true , X86_TEST , RDX , RDX );
+	done = branch( X86_JZ );
+	setRegister( RAX , 1 );
+	setRegister( RDI , 1 );
+	putOpcode( false , X86_SYSCALL , 0 , 0 );
+	operate( true , X86_TEST , RAX , RAX );
+	skip = branch( X86_JLE );
+	operate( true , X86_ADD , RAX , RSI );
+	operate( true , X86_SUB , RAX , RDX );
+	patch( branch( X86_JUMP ) , loop );
+	patch( done , codeSize );
+	patch( skip , codeSize );
+	operate( true , X86_STORE , OUTPUT_BASE , OUTPUT_TOP );
+	popRegister( RDI );
+	popRegister( RSI );
+	putByte( X86_RETURN );
+
+	// al を1文字出力する
+	putCharAt = codeSize;
+	memory( false , X86_STORE_BYTE , RAX , OUTPUT_TOP , 0 );
+	operate( true , X86_INCREMENT , GROUP_INC , OUTPUT_TOP );
+	memory( true , X86_LEA , RAX , OUTPUT_BASE , EMIT_OUTPUT_SIZE );
+	operate( true , X86_CMP , OUTPUT_TOP , RAX );
+	skip = branch( X86_JB );
+	patch( branch( X86_CALL ) , flushAt );
+	patch( skip , codeSize );
+	putByte( X86_RETURN );
+
+	// rax を %ld の形式で出力する 数字はスタックの上に下の桁から並べる
+	putNumberAt = codeSize;
+	operate( true , X86_STORE , RAX , R8 );
+	operate( true , X86_TEST , RAX , RAX );
+	skip = branch( X86_JNS );
+	operate( true , X86_UNARY , GROUP_NEG , RAX );
+	patch( skip , codeSize );
+	operate( true , X86_STORE , RSP , RSI );
+	immediate( true , GROUP_SUB , RSP , 32 );
+	setRegister( RCX , 10 );
+	loop = codeSize;
+	operate( false , X86_XOR , RDX , RDX );
+	operate( true , X86_UNARY , GROUP_DIV , RCX );
+	memory( false , X86_LEA , RDX , RDX , '0' );
+	operate( true , X86_INCREMENT , GROUP_DEC , RSI );
+	memory( false , X86_STORE_BYTE , RDX , RSI , 0 );
+	operate( true , X86_TEST , RAX , RAX );
+	patch( branch( X86_JNZ ) , loop );
+	operate( true , X86_TEST , R8 , R8 );
+	skip = branch( X86_JNS );
+	operate( true , X86_INCREMENT , GROUP_DEC , RSI );
+	memory( false , X86_MOVE_BYTE_IMMEDIATE , 0 , RSI , 0 );
+	putByte( '-' );
+	patch( skip , codeSize );
+	memory( true , X86_LEA , RDI , RSP , 32 );
+	loop = codeSize;
+	operate( true , X86_CMP , RSI , RDI );
+	done = branch( X86_JAE );
+	memory( false , X86_MOVZX_BYTE , RAX , RSI , 0 );
+	patch( branch( X86_CALL ) , putCharAt );
+	operate( true , X86_INCREMENT , GROUP_INC , RSI );
+	patch( branch( X86_JUMP ) , loop );
+	patch( done , codeSize );
+	immediate( true , GROUP_ADD , RSP , 32 );
+	putByte( X86_RETURN );
+
+	// 1バイト読み込んで rax に返す 終端に達した場合は -1 を返して終端の印を付ける
+	// 入力を待つ前に出力バッファを書き出す rax rcx rdx r11 を壊す
+	getByteAt = codeSize;
+	memory( true , X86_LOAD , RAX , INPUT_BASE , EMIT_INPUT_POSITION );
+	memory( true , X86_CMP , RAX , INPUT_BASE , EMIT_INPUT_END );
+	skip = branch( X86_JB );
+	patch( branch( X86_CALL ) , flushAt );
+	pushRegister( RSI );
+	pushRegister( RDI );
+	operate( false , X86_XOR , RAX , RAX );
+	operate( false , X86_XOR , RDI , RDI );
+	memory( true , X86_LEA , RSI , INPUT_BASE , EMIT_INPUT_DATA );
+	setRegister( RDX , EMIT_INPUT_SIZE );
+	putOpcode( false , X86_SYSCALL , 0 , 0 );
+	popRegister( RDI );
+	popRegister( RSI );
+	operate( true , X86_TEST , RAX , RAX );
+	next = branch( X86_JG );
+	memory( true , X86_MOVE_IMMEDIATE , 0 , INPUT_BASE , EMIT_INPUT_EOF );
+	putValue( 1 , 4 );
+	setRegister( RAX , -1 );
+	putByte( X86_RETURN );
+	patch( next , codeSize );
+	memory( true , X86_LEA , RDX , INPUT_BASE , EMIT_INPUT_DATA );
+	memory( true , X86_STORE , RDX , INPUT_BASE , EMIT_INPUT_POSITION );
+	operate( true , X86_ADD , RAX , RDX );
+	memory( true , X86_STORE , RDX , INPUT_BASE , EMIT_INPUT_END );
+	memory( true , X86_LEA , RAX , INPUT_BASE , EMIT_INPUT_DATA );
+	patch( skip , codeSize );
+	memory( true , X86_LEA , RDX , RAX , 1 );
+	memory( true , X86_STORE , RDX , INPUT_BASE , EMIT_INPUT_POSITION );
+	memory( false , X86_MOVZX_BYTE , RAX , RAX , 0 );
+	putByte( X86_RETURN );
+
+	// fgets で1行読み込んで parseNumber した値を rax に返す
+	// r8 に値、r9 に状態 ( 0: 空白を読み飛ばす 1: 数字を読む 2: 行末まで読み飛ばす )、r10 に負の印、rsi に残りの文字数を持つ
+	getNumberAt = codeSize;
+	operate( false , X86_XOR , R8 , R8 );
+	operate( false , X86_XOR , R9 , R9 );
+	operate( false , X86_XOR , R10 , R10 );
+	setRegister( RSI , BUFFER_SIZE - 2 );
+	loop = codeSize;
+	patch( branch( X86_CALL ) , getByteAt );
+	operate( true , X86_TEST , RAX , RAX );
+	finish = branch( X86_JS );
+	immediate( true , GROUP_CMP , R9 , 2 );
+	skips[0] = branch( X86_JZ );
+	operate( true , X86_TEST , R9 , R9 );
+	digits = branch( X86_JNZ );
+	immediate( false , GROUP_CMP , RAX , ' ' );
+	skips[1] = branch( X86_JZ );
+	memory( false , X86_LEA , RCX , RAX , -'\t' );
+	immediate( false , GROUP_CMP , RCX , '\r' - '\t' );
+	skips[2] = branch( X86_JBE );
+	setRegister( R9 , 1 );
+	immediate( false , GROUP_CMP , RAX , '-' );
+	plus = branch( X86_JNZ );
+	setRegister( R10 , 1 );
+	skips[3] = branch( X86_JUMP );
+	patch( plus , codeSize );
+	immediate( false , GROUP_CMP , RAX , '+' );
+	skips[4] = branch( X86_JZ );
+	patch( digits , codeSize );
+	memory( false , X86_LEA , RCX , RAX , -'0' );
+	immediate( false , GROUP_CMP , RCX , 9 );
+	stop = branch( X86_JA );
+	// r8 * 10 + rcx を符号無しで計算し、桁あふれした場合は飽和させて行末まで読み飛ばす
+	operate( true , X86_STORE , R8 , RAX );
+	setRegister( RDX , 10 );
+	operate( true , X86_UNARY , GROUP_MUL , RDX );
+	overflows[0] = branch( X86_JB );
+	operate( true , X86_ADD , RCX , RAX );
+	overflows[1] = branch( X86_JB );
+	operate( true , X86_STORE , RAX , R8 );
+	counts[0] = branch( X86_JUMP );
+	patch( overflows[0] , codeSize );
+	patch( overflows[1] , codeSize );
+	setRegister( R8 , -1 );
+	setRegister( R9 , 2 );
+	counts[1] = branch( X86_JUMP );
+	patch( stop , codeSize );
+	setRegister( R9 , 2 );
+	for( index = 0 ; index < 5 ; index++ ){
+		patch( skips[index] , codeSize );
+	}
+	immediate( false , GROUP_CMP , RAX , '\n' );
+	next = branch( X86_JZ );
+	patch( counts[0] , codeSize );
+	patch( counts[1] , codeSize );
+	operate( false , X86_INCREMENT , GROUP_DEC , RSI );
+	patch( branch( X86_JNZ ) , loop );
+	patch( finish , codeSize );
+	patch( next , codeSize );
+	// parseNumber と同じく long の範囲に飽和させる
+	operate( true , X86_TEST , R10 , R10 );
+	negative = branch( X86_JNZ );
+	operate( true , X86_STORE , R8 , RAX );
+	operate( true , X86_TEST , RAX , RAX );
+	done = branch( X86_JNS );
+	setRegister( RAX , LONG_MAX );
+	putByte( X86_RETURN );
+	patch( negative , codeSize );
+	setRegister( RAX , LONG_MIN );
+	operate( true , X86_CMP , R8 , RAX );
+	skip = branch( X86_JAE );
+	operate( true , X86_STORE , R8 , RAX );
+	operate( true , X86_UNARY , GROUP_NEG , RAX );
+	patch( done , codeSize );
+	patch( skip , codeSize );
+	putByte( X86_RETURN );
+
+	// 出力バッファを書き出して終了する
+	exitAt = codeSize;
+	patch( branch( X86_CALL ) , flushAt );
+	setRegister( RAX , 231 );
+	operate( false , X86_XOR , RDI , RDI );
+	putOpcode( false , X86_SYSCALL , 0 , 0 );
+
+	// 出力バッファを書き出し、rsi の位置から rdi バイトのメッセージを表示して失敗として終了する
+	failAt = codeSize;
+	patch( branch( X86_CALL ) , flushAt );
+	operate( true , X86_STORE , RDI , RDX );
+	setRegister( RAX , 1 );
+	setRegister( RDI , 2 );
+	putOpcode( false , X86_SYSCALL , 0 , 0 );
+	setRegister( RAX , 231 );
+	setRegister( RDI , 1 );
+	putOpcode( false , X86_SYSCALL , 0 , 0 );
+
+	// ヒープのエラーとして終了する
+	heapErrorAt = codeSize;
+	setRegister( RSI , ( long ) ( EMIT_BASE_ADDRESS + EMIT_HEADER_SIZE + sizeof( failure ) - 1 ) );
+	setRegister( RDI , sizeof( heapFailure ) - 1 );
+	patch( branch( X86_JUMP ) , failAt );
+
+	// スタックのエラーとして終了する
+	stackErrorAt = codeSize;
+	setRegister( RSI , ( long ) ( EMIT_BASE_ADDRESS + EMIT_HEADER_SIZE + sizeof( failure ) - 1 + sizeof( heapFailure ) - 1 ) );
+	setRegister( RDI , sizeof( stackFailure ) - 1 );
+	patch( branch( X86_JUMP ) , failAt );
+	return;
+}
+
+static void emitEntry( void ){
+	size_t skip;
+	entryAt = codeSize;
+	// ヒープ・スタック・戻り先・入出力の領域を1度に確保する
+	setRegister( RAX , 9 );
+	operate( false , X86_XOR , RDI , RDI );
+	setRegister( RSI , ( long ) EMIT_REGION_SIZE );
+	setRegister( RDX , 0x03 );		// PROT_READ | PROT_WRITE
+	setRegister( R10 , 0x4022 );	// MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE
+	setRegister( R8 , -1 );
+	operate( false , X86_XOR , R9 , R9 );
+	putOpcode( false , X86_SYSCALL , 0 , 0 );
+	operate( true , X86_TEST , RAX , RAX );
+	skip = branch( X86_JNS );
+	setRegister( RAX , 1 );
+	setRegister( RDI , 2 );
+	setRegister( RSI , ( long ) ( EMIT_BASE_ADDRESS + EMIT_HEADER_SIZE ) );
+	setRegister( RDX , sizeof( failure ) - 1 );
+	putOpcode( false , X86_SYSCALL , 0 , 0 );
+	setRegister( RAX , 231 );
+	setRegister( RDI , 1 );
+	putOpcode( false , X86_SYSCALL , 0 , 0 );
+	patch( skip , codeSize );
+
+	operate( true , X86_STORE , RAX , HEAP_BASE );
+	setRegister( STACK_TOP , ( long ) EMIT_HEAP_SIZE );
+	operate( true , X86_ADD , RAX , STACK_TOP );
+	setRegister( RSP , ( long ) ( EMIT_HEAP_SIZE + EMIT_STACK_SIZE + EMIT_CALL_SIZE ) );
+	operate( true , X86_ADD , RAX , RSP );
+	operate( true , X86_STORE , RSP , OUTPUT_BASE );
+	operate( true , X86_STORE , RSP , OUTPUT_TOP );
+	memory( true , X86_LEA , INPUT_BASE , RSP , EMIT_OUTPUT_SIZE );
+	memory( true , X86_STORE , STACK_TOP , INPUT_BASE , EMIT_STACK_BASE );
+	operate( false , X86_XOR , CALL_DEPTH , CALL_DEPTH );
+	return;
+}
+
+static void emitInstruction( Instruction *instruction ){
+	switch( instruction->imp ){
+		case STACK:
+			emitStack( instruction );
+			break;
+
+		case OPERATION:
+			emitOperation( instruction );
+			break;
+
+		case HEAP:
+			emitHeap( instruction );
+			break;
+
+		case FLOW_CONTROL:
+			emitControl( instruction );
+			break;
+
+		case IO:
+			emitIO( instruction );
+			break;
+
+		default:
+			error( "emit: illegal IMP" );
+			break;
+	}
+	return;
+}
+
+static void emitStack( Instruction *instruction ){
+	switch( instruction->c_stack ){
+		case PUSH_NUMBER:
+			if( -0x80000000L <= instruction->p_value && instruction->p_value <= 0x7FFFFFFFL ){
+				memory( true , X86_MOVE_IMMEDIATE , 0 , STACK_TOP , 0 );
+				putValue( ( unsigned long ) instruction->p_value , 4 );
+			}
+			else{
+				setRegister( RAX , instruction->p_value );
+				memory( true , X86_STORE , RAX , STACK_TOP , 0 );
+			}
+			immediate( true , GROUP_ADD , STACK_TOP , 8 );
+			break;
+
+		case TOP_COPY:
+			require( 1 );
+			memory( true , X86_LOAD , RAX , STACK_TOP , -8 );
+			memory( true , X86_STORE , RAX , STACK_TOP , 0 );
+			immediate( true , GROUP_ADD , STACK_TOP , 8 );
+			break;
+
+		case N_COPY:
+			require( ( long ) ( int ) instruction->p_value + 1 );
+			memory( true , X86_LOAD , RAX , STACK_TOP , -8 * ( ( long ) ( int ) instruction->p_value + 1 ) );
+			memory( true , X86_STORE , RAX , STACK_TOP , 0 );
+			immediate( true , GROUP_ADD , STACK_TOP , 8 );
+			break;
+
+		case PUSH_EXCHANGE:
+			require( 2 );
+			memory( true , X86_LOAD , RAX , STACK_TOP , -8 );
+			memory( true , X86_LOAD , RCX , STACK_TOP , -16 );
+			memory( true , X86_STORE , RCX , STACK_TOP , -8 );
+			memory( true , X86_STORE , RAX , STACK_TOP , -16 );
+			break;
+
+		case TOP_DESTRUCTION:
+			require( 1 );
+			immediate( true , GROUP_SUB , STACK_TOP , 8 );
+			break;
+
+		case N_SLIDE:
+			require( ( long ) ( int ) instruction->p_value + 1 );
+			memory( true , X86_LOAD , RAX , STACK_TOP , -8 );
+			immediate( true , GROUP_SUB , STACK_TOP , 8 * ( long ) ( int ) instruction->p_value );
+			memory( true , X86_STORE , RAX , STACK_TOP , -8 );
+			break;
+
+		default:
+			error( "emit: illegal stack command" );
+			break;
+	}
+	return;
+}
+
+static void emitOperation( Instruction *instruction ){
+	require( 2 );
+	immediate( true , GROUP_SUB , STACK_TOP , 8 );
+	switch( instruction->c_operation ){
+		case ADDTION:
+			memory( true , X86_LOAD , RAX , STACK_TOP , 0 );
+			memory( true , X86_ADD , RAX , STACK_TOP , -8 );
+			break;
+
+		case SUBTRACTION:
+			memory( true , X86_LOAD , RAX , STACK_TOP , 0 );
+			memory( true , X86_SUB , RAX , STACK_TOP , -8 );
+			break;
+
+		case MULTIPLICATION:
+			memory( true , X86_LOAD , RAX , STACK_TOP , 0 );
+			memory( true , X86_IMUL , RAX , STACK_TOP , -8 );
+			memory( true , X86_STORE , RAX , STACK_TOP , -8 );
+			break;
+
+		case DIVISION:
+		case MODULO:
+			memory( true , X86_LOAD , RCX , STACK_TOP , 0 );
+			memory( true , X86_LOAD , RAX , STACK_TOP , -8 );
+			putOpcode( true , X86_CQO , 0 , 0 );
+			operate( true , X86_UNARY , GROUP_IDIV , RCX );
+			memory( true , X86_STORE , instruction->c_operation == DIVISION ? RAX : RDX , STACK_TOP , -8 );
+			break;
+
+		default:
+			error( "emit: illegal operation command" );
+			break;
+	}
+	return;
+}
+
+static void emitHeap( Instruction *instruction ){
+	switch( instruction->c_heap ){
+		case TO_ADDRESS:
+			require( 2 );
+			immediate( true , GROUP_SUB , STACK_TOP , 16 );
+			memory( true , X86_LOAD , RAX , STACK_TOP , 0 );
+			operate( true , X86_MOVSXD , RAX , RAX );
+			memory( true , X86_LOAD , RCX , STACK_TOP , 8 );
+			heap( X86_STORE , RCX , RAX );
+			break;
+
+		case TO_STACK:
+			require( 1 );
+			memory( true , X86_LOAD , RAX , STACK_TOP , -8 );
+			operate( true , X86_MOVSXD , RAX , RAX );
+			heap( X86_LOAD , RAX , RAX );
+			memory( true , X86_STORE , RAX , STACK_TOP , -8 );
+			break;
+
+		case TO_VARIABLE:
+			require( 1 );
+			reach( true , instruction->p_value );
+			immediate( true , GROUP_SUB , STACK_TOP , 8 );
+			memory( true , X86_LOAD , RAX , STACK_TOP , 0 );
+			memory( true , X86_STORE , RAX , HEAP_BASE , getSlotDisplacement( instruction->p_value ) );
+			break;
+
+		case VARIABLE_TO_STACK:
+			reach( false , instruction->p_value );
+			memory( true , X86_LOAD , RAX , HEAP_BASE , getSlotDisplacement( instruction->p_value ) );
+			memory( true , X86_STORE , RAX , STACK_TOP , 0 );
+			immediate( true , GROUP_ADD , STACK_TOP , 8 );
+			break;
+
+		case BLOCK_FILL:
+		case BLOCK_COPY:
+			// 直後のループがそのまま機械語として実行するため、何も出力しない
+			break;
+
+		default:
+			error( "emit: illegal heap command" );
+			break;
+	}
+	return;
+}
+
+static void emitControl( Instruction *instruction ){
+	size_t skip;
+	switch( instruction->c_control ){
+		case LABEL_DEFINE:
+			break;
+
+		case CALL_ROUTINE:
+			operate( true , X86_INCREMENT , GROUP_INC , CALL_DEPTH );
+			branchInstruction( X86_CALL , instruction->jump );
+			break;
+
+		case TAIL_CALL:
+			// サブルーチンの中ならジャンプし、そうでなければ呼び出す
+			operate( true , X86_TEST , CALL_DEPTH , CALL_DEPTH );
+			branchInstruction( X86_JNZ , instruction->jump );
+			operate( true , X86_INCREMENT , GROUP_INC , CALL_DEPTH );
+			branchInstruction( X86_CALL , instruction->jump );
+			break;
+
+		case JUMP:
+			branchInstruction( X86_JUMP , instruction->jump );
+			break;
+
+		case ZERO_JUMP:
+		case MINUS_JUMP:
+			require( 1 );
+			immediate( true , GROUP_SUB , STACK_TOP , 8 );
+			memory( true , X86_LOAD , RAX , STACK_TOP , 0 );
+			operate( true , X86_TEST , RAX , RAX );
+			branchInstruction( instruction->c_control == ZERO_JUMP ? X86_JZ : X86_JS , instruction->jump );
+			break;
+
+		case END_ROUTINE:
+			// 呼び出されていない場合は次の命令に進む
+			operate( true , X86_TEST , CALL_DEPTH , CALL_DEPTH );
+			skip = branch( X86_JZ );
+			operate( true , X86_INCREMENT , GROUP_DEC , CALL_DEPTH );
+			putByte( X86_RETURN );
+			patch( skip , codeSize );
+			break;
+
+		case FINISH:
+			patch( branch( X86_JUMP ) , exitAt );
+			break;
+
+		default:
+			error( "emit: illegal flow control command" );
+			break;
+	}
+	return;
+}
+
+static void emitIO( Instruction *instruction ){
+	size_t skip;
+	switch( instruction->c_io ){
+		case PUT_CHAR:
+			require( 1 );
+			immediate( true , GROUP_SUB , STACK_TOP , 8 );
+			memory( false , X86_LOAD_BYTE , RAX , STACK_TOP , 0 );
+			patch( branch( X86_CALL ) , putCharAt );
+			break;
+
+		case PUT_NUMBER:
+			require( 1 );
+			immediate( true , GROUP_SUB , STACK_TOP , 8 );
+			memory( true , X86_LOAD , RAX , STACK_TOP , 0 );
+			patch( branch( X86_CALL ) , putNumberAt );
+			break;
+
+		case GET_CHAR:
+		case GET_NUMBER:
+			// 入力の終端に達した後はヒープを書き換えない
+			memory( true , 0x83 , GROUP_CMP , INPUT_BASE , EMIT_INPUT_EOF );
+			putByte( 0 );
+			skip = branch( X86_JNZ );
+			require( 1 );
+			patch( branch( X86_CALL ) , instruction->c_io == GET_CHAR ? getByteAt : getNumberAt );
+			memory( true , X86_LOAD , RCX , STACK_TOP , -8 );
+			operate( true , X86_MOVSXD , RCX , RCX );
+			heap( X86_STORE , RAX , RCX );
+			patch( skip , codeSize );
+			break;
+
+		case PUT_STRING:
+			break;
+
+		default:
+			error( "emit: illegal io command" );
+			break;
+	}
+	return;
+}
+
+static long getSlotDisplacement( long slot ){
+	if( slots == NULL || slot < 0 || getMachine()->variableCount <= slot ){
+		error( "emit: illegal variable slot" );
+	}
+	return slots[slot] * ( long ) sizeof( long );
+}
+
+static void setHeader( unsigned char *header ){
+	size_t size = EMIT_HEADER_SIZE + codeSize;
+	memset( header , 0 , EMIT_HEADER_SIZE );
+	memcpy( header , "\177ELF" , 4 );
+	header[4] = 2;		// ELFCLASS64
+	header[5] = 1;		// ELFDATA2LSB
+	header[6] = 1;		// EV_CURRENT
+	setValue( header + 16 , 2 , 2 );		// ET_EXEC
+	setValue( header + 18 , 62 , 2 );		// EM_X86_64
+	setValue( header + 20 , 1 , 4 );
+	setValue( header + 24 , EMIT_BASE_ADDRESS + EMIT_HEADER_SIZE + entryAt , 8 );
+	setValue( header + 32 , 64 , 8 );		// プログラムヘッダの位置
+	setValue( header + 52 , 64 , 2 );
+	setValue( header + 54 , 56 , 2 );
+	setValue( header + 56 , 1 , 2 );
+	// 機械語をヘッダごと読み出し・実行可能として読み込む
+	setValue( header + 64 , 1 , 4 );		// PT_LOAD
+	setValue( header + 68 , 5 , 4 );		// PF_R | PF_X
+	setValue( header + 72 , 0 , 8 );
+	setValue( header + 80 , EMIT_BASE_ADDRESS , 8 );
+	setValue( header + 88 , EMIT_BASE_ADDRESS , 8 );
+	setValue( header + 96 , size , 8 );
+	setValue( header + 104 , size , 8 );
+	setValue( header + 112 , 0x1000 , 8 );
+	return;
+}
+
+static void setValue( unsigned char *destination , unsigned long value , int size ){
+	int index;
+	for( index = 0 ; index < size ; index++ ){
+		destination[index] = ( unsigned char ) ( value >> ( index * 8 ) );
+	}
+	return;
+}
+
+static void emitClear( void ){
+	free( code );
+	free( fixups );
+	free( offsets );
+	free( slots );
+	code = NULL;
+	fixups = NULL;
+	offsets = NULL;
+	slots = NULL;
+	codeSize = codeAllocation = 0;
+	fixupCount = fixupAllocation = 0;
+	return;
+}
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	exit( EXIT_FAILURE );
+}
@@ -6,47 +6,37 @@
 //  Copyright (c) 2015年 kuroneko. All rights reserved.
 //
 
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include "whitespace.h"
 
 /**
- * 現在参照している命令
- * プログラムカウンタ的役割を果たす
+ * ヒープをファイルに割り当てる場合に予約するアドレス空間のバイト数
+ * int で表せる非負のアドレス全てを覆うため、ファイルが伸びても割り当て直さない
  */
-static Instruction *current = NULL;
+#define HEAP_FILE_RESERVE ( ( ( size_t ) INT_MAX + 1 ) * sizeof( long ) )
 
 /**
- * ヒープ
+ * 仮想マシンの実行状態
  */
-static long *heap = NULL;
+static Machine machine = { 0 };
 
 /**
- * ヒープの確保容量
+ * 実行時間の上限に達した場合に 0 以外
  */
-static size_t heapAllocation = 0;
+static volatile sig_atomic_t expired = 0;
 
 /**
- * スタック
+ * 実行を開始した時刻
  */
-static long *stack = NULL;
-
-/**
- * スタックの確保容量
- */
-static size_t stackAllocation = 0;
-
-/**
- * スタックの現在の参照位置
- */
-static int stackPointer = 0;
-
-/**
- * 命令を実行する際の基本的処理
- * @param instruction
- *	実行する命令
- * @return
- *	プログラムが終了の場合に true を返す
- */
-static bool baseProcess( Instruction *instruction );
+static struct timespec started;
 
 /**
  * スタック操作を行う
@@ -86,22 +76,64 @@ static bool flowControlProcess( Instruction *instruction );
 static void ioProcess( Instruction *instruction );
 
 /**
- * ヒープに値を設定する
- * @param address
- *	値を保存するヒープのアドレス
- * @param value
- *	ヒープに保存する値
+ * 入力の読み込みがシグナルで中断した時に、実行時間の上限と Machine の interrupt を確認する
  */
-static void setHeapValue( int address , long value );
+static void interrupt( void );
 
 /**
- * ヒープから値を取得する
- * @param address
- *	値を取得するヒープのアドレス
+ * 値の領域を拡張する
+ * スナップショットから割り当てた領域の場合は複製してから割り当てを解除する
+ * @param area
+ *	拡張する領域
+ * @param used
+ *	拡張前の領域の値の個数
+ * @param allocation
+ *	拡張後の値の個数
+ * @param mapped
+ *	スナップショットから割り当てた領域のバイト数
+ *	複製した場合は 0 が設定される
  * @return
- *	取得した値
+ *	拡張した領域
+ */
+static long *expand( long *area , size_t used , size_t allocation , size_t *mapped );
+
+/**
+ * 値の領域を破棄する
+ * @param area
+ *	破棄する領域
+ * @param mapped
+ *	スナップショットから割り当てた領域のバイト数
+ */
+static void release( long *area , size_t *mapped );
+
+/**
+ * ファイルに割り当てたヒープを伸ばす
+ * @param allocation
+ *	伸ばした後の値の個数
+ */
+static void resizeHeapFile( size_t allocation );
+
+/**
+ * 上限を超えないように確保する値の個数を調整する
+ * @param allocation
+ *	確保しようとしている値の個数
+ * @param needed
+ *	必要な値の個数
+ * @param limit
+ *	値の個数の上限 0 の場合は制限しない
+ * @param reason
+ *	上限を超えた場合に中断する理由
+ * @return
+ *	確保する値の個数
+ */
+static size_t bound( size_t allocation , size_t needed , size_t limit , Halt reason );
+
+/**
+ * 実行時間の上限に達したことを受ける
+ * @param number
+ *	シグナル番号
  */
-static long getHeapValue( int address );
+static void expire( int number );
 
 /**
  * スタックの値を積む
@@ -134,53 +166,269 @@ static long getStackValue( int position );
  */
 static long getStackTop( void );
 
-/**
- * サブルーチンの呼び出しを行う
- * @param instruction
- *	サブルーチンの命令
- * @return
- *	プログラム終了時に true を返す
- */
-static bool callSubRoutine( Instruction *instruction );
-
 /**
  * プログラムの実行時エラーを通知する
  * エラーが通知されるとプログラムは終了する
+ * executeGoverned から実行している場合は実行が中断される
  */
 static void error( char *message );
 
 
 
 void execute( Instruction *instruction ){
-	current = instruction;
-	while( current != NULL ){
-		if( baseProcess( current ) ){
+	machine.current = instruction;
+	while( true ){
+		while( machine.current != NULL ){
+			if( baseProcess( machine.current ) ){
+				return;
+			}
+		}
+		if( machine.callPointer == 0 ){
 			break;
 		}
+		machine.current = machine.calls[--machine.callPointer];
+	}
+	return;
+}
+
+void setLimit( Limit *limit ){
+	struct sigaction action;
+	struct itimerval timer;
+	machine.limit = *limit;
+	machine.fuel = limit->fuel;
+	machine.governed = limit->fuel != 0 || 0 < limit->milliseconds;
+	expired = 0;
+	clock_gettime( CLOCK_MONOTONIC , &started );
+	// 前回の実行で設定したタイマーが残らないよう、上限が無い場合も設定し直す
+	memset( &timer , 0 , sizeof( timer ) );
+	if( 0 < limit->milliseconds ){
+		memset( &action , 0 , sizeof( action ) );
+		action.sa_handler = expire;
+		// 入力を待っている間に上限に達した場合も中断できるよう、読み込みを再開させない
+		action.sa_flags = 0;
+		sigemptyset( &action.sa_mask );
+		sigaction( SIGALRM , &action , NULL );
+		timer.it_value.tv_sec = limit->milliseconds / 1000;
+		timer.it_value.tv_usec = limit->milliseconds % 1000 * 1000;
+	}
+	setitimer( ITIMER_REAL , &timer , NULL );
+	return;
+}
+
+Halt executeGoverned( void ( *engine )( Instruction * ) , Instruction *instruction ){
+	jmp_buf escape;
+	Halt reason;
+	if( ( reason = ( Halt ) setjmp( escape ) ) == HALT_NONE ){
+		machine.escape = &escape;
+		machine.entry = instruction != NULL ? instruction->index : 0;
+		engine( instruction );
+	}
+	else if( machine.discard != NULL ){
+		machine.discard();
+	}
+	machine.escape = NULL;
+	machine.discard = NULL;
+	return reason;
+}
+
+void chargeFuel( Instruction *instruction , Instruction *target ){
+	long count;
+	// 前方への分岐では消費せず、飛ばした命令数だけ一続きの命令の最初をずらして次に消費する時にまとめて数える
+	if( target != NULL && instruction->index < target->index && instruction->c_control != CALL_ROUTINE && instruction->c_control != TAIL_CALL ){
+		machine.entry += target->index - instruction->index - 1;
+		if( expired ){
+			halt( HALT_TIME );
+		}
+		return;
+	}
+	// 番号は命令の並び順に振り直してあるため、一続きの命令数は番号の差になる
+	count = instruction->index - machine.entry + 1;
+	machine.entry = target != NULL ? target->index : 0;
+	consumeFuel( count < 1 ? 1 : count );
+	return;
+}
+
+void consumeFuel( long count ){
+	if( machine.limit.fuel != 0 && ( machine.fuel -= count ) < 0 ){
+		halt( HALT_FUEL );
+	}
+	if( expired ){
+		halt( HALT_TIME );
+	}
+	return;
+}
+
+void halt( Halt reason ){
+	if( machine.escape != NULL ){
+		longjmp( *machine.escape , reason );
+	}
+	fflush( machine.output );
+	if( reason != HALT_ERROR ){
+		reportHalt( reason );
+		exit( LIMIT_EXIT_STATUS );
+	}
+	exit( EXIT_FAILURE );
+}
+
+void reportHalt( Halt reason ){
+	static const char *reasons[] = {
+		"finished" ,
+		"runtime error" ,
+		"fuel exhausted" ,
+		"heap limit exceeded" ,
+		"stack limit exceeded" ,
+		"call limit exceeded" ,
+		"time limit exceeded"
+	};
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC , &now );
+	fprintf( stderr , "halt: %s ( fuel used %ld , heap %zu bytes , stack depth %d , call depth %d , %.3f seconds )\n" ,
+		reasons[reason] ,
+		machine.limit.fuel - machine.fuel ,
+		sizeof( long ) * machine.heapAllocation ,
+		machine.stackPointer ,
+		machine.callPointer ,
+		( now.tv_sec - started.tv_sec ) + ( now.tv_nsec - started.tv_nsec ) / 1e9 );
+	return;
+}
+
+Machine *getMachine( void ){
+	return &machine;
+}
+
+void setStream( FILE *input , FILE *output ){
+	machine.input = input;
+	machine.output = output;
+	return;
+}
+
+void reserveStack( int count ){
+	if( machine.stackAllocation < machine.stackPointer + count ){
+		size_t allocation = machine.stackAllocation;
+		while( allocation < machine.stackPointer + count ){
+			allocation += STACK_ALLOCATION_SIZE;
+		}
+		machine.stackAllocation = bound( allocation , machine.stackPointer + count , machine.limit.stack , HALT_STACK );
+		machine.stack = expand( machine.stack , machine.stackPointer , machine.stackAllocation , &machine.stackMapped );
 	}
 	return;
 }
 
+void pushCall( Instruction *instruction ){
+	if( machine.callAllocation == machine.callPointer ){
+		machine.callAllocation = bound( machine.callAllocation + STACK_ALLOCATION_SIZE , machine.callPointer + 1 , machine.limit.call , HALT_CALL );
+		if( ( machine.calls = ( Instruction ** ) realloc( machine.calls , sizeof( Instruction * ) * machine.callAllocation ) ) == NULL ){
+			error( "execute: out of memory error" );
+		}
+	}
+	machine.calls[machine.callPointer++] = instruction;
+	return;
+}
+
 void stackClear( void ){
-	if( stack != NULL ){
-		free( stack );
-		stack = NULL;
-		stackAllocation = 0;
-		stackPointer = 0;
+	if( machine.stack != NULL ){
+		release( machine.stack , &machine.stackMapped );
+		machine.stack = NULL;
+		machine.stackAllocation = 0;
+		machine.stackPointer = 0;
+	}
+	if( machine.calls != NULL ){
+		free( machine.calls );
+		machine.calls = NULL;
+		machine.callAllocation = 0;
+		machine.callPointer = 0;
 	}
 	return;
 }
 
+void setVariable( long *addresses , int count ){
+	int index;
+	machine.variableLimit = 0;
+	for( index = 0 ; index < count ; index++ ){
+		if( machine.variableLimit <= addresses[index] ){
+			machine.variableLimit = ( int ) addresses[index] + 1;
+		}
+	}
+	machine.variables = ( long * ) calloc( count , sizeof( long ) );
+	machine.variableAt = ( int * ) malloc( sizeof( int ) * machine.variableLimit );
+	machine.variableAddresses = ( int * ) malloc( sizeof( int ) * count );
+	if( machine.variables == NULL || machine.variableAt == NULL || machine.variableAddresses == NULL ){
+		error( "execute: out of memory error" );
+	}
+	memset( machine.variableAt , -1 , sizeof( int ) * machine.variableLimit );
+	machine.variableCount = count;
+	for( index = 0 ; index < count ; index++ ){
+		machine.variableAt[addresses[index]] = index;
+		machine.variableAddresses[index] = ( int ) addresses[index];
+		if( addresses[index] < machine.heapAllocation ){
+			machine.variables[index] = machine.heap[addresses[index]];
+		}
+	}
+	return;
+}
+
+void setHeapFile( const char *path , bool temporary ){
+	char name[BUFFER_SIZE];
+	struct stat status;
+	int descriptor;
+	if( temporary ){
+		snprintf( name , sizeof( name ) , "%s/whitespace-heap-XXXXXX" , path );
+		if( ( descriptor = mkstemp( name ) ) < 0 ){
+			error( "execute: heap file open error" );
+		}
+		unlink( name );
+	}
+	else if( ( descriptor = open( path , O_RDWR | O_CREAT , 0644 ) ) < 0 ){
+		error( "execute: heap file open error" );
+	}
+	if( fstat( descriptor , &status ) != 0 || HEAP_FILE_RESERVE < ( size_t ) status.st_size ){
+		error( "execute: heap file size error" );
+	}
+	if( ( machine.heap = ( long * ) mmap( NULL , HEAP_FILE_RESERVE , PROT_READ | PROT_WRITE , MAP_SHARED | MAP_NORESERVE , descriptor , 0 ) ) == MAP_FAILED ){
+		error( "execute: heap file map error" );
+	}
+	machine.heapDescriptor = descriptor;
+	machine.heapBacked = true;
+	resizeHeapFile( ( ( size_t ) status.st_size + sizeof( long ) - 1 ) / sizeof( long ) );
+	return;
+}
+
 void heapClear( void ){
-	if( heap != NULL ){
-		free( heap );
-		heap = NULL;
-		heapAllocation = 0;
+	int address;
+	if( machine.heapBacked ){
+		for( address = 0 ; address < machine.variableLimit ; address++ ){
+			if( 0 <= machine.variableAt[address] && ( address < machine.heapAllocation || machine.variables[machine.variableAt[address]] != 0 ) ){
+				if( machine.heapAllocation <= address ){
+					resizeHeapFile( address + 1 );
+				}
+				machine.heap[address] = machine.variables[machine.variableAt[address]];
+			}
+		}
+		munmap( machine.heap , HEAP_FILE_RESERVE );
+		close( machine.heapDescriptor );
+		machine.heap = NULL;
+		machine.heapAllocation = 0;
+		machine.heapBacked = false;
+	}
+	else if( machine.heap != NULL ){
+		release( machine.heap , &machine.heapMapped );
+		machine.heap = NULL;
+		machine.heapAllocation = 0;
+	}
+	if( machine.variables != NULL ){
+		free( machine.variables );
+		free( machine.variableAt );
+		free( machine.variableAddresses );
+		machine.variables = NULL;
+		machine.variableAt = NULL;
+		machine.variableAddresses = NULL;
+		machine.variableLimit = 0;
+		machine.variableCount = 0;
 	}
 	return;
 }
 
-static bool baseProcess( Instruction *instruction ){
+bool baseProcess( Instruction *instruction ){
 	switch( instruction->imp ){
 		case STACK:
 			stackProcess( instruction );
@@ -236,7 +484,7 @@ static void stackProcess( Instruction *instruction ){
 
 		case N_SLIDE:
 			firstTemporary = pop();
-			stackPointer -= ( int ) instruction->p_value;
+			machine.stackPointer -= ( int ) instruction->p_value;
 			push( firstTemporary );
 			break;
 
@@ -244,7 +492,7 @@ static void stackProcess( Instruction *instruction ){
 			error( "execute: illegal stack command" );
 			break;
 	}
-	current = instruction->next;
+	machine.current = instruction->next;
 	return;
 }
 
@@ -277,7 +525,7 @@ static void operationProcess( Instruction *instruction ){
 			break;
 
 	}
-	current = instruction->next;
+	machine.current = instruction->next;
 	return;
 }
 
@@ -295,162 +543,296 @@ static void heapProcess( Instruction *instruction ){
 			push( getHeapValue( ( int ) address ) );
 			break;
 
+		case TO_VARIABLE:
+			if( machine.heapAllocation < machine.variableLimit ){
+				setVariableValue( instruction->p_value , pop() );
+			}
+			else{
+				machine.variables[instruction->p_value] = pop();
+			}
+			break;
+
+		case VARIABLE_TO_STACK:
+			push( machine.heapAllocation < machine.variableLimit ? getVariableValue( instruction->p_value ) : machine.variables[instruction->p_value] );
+			break;
+
+		case BLOCK_FILL:
+		case BLOCK_COPY:
+			executeIdiom( instruction );
+			break;
+
 		default:
 			error( "execute: illegal heap command" );
 			break;
 	}
-	current = instruction->next;
+	machine.current = instruction->next;
 	return;
 }
 
 static bool flowControlProcess( Instruction *instruction ){
 	switch( instruction->c_control ){
 		case LABEL_DEFINE:
-			current = instruction->next;
+			machine.current = instruction->next;
 			break;
 
 		case CALL_ROUTINE:
-			if( callSubRoutine( instruction->jump ) ){
-				return true;
+			if( machine.governed ){
+				chargeFuel( instruction , instruction->jump );
 			}
-			current = instruction->next;
+			pushCall( instruction->next );
+			machine.current = instruction->jump;
+			break;
+
+		case TAIL_CALL:
+			if( machine.governed ){
+				chargeFuel( instruction , instruction->jump );
+			}
+			if( machine.callPointer == 0 ){
+				pushCall( instruction->next );
+			}
+			machine.current = instruction->jump;
 			break;
 
 		case JUMP:
-			current = instruction->jump;
+			if( machine.governed ){
+				chargeFuel( instruction , instruction->jump );
+			}
+			machine.current = instruction->jump;
 			break;
 
 		case ZERO_JUMP:
-			current = pop() == 0 ? instruction->jump : instruction->next;
+			if( pop() != 0 ){
+				machine.current = instruction->next;
+				break;
+			}
+			if( machine.governed ){
+				chargeFuel( instruction , instruction->jump );
+			}
+			machine.current = instruction->jump;
 			break;
 
 		case MINUS_JUMP:
-			current = pop() < 0 ? instruction->jump : instruction->next;
+			if( 0 <= pop() ){
+				machine.current = instruction->next;
+				break;
+			}
+			if( machine.governed ){
+				chargeFuel( instruction , instruction->jump );
+			}
+			machine.current = instruction->jump;
 			break;
 
 		case END_ROUTINE:
-			current = instruction->next;
+			machine.current = 0 < machine.callPointer ? machine.calls[--machine.callPointer] : instruction->next;
+			if( machine.governed ){
+				chargeFuel( instruction , machine.current );
+			}
 			break;
 
 		case FINISH:
 			return true;
 
+		case LAZY_BLOCK:
+			machine.current = decodeBlock( instruction );
+			break;
+
 		default:
-			current = instruction->next;
+			machine.current = instruction->next;
 			break;
 	}
 	return false;
 }
 
 static void ioProcess( Instruction *instruction ){
-	char buffer[BUFFER_SIZE];
+	char buffer[BUFFER_SIZE] , *line;
+	int character , length;
+	long value;
 	switch( instruction->c_io ){
 		case PUT_CHAR:
-			fputc( ( char ) ( pop() & 0xFF ) , stdout );
-			fflush( stdout );
+			fputc( ( char ) ( pop() & 0xFF ) , machine.output );
+			fflush( machine.output );
+			machine.outputOffset++;
 			break;
 
 		case PUT_NUMBER:
-			fprintf( stdout , "%ld" , pop() );
-			fflush( stdout );
+			length = formatNumber( pop() , buffer );
+			fwrite( buffer , sizeof( char ) , length , machine.output );
+			machine.outputOffset += length;
+			fflush( machine.output );
 			break;
 
 		case GET_CHAR:
-			if( ! feof( stdin ) ){
-				setHeapValue( ( int ) getStackTop() , fgetc( stdin ) );
+			if( ! feof( machine.input ) ){
+				// シグナルで読み込みが中断した場合は、上限と割り込みを確認してから読み直す
+				while( ( character = fgetc( machine.input ) ) == EOF && ferror( machine.input ) && errno == EINTR ){
+					interrupt();
+				}
+				if( character != EOF ){
+					machine.inputOffset++;
+				}
+				setHeapValue( ( int ) getStackTop() , character );
 			}
 			break;
 
 		case GET_NUMBER:
-			if( ! feof( stdin ) ){
-				setHeapValue( ( int ) getStackTop() , atoi( fgets( buffer , BUFFER_SIZE - 1 , stdin ) ) );
+			if( ! feof( machine.input ) ){
+				value = 0;
+				while( ( line = fgets( buffer , BUFFER_SIZE - 1 , machine.input ) ) == NULL && ferror( machine.input ) && errno == EINTR ){
+					interrupt();
+				}
+				if( line != NULL ){
+					machine.inputOffset += strlen( line );
+					parseNumber( line , &value );
+				}
+				setHeapValue( ( int ) getStackTop() , value );
 			}
 			break;
 
+		case PUT_STRING:
+			executeIdiom( instruction );
+			break;
+
 		default:
 			error( "execute: illegal io command" );
 			break;
 	}
-	current = instruction->next;
+	machine.current = instruction->next;
+	return;
+}
+
+static void interrupt( void ){
+	clearerr( machine.input );
+	if( expired ){
+		halt( HALT_TIME );
+	}
+	if( machine.interrupt != NULL ){
+		machine.interrupt();
+	}
 	return;
 }
 
-static void setHeapValue( int address , long value ){
-	if( heapAllocation <= address ){
-		while( heapAllocation <= address ){
-			heapAllocation += HEAP_ALLOCATION_SIZE;
+void setHeapValue( int address , long value ){
+	// 固定スロットに割り当てたアドレスも、割り当てていない場合と同じくヒープを確保して上限を確認する
+	if( machine.heapAllocation <= address ){
+		size_t step = machine.heapBacked ? HEAP_FILE_ALLOCATION_SIZE : HEAP_ALLOCATION_SIZE;
+		size_t allocation = machine.heapAllocation + ( ( address - machine.heapAllocation ) / step + 1 ) * step;
+		// 1個分に満たない上限が無制限を表す 0 にならないよう切り上げる
+		allocation = bound( allocation , address + 1 , ( machine.limit.heap + sizeof( long ) - 1 ) / sizeof( long ) , HALT_HEAP );
+		if( machine.heapBacked ){
+			resizeHeapFile( allocation );
 		}
-		if( heap == NULL ){
-			if( ( heap = ( long * ) malloc( sizeof( long ) * heapAllocation ) ) == NULL ){
-				error( "execute: out of memory error" );
-			}
-		}
-		else if( ( heap = ( long * ) realloc( heap , sizeof( long ) * heapAllocation ) ) == NULL ){
-			error( "execute: out of memory error" );
+		else{
+			machine.heap = expand( machine.heap , machine.heapAllocation , allocation , &machine.heapMapped );
+			machine.heapAllocation = allocation;
 		}
 	}
-	heap[address] = value;
+	if( 0 <= address && address < machine.variableLimit && 0 <= machine.variableAt[address] ){
+		machine.variables[machine.variableAt[address]] = value;
+		return;
+	}
+	machine.heap[address] = value;
 	return;
 }
-static long getHeapValue( int address ){
-	if( heapAllocation <= address ){
+
+long getHeapValue( int address ){
+	if( machine.heapAllocation <= address ){
 		error( "execute: do not allocation in heap" );
 	}
-	return heap[address];
+	if( 0 <= address && address < machine.variableLimit && 0 <= machine.variableAt[address] ){
+		return machine.variables[machine.variableAt[address]];
+	}
+	return machine.heap[address];
 }
 
-static void push( long value ){
-	if( stack == NULL ){
-		stackAllocation = STACK_ALLOCATION_SIZE;
-		if( ( stack = ( long * ) malloc( sizeof( long ) * stackAllocation ) ) == NULL ){
+void setVariableValue( int slot , long value ){
+	setHeapValue( machine.variableAddresses[slot] , value );
+	return;
+}
+
+long getVariableValue( int slot ){
+	return getHeapValue( machine.variableAddresses[slot] );
+}
+
+static long *expand( long *area , size_t used , size_t allocation , size_t *mapped ){
+	long *expanded;
+	if( *mapped != 0 ){
+		if( ( expanded = ( long * ) malloc( sizeof( long ) * allocation ) ) == NULL ){
 			error( "execute: out of memory error" );
 		}
+		memcpy( expanded , area , sizeof( long ) * used );
+		munmap( area , *mapped );
+		*mapped = 0;
 	}
-	else if( stackAllocation == stackPointer ){
-		stackAllocation += STACK_ALLOCATION_SIZE;
-		if( ( stack = ( long * ) realloc( stack , sizeof( long ) * stackAllocation ) ) == NULL ){
-			error( "execute: out of memory error" );
-		}
+	else if( ( expanded = ( long * ) realloc( area , sizeof( long ) * allocation ) ) == NULL ){
+		error( "execute: out of memory error" );
+	}
+	return expanded;
+}
+
+static void release( long *area , size_t *mapped ){
+	if( *mapped != 0 ){
+		munmap( area , *mapped );
+		*mapped = 0;
+	}
+	else{
+		free( area );
 	}
-	stack[stackPointer++] = value;
+	return;
+}
+
+static void resizeHeapFile( size_t allocation ){
+	if( HEAP_FILE_RESERVE / sizeof( long ) < allocation || ftruncate( machine.heapDescriptor , ( off_t ) ( sizeof( long ) * allocation ) ) != 0 ){
+		error( "execute: heap file resize error" );
+	}
+	machine.heapAllocation = allocation;
+	return;
+}
+
+static size_t bound( size_t allocation , size_t needed , size_t limit , Halt reason ){
+	if( limit == 0 ){
+		return allocation;
+	}
+	if( limit < needed ){
+		halt( reason );
+	}
+	return allocation < limit ? allocation : limit;
+}
+
+static void expire( int number ){
+	expired = 1;
+	return;
+}
+
+static void push( long value ){
+	if( machine.stackAllocation == machine.stackPointer ){
+		machine.stackAllocation = bound( machine.stackAllocation + STACK_ALLOCATION_SIZE , machine.stackPointer + 1 , machine.limit.stack , HALT_STACK );
+		machine.stack = expand( machine.stack , machine.stackPointer , machine.stackAllocation , &machine.stackMapped );
+	}
+	machine.stack[machine.stackPointer++] = value;
 	return;
 }
 
 static long pop( void ){
-	if( stackPointer == 0 ){
+	if( machine.stackPointer == 0 ){
 		error( "do not have value in stack" );
 	}
-	return stack[--stackPointer];
+	return machine.stack[--machine.stackPointer];
 }
 
 static long getStackValue( int position ){
-	if( position < 0 && stackPointer <= position ){
+	if( position < 0 && machine.stackPointer <= position ){
 		error( "do not have value in stack" );
 	}
-	return stack[stackPointer-position-1];
+	return machine.stack[machine.stackPointer-position-1];
 }
 
 static long getStackTop( void ){
 	return getStackValue( 0 );
 }
 
-static bool callSubRoutine( Instruction *instruction ){
-	current = instruction;
-	while( current != NULL ){
-		if( current->imp == FLOW_CONTROL && current->c_control == END_ROUTINE ){
-			break;
-		}
-		else if( baseProcess( current ) ){
-			return true;
-		}
-	}
-	return false;
-}
-
 static void error( char *message ){
 	fputs( message , stderr );
 	fputc( '\n' , stderr );
-	fflush( stdout );
-	exit( EXIT_FAILURE );
+	halt( HALT_ERROR );
 }
 
@@ -0,0 +1,639 @@
+//
+//  fold.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include <limits.h>
+#include "whitespace.h"
+
+/**
+ * 定数として追跡するスタックの深さ
+ */
+#define FOLD_DEPTH 32
+
+/**
+ * スタックの値を定数として追跡するための枠
+ * 0 番目がスタックの1個目の値を表す
+ */
+struct{
+	bool known[FOLD_DEPTH];	// 値が定数として分かっているか
+	long value[FOLD_DEPTH];	// 定数の値
+	int producer[FOLD_DEPTH];	// 値を積んだ命令の出力位置 積んだ命令が無い場合は -1
+} typedef Frame;
+
+/**
+ * 畳み込みを行う際の基本ブロック
+ */
+struct{
+	Instruction *head;	// ブロックの先頭の命令
+	Instruction *tail;	// ブロックの最後の命令
+	Frame entry;		// ブロック開始時のスタック
+	bool visited;		// 開始時のスタックが設定済みか
+	bool queued;		// 作業リストに入っているか
+} typedef FoldBlock;
+
+/**
+ * 基本ブロック
+ */
+static FoldBlock *blocks = NULL;
+
+/**
+ * 基本ブロックの数
+ */
+static int blockCount = 0;
+
+/**
+ * 命令の通し番号から基本ブロックの番号を引くための表
+ */
+static int *blockAt = NULL;
+
+/**
+ * 開始時のスタックが変化したブロックの作業リスト
+ */
+static int *queue = NULL;
+
+/**
+ * 作業リストに入っているブロックの数
+ */
+static int queueCount = 0;
+
+/**
+ * 畳み込み後の命令列
+ */
+static Instruction **output = NULL;
+
+/**
+ * 畳み込み後の命令数
+ */
+static int outputLength = 0;
+
+/**
+ * 命令セットを基本ブロックに分割する
+ * @param instruction
+ *	分割する命令セット
+ */
+static void split( Instruction *instruction );
+
+/**
+ * ブロック開始時のスタックを定数の流れに沿って求める
+ */
+static void analyze( void );
+
+/**
+ * 後続のブロックに開始時のスタックを伝える
+ * @param instruction
+ *	後続のブロックの先頭の命令
+ * @param frame
+ *	伝えるスタック
+ */
+static void propagate( Instruction *instruction , Frame *frame );
+
+/**
+ * 1つの命令を実行した後のスタックを求める
+ * @param frame
+ *	更新するスタック
+ * @param instruction
+ *	実行する命令
+ */
+static void transfer( Frame *frame , Instruction *instruction );
+
+/**
+ * 1つのブロックの命令を畳み込んで出力する
+ * @param block
+ *	畳み込むブロック
+ */
+static void fold( FoldBlock *block );
+
+/**
+ * 演算結果を求める
+ * @param operation
+ *	演算コマンド
+ * @param left
+ *	左辺
+ * @param right
+ *	右辺
+ * @param result
+ *	演算結果が格納される
+ * @return
+ *	実行時と同じ結果を求められる場合に true を返す
+ */
+static bool calculate( Operation operation , long left , long right , long *result );
+
+/**
+ * スタックに値を積む
+ * @param frame
+ *	更新するスタック
+ * @param known
+ *	値が定数として分かっている場合に true を指定する
+ * @param value
+ *	定数の値
+ * @param producer
+ *	値を積んだ命令の出力位置
+ */
+static void pushFrame( Frame *frame , bool known , long value , int producer );
+
+/**
+ * スタックから値を取り除く
+ * @param frame
+ *	更新するスタック
+ * @param count
+ *	取り除く値の個数
+ */
+static void popFrame( Frame *frame , int count );
+
+/**
+ * スタックの値を全て不明にする
+ * @param frame
+ *	更新するスタック
+ */
+static void forgetFrame( Frame *frame );
+
+/**
+ * 畳み込み後の命令列に命令を追加する
+ * @param instruction
+ *	追加する命令
+ */
+static void emit( Instruction *instruction );
+
+/**
+ * 畳み込み後の命令列の末尾の命令を破棄する
+ */
+static void discard( void );
+
+/**
+ * 畳み込みに使用した領域を破棄する
+ */
+static void clear( void );
+
+/**
+ * エラーメッセージを表示してプログラムを終了する
+ * @param message
+ *	表示するメッセージ
+ */
+static void error( char *message );
+
+
+
+Instruction *foldConstant( Instruction *instruction ){
+	if( instruction == NULL ){
+		return NULL;
+	}
+	split( instruction );
+	analyze();
+	int index;
+	for( index = 0 ; index < blockCount ; index++ ){
+		fold( &blocks[index] );
+	}
+	if( outputLength == 0 ){
+		Instruction *finish = createInstruction();
+		finish->imp = FLOW_CONTROL;
+		finish->c_control = FINISH;
+		emit( finish );
+	}
+	for( index = 0 ; index < outputLength ; index++ ){
+		output[index]->index = index;
+		output[index]->next = index + 1 < outputLength ? output[index + 1] : NULL;
+	}
+	instruction = output[0];
+	clear();
+	return instruction;
+}
+
+static void split( Instruction *instruction ){
+	Instruction *position;
+	int count = 0 , length = 0;
+	bool leader = true;
+	for( position = instruction ; position != NULL ; position = position->next ){
+		if( length <= position->index ){
+			length = position->index + 1;
+		}
+		if( leader || ( position->imp == FLOW_CONTROL && position->c_control == LABEL_DEFINE ) ){
+			count++;
+		}
+		leader = position->imp == FLOW_CONTROL && position->c_control != LABEL_DEFINE;
+	}
+	blocks = ( FoldBlock * ) calloc( count , sizeof( FoldBlock ) );
+	blockAt = ( int * ) malloc( sizeof( int ) * length );
+	queue = ( int * ) malloc( sizeof( int ) * count );
+	output = ( Instruction ** ) malloc( sizeof( Instruction * ) * ( length + count + 1 ) );
+	if( blocks == NULL || blockAt == NULL || queue == NULL || output == NULL ){
+		error( "fold: out of memory error" );
+	}
+	blockCount = 0;
+	leader = true;
+	for( position = instruction ; position != NULL ; position = position->next ){
+		if( leader || ( position->imp == FLOW_CONTROL && position->c_control == LABEL_DEFINE ) ){
+			blocks[blockCount++].head = position;
+		}
+		blocks[blockCount - 1].tail = position;
+		blockAt[position->index] = blockCount - 1;
+		leader = position->imp == FLOW_CONTROL && position->c_control != LABEL_DEFINE;
+	}
+	return;
+}
+
+static void analyze( void ){
+	Frame frame;
+	forgetFrame( &frame );
+	propagate( blocks[0].head , &frame );
+	while( 0 < queueCount ){
+		FoldBlock *block = &blocks[queue[--queueCount]];
+		block->queued = false;
+		frame = block->entry;
+		Instruction *instruction;
+		for( instruction = block->head ; ; instruction = instruction->next ){
+			transfer( &frame , instruction );
+			if( instruction == block->tail ){
+				break;
+			}
+		}
+		Frame unknown;
+		forgetFrame( &unknown );
+		if( instruction->imp != FLOW_CONTROL || instruction->c_control == LABEL_DEFINE ){
+			propagate( instruction->next , &frame );
+			continue;
+		}
+		switch( instruction->c_control ){
+			case CALL_ROUTINE:
+				// FALL THROUGH
+
+			case TAIL_CALL:
+				propagate( instruction->jump , &frame );
+				propagate( instruction->next , &unknown );
+				break;
+
+			case JUMP:
+				propagate( instruction->jump , &frame );
+				break;
+
+			case ZERO_JUMP:
+				// FALL THROUGH
+
+			case MINUS_JUMP:
+				propagate( instruction->jump , &frame );
+				propagate( instruction->next , &frame );
+				break;
+
+			case END_ROUTINE:
+				propagate( instruction->next , &unknown );
+				break;
+
+			default:
+				break;
+		}
+	}
+	return;
+}
+
+static void propagate( Instruction *instruction , Frame *frame ){
+	if( instruction == NULL ){
+		return;
+	}
+	int index = blockAt[instruction->index];
+	FoldBlock *block = &blocks[index];
+	bool changed = false;
+	int position;
+	if( ! block->visited ){
+		block->entry = *frame;
+		block->visited = true;
+		changed = true;
+	}
+	else{
+		for( position = 0 ; position < FOLD_DEPTH ; position++ ){
+			if( block->entry.known[position] && ( ! frame->known[position] || block->entry.value[position] != frame->value[position] ) ){
+				block->entry.known[position] = false;
+				changed = true;
+			}
+		}
+	}
+	for( position = 0 ; position < FOLD_DEPTH ; position++ ){
+		block->entry.producer[position] = -1;
+	}
+	if( changed && ! block->queued ){
+		block->queued = true;
+		queue[queueCount++] = index;
+	}
+	return;
+}
+
+static void transfer( Frame *frame , Instruction *instruction ){
+	long result;
+	int position;
+	switch( instruction->imp ){
+		case STACK:
+			switch( instruction->c_stack ){
+				case PUSH_NUMBER:
+					pushFrame( frame , true , instruction->p_value , -1 );
+					break;
+
+				case TOP_COPY:
+					pushFrame( frame , frame->known[0] , frame->value[0] , -1 );
+					break;
+
+				case N_COPY:
+					position = ( int ) instruction->p_value;
+					if( 0 <= position && position < FOLD_DEPTH ){
+						pushFrame( frame , frame->known[position] , frame->value[position] , -1 );
+					}
+					else{
+						pushFrame( frame , false , 0 , -1 );
+					}
+					break;
+
+				case PUSH_EXCHANGE:
+					result = frame->value[0];
+					frame->value[0] = frame->value[1];
+					frame->value[1] = result;
+					position = frame->known[0];
+					frame->known[0] = frame->known[1];
+					frame->known[1] = position;
+					frame->producer[0] = frame->producer[1] = -1;
+					break;
+
+				case TOP_DESTRUCTION:
+					popFrame( frame , 1 );
+					break;
+
+				case N_SLIDE:
+					result = frame->value[0];
+					position = frame->known[0];
+					popFrame( frame , 1 );
+					if( 0 < instruction->p_value && instruction->p_value < FOLD_DEPTH ){
+						popFrame( frame , ( int ) instruction->p_value );
+						pushFrame( frame , position , result , -1 );
+					}
+					else{
+						forgetFrame( frame );
+					}
+					break;
+
+				default:
+					forgetFrame( frame );
+					break;
+			}
+			break;
+
+		case OPERATION:
+			if( frame->known[0] && frame->known[1] && calculate( instruction->c_operation , frame->value[1] , frame->value[0] , &result ) ){
+				popFrame( frame , 2 );
+				pushFrame( frame , true , result , -1 );
+			}
+			else{
+				popFrame( frame , 2 );
+				pushFrame( frame , false , 0 , -1 );
+			}
+			break;
+
+		case HEAP:
+			switch( instruction->c_heap ){
+				case TO_ADDRESS:
+					popFrame( frame , 2 );
+					break;
+
+				case TO_STACK:
+					popFrame( frame , 1 );
+					pushFrame( frame , false , 0 , -1 );
+					break;
+
+				case TO_VARIABLE:
+					popFrame( frame , 1 );
+					break;
+
+				case VARIABLE_TO_STACK:
+					pushFrame( frame , false , 0 , -1 );
+					break;
+
+				default:
+					forgetFrame( frame );
+					break;
+			}
+			break;
+
+		case FLOW_CONTROL:
+			switch( instruction->c_control ){
+				case ZERO_JUMP:
+					// FALL THROUGH
+
+				case MINUS_JUMP:
+					popFrame( frame , 1 );
+					break;
+
+				default:
+					break;
+			}
+			break;
+
+		case IO:
+			if( instruction->c_io == PUT_CHAR || instruction->c_io == PUT_NUMBER ){
+				popFrame( frame , 1 );
+			}
+			else{
+				frame->producer[0] = -1;
+			}
+			break;
+
+		default:
+			forgetFrame( frame );
+			break;
+	}
+	return;
+}
+
+static void fold( FoldBlock *block ){
+	Frame frame;
+	Instruction *instruction , *next , *jump;
+	long result;
+	bool taken;
+	if( block->visited ){
+		frame = block->entry;
+	}
+	else{
+		forgetFrame( &frame );
+	}
+	for( instruction = block->head ; instruction != NULL ; instruction = next ){
+		next = instruction == block->tail ? NULL : instruction->next;
+		switch( instruction->imp ){
+			case STACK:
+				if( ( instruction->c_stack == TOP_COPY && frame.known[0] )
+				|| ( instruction->c_stack == N_COPY && 0 <= instruction->p_value && instruction->p_value < FOLD_DEPTH && frame.known[instruction->p_value] ) ){
+					instruction->p_value = frame.value[instruction->c_stack == TOP_COPY ? 0 : instruction->p_value];
+					instruction->c_stack = PUSH_NUMBER;
+				}
+				if( instruction->c_stack == PUSH_NUMBER ){
+					emit( instruction );
+					pushFrame( &frame , true , instruction->p_value , outputLength - 1 );
+					continue;
+				}
+				if( instruction->c_stack == TOP_DESTRUCTION && frame.producer[0] == outputLength - 1 && frame.producer[0] != -1 ){
+					discard();
+					destroyInstruction( instruction );
+					popFrame( &frame , 1 );
+					continue;
+				}
+				if( instruction->c_stack == PUSH_EXCHANGE && frame.producer[0] == outputLength - 1 && frame.producer[1] == outputLength - 2 && frame.producer[1] != -1 ){
+					output[outputLength - 1]->p_value = frame.value[1];
+					output[outputLength - 2]->p_value = frame.value[0];
+					frame.value[0] = output[outputLength - 1]->p_value;
+					frame.value[1] = output[outputLength - 2]->p_value;
+					destroyInstruction( instruction );
+					continue;
+				}
+				break;
+
+			case OPERATION:
+				if( frame.known[0] && frame.known[1] && frame.producer[0] == outputLength - 1 && frame.producer[1] == outputLength - 2 && frame.producer[1] != -1
+				&& calculate( instruction->c_operation , frame.value[1] , frame.value[0] , &result ) ){
+					discard();
+					discard();
+					popFrame( &frame , 2 );
+					instruction->imp = STACK;
+					instruction->c_stack = PUSH_NUMBER;
+					instruction->p_value = result;
+					emit( instruction );
+					pushFrame( &frame , true , result , outputLength - 1 );
+					continue;
+				}
+				break;
+
+			case FLOW_CONTROL:
+				if( ( instruction->c_control != ZERO_JUMP && instruction->c_control != MINUS_JUMP ) || ! frame.known[0] ){
+					break;
+				}
+				taken = instruction->c_control == ZERO_JUMP ? frame.value[0] == 0 : frame.value[0] < 0;
+				if( frame.producer[0] == outputLength - 1 && frame.producer[0] != -1 ){
+					discard();
+					popFrame( &frame , 1 );
+					if( taken ){
+						instruction->c_control = JUMP;
+						emit( instruction );
+					}
+					else{
+						destroyInstruction( instruction );
+					}
+					continue;
+				}
+				jump = NULL;
+				if( taken ){
+					jump = createInstruction();
+					jump->imp = FLOW_CONTROL;
+					jump->c_control = JUMP;
+					jump->p_label = instruction->p_label;
+					jump->jump = instruction->jump;
+				}
+				instruction->imp = STACK;
+				instruction->c_stack = TOP_DESTRUCTION;
+				instruction->p_value = 0;
+				instruction->jump = NULL;
+				emit( instruction );
+				popFrame( &frame , 1 );
+				if( jump != NULL ){
+					emit( jump );
+				}
+				continue;
+
+			default:
+				break;
+		}
+		emit( instruction );
+		transfer( &frame , instruction );
+	}
+	return;
+}
+
+static bool calculate( Operation operation , long left , long right , long *result ){
+	switch( operation ){
+		case ADDTION:
+			*result = ( long ) ( ( unsigned long ) left + ( unsigned long ) right );
+			return true;
+
+		case SUBTRACTION:
+			*result = ( long ) ( ( unsigned long ) left - ( unsigned long ) right );
+			return true;
+
+		case MULTIPLICATION:
+			*result = ( long ) ( ( unsigned long ) left * ( unsigned long ) right );
+			return true;
+
+		case DIVISION:
+			if( right == 0 || ( right == -1 && left == LONG_MIN ) ){
+				return false;
+			}
+			*result = left / right;
+			return true;
+
+		case MODULO:
+			if( right == 0 || ( right == -1 && left == LONG_MIN ) ){
+				return false;
+			}
+			*result = left % right;
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+static void pushFrame( Frame *frame , bool known , long value , int producer ){
+	memmove( &frame->known[1] , &frame->known[0] , sizeof( bool ) * ( FOLD_DEPTH - 1 ) );
+	memmove( &frame->value[1] , &frame->value[0] , sizeof( long ) * ( FOLD_DEPTH - 1 ) );
+	memmove( &frame->producer[1] , &frame->producer[0] , sizeof( int ) * ( FOLD_DEPTH - 1 ) );
+	frame->known[0] = known;
+	frame->value[0] = value;
+	frame->producer[0] = producer;
+	return;
+}
+
+static void popFrame( Frame *frame , int count ){
+	while( count-- ){
+		memmove( &frame->known[0] , &frame->known[1] , sizeof( bool ) * ( FOLD_DEPTH - 1 ) );
+		memmove( &frame->value[0] , &frame->value[1] , sizeof( long ) * ( FOLD_DEPTH - 1 ) );
+		memmove( &frame->producer[0] , &frame->producer[1] , sizeof( int ) * ( FOLD_DEPTH - 1 ) );
+		frame->known[FOLD_DEPTH - 1] = false;
+		frame->producer[FOLD_DEPTH - 1] = -1;
+	}
+	return;
+}
+
+static void forgetFrame( Frame *frame ){
+	int position;
+	for( position = 0 ; position < FOLD_DEPTH ; position++ ){
+		frame->known[position] = false;
+		frame->value[position] = 0;
+		frame->producer[position] = -1;
+	}
+	return;
+}
+
+static void emit( Instruction *instruction ){
+	output[outputLength++] = instruction;
+	return;
+}
+
+static void discard( void ){
+	destroyInstruction( output[--outputLength] );
+	return;
+}
+
+static void clear( void ){
+	free( blocks );
+	blocks = NULL;
+	blockCount = 0;
+	free( blockAt );
+	blockAt = NULL;
+	free( queue );
+	queue = NULL;
+	queueCount = 0;
+	free( output );
+	output = NULL;
+	outputLength = 0;
+	return;
+}
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	exit( EXIT_FAILURE );
+}
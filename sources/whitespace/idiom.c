@@ -0,0 +1,640 @@
+//
+//  idiom.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include <limits.h>
+#include "whitespace.h"
+
+/**
+ * ループの先頭で追跡するスタックの深さ
+ */
+#define IDIOM_DEPTH 8
+
+/**
+ * ループの中で追跡するスタックの最大の深さ
+ */
+#define IDIOM_STACK_SIZE 32
+
+/**
+ * ループの先頭のスタックの値で表したスタックの値
+ * ループの先頭での位置 slot の値に offset を足した値で、loaded が true の場合はその値をアドレスとしたヒープの値を表す
+ */
+struct{
+	int slot;		// ループの先頭でのスタックの位置 定数の場合は -1
+	long offset;	// 足す値
+	bool loaded;	// ヒープから読み込んだ値の場合に true
+} typedef Term;
+
+/**
+ * 1回の繰り返しを追跡した結果
+ */
+struct{
+	Instruction *branch;	// ループを抜ける条件ジャンプ
+	Instruction *back;		// ループの先頭へ戻る命令
+	Term test;				// 条件ジャンプが判定する値
+	int effects;			// ヒープへの書き込みと出力の回数
+	bool output;			// 出力の場合に true ヒープへの書き込みの場合は false
+	Term address;			// 書き込むアドレス
+	Term value;				// 書き込むか出力する値
+} typedef Shape;
+
+/**
+ * 追跡しているスタック
+ */
+static Term terms[IDIOM_STACK_SIZE];
+
+/**
+ * 追跡しているスタックの値の個数
+ */
+static int termCount = 0;
+
+/**
+ * 参照したループの先頭のスタックの最も深い位置
+ */
+static int lowest = 0;
+
+/**
+ * 実行中の仮想マシン
+ */
+static Machine *machine = NULL;
+
+/**
+ * ラベル定義の並びから始まるループを調べ、まとめて実行できる場合はその命令を作成する
+ * @param head
+ *	ラベル定義の並びの先頭
+ * @param last
+ *	ラベル定義の並びの最後
+ * @return
+ *	まとめて実行する命令 できない場合は NULL
+ */
+static Instruction *match( Instruction *head , Instruction *last );
+
+/**
+ * ループの1回の繰り返しを追跡する
+ * 分岐はループを抜ける条件ジャンプ1つと、先頭へ戻る無条件ジャンプのみを許す
+ * @param head
+ *	ラベル定義の並びの先頭
+ * @param last
+ *	ラベル定義の並びの最後
+ * @param shape
+ *	追跡した結果が格納される
+ * @return
+ *	決まった形のループとして追跡できた場合に true を返す
+ */
+static bool analyze( Instruction *head , Instruction *last , Shape *shape );
+
+/**
+ * 1つの命令を実行した後のスタックを求める
+ * @param instruction
+ *	実行する命令
+ * @param shape
+ *	ヒープへの書き込みと出力が記録される
+ * @return
+ *	追跡できる命令の場合に true を返す
+ */
+static bool evaluate( Instruction *instruction , Shape *shape );
+
+/**
+ * 命令がラベル定義の並びに含まれているか判定する
+ * @param head
+ *	ラベル定義の並びの先頭
+ * @param last
+ *	ラベル定義の並びの最後
+ * @param instruction
+ *	判定する命令
+ * @return
+ *	含まれている場合に true を返す
+ */
+static bool isRun( Instruction *head , Instruction *last , Instruction *instruction );
+
+/**
+ * 追跡しているスタックの上から指定した個数の値を参照する
+ * @param count
+ *	参照する値の個数
+ * @return
+ *	追跡しているスタックに値が足りる場合に true を返す
+ */
+static bool need( int count );
+
+/**
+ * 追跡しているスタックに値を積む
+ * @param term
+ *	積む値
+ * @return
+ *	追跡できる深さを超えない場合に true を返す
+ */
+static bool pushTerm( Term term );
+
+/**
+ * 追跡しているスタックから値を取り出す
+ * 事前に need で値があることを確認しておく
+ * @return
+ *	取り出した値
+ */
+static Term popTerm( void );
+
+/**
+ * ヒープを埋めるループをまとめて実行する
+ * @param idiom
+ *	ループの形
+ * @param top
+ *	スタックの1個目の値
+ */
+static void fillBlock( Idiom *idiom , long *top );
+
+/**
+ * ヒープを複写するループをまとめて実行する
+ * @param idiom
+ *	ループの形
+ * @param top
+ *	スタックの1個目の値
+ */
+static void copyBlock( Idiom *idiom , long *top );
+
+/**
+ * ヒープの文字列を出力するループをまとめて実行する
+ * @param idiom
+ *	ループの形
+ * @param top
+ *	スタックの1個目の値
+ */
+static void putString( Idiom *idiom , long *top );
+
+/**
+ * まとめて実行した回数だけスタックの値を進める
+ * 回数とアドレスを同じ位置の値で兼ねている場合は1度だけ進める
+ * @param idiom
+ *	ループの形
+ * @param top
+ *	スタックの1個目の値
+ * @param count
+ *	まとめて実行した回数
+ */
+static void advance( Idiom *idiom , long *top , long count );
+
+/**
+ * ループを抜けずに繰り返す回数を求める
+ * 抜けるまでに値が桁溢れする場合は 0 を返し、元のループに任せる
+ * @param idiom
+ *	ループの形
+ * @param value
+ *	条件ジャンプが判定する値
+ * @return
+ *	繰り返す回数
+ */
+static long countIteration( Idiom *idiom , long value );
+
+/**
+ * アドレスが int の範囲に収まるように回数を制限する
+ * @param address
+ *	最初のアドレス
+ * @param count
+ *	回数
+ * @return
+ *	制限した回数
+ */
+static long clampRange( long address , long count );
+
+/**
+ * 固定スロットに割り当てたアドレスを含まず、確保済みのヒープに収まる範囲か判定する
+ * @param address
+ *	最初のアドレス
+ * @param count
+ *	アドレスの個数
+ * @return
+ *	ヒープの配列を直接読み書きできる場合に true を返す
+ */
+static bool isPlain( long address , long count );
+
+/**
+ * ヒープの値を読み込めるアドレスか判定する
+ * @param address
+ *	0 以上のアドレス
+ * @return
+ *	読み込める場合に true を返す
+ */
+static bool isReadable( long address );
+
+/**
+ * 実行時と同じく桁溢れを折り返して値を足す
+ * @param value
+ *	値
+ * @param offset
+ *	足す値
+ * @return
+ *	足した値
+ */
+static long shift( long value , long offset );
+
+
+
+Instruction *recognizeIdiom( Instruction *instruction ){
+	Instruction *position , *last , *inserted;
+	bool changed = false;
+	int number = 0;
+	for( position = instruction ; position != NULL ; position = position->next ){
+		if( position->imp != FLOW_CONTROL || position->c_control != LABEL_DEFINE ){
+			continue;
+		}
+		for( last = position ; last->next != NULL && last->next->imp == FLOW_CONTROL && last->next->c_control == LABEL_DEFINE ; last = last->next );
+		if( ( inserted = match( position , last ) ) != NULL ){
+			inserted->next = last->next;
+			last->next = inserted;
+			changed = true;
+		}
+		position = last;
+	}
+	if( changed ){
+		for( position = instruction ; position != NULL ; position = position->next ){
+			position->index = number++;
+		}
+	}
+	return instruction;
+}
+
+void executeIdiom( Instruction *instruction ){
+	Idiom *idiom = instruction->p_idiom;
+	long *top;
+	machine = getMachine();
+	// スタックが足りない場合は元のループにエラーを任せる
+	if( machine->stackPointer < idiom->depth ){
+		return;
+	}
+	top = machine->stack + machine->stackPointer - 1;
+	if( instruction->imp == IO ){
+		putString( idiom , top );
+	}
+	else if( instruction->c_heap == BLOCK_FILL ){
+		fillBlock( idiom , top );
+	}
+	else{
+		copyBlock( idiom , top );
+	}
+	return;
+}
+
+static Instruction *match( Instruction *head , Instruction *last ){
+	Shape shape;
+	Instruction *instruction;
+	Idiom found = { 0 };
+	Term test , address , value;
+	long delta[IDIOM_DEPTH] , expect[IDIOM_DEPTH] = { 0 };
+	int slot;
+	if( ! analyze( head , last , &shape ) || termCount != IDIOM_DEPTH || shape.effects != 1 ){
+		return NULL;
+	}
+	// 1回の繰り返しで各位置の値は自身に定数を足した値にならなければならない
+	for( slot = 0 ; slot < IDIOM_DEPTH ; slot++ ){
+		if( terms[IDIOM_DEPTH - 1 - slot].slot != slot || terms[IDIOM_DEPTH - 1 - slot].loaded ){
+			return NULL;
+		}
+		delta[slot] = terms[IDIOM_DEPTH - 1 - slot].offset;
+	}
+	test = shape.test;
+	address = shape.address;
+	value = shape.value;
+	found.depth = IDIOM_DEPTH - lowest;
+	found.back = shape.back;
+	found.negative = shape.branch->c_control == MINUS_JUMP;
+	found.source = value.slot;
+	found.sourceOffset = value.offset;
+	if( shape.output ){
+		// 読み込んだ文字が 0 の場合に抜け、そうでなければ出力して次のアドレスに進む
+		if( ! value.loaded || value.slot < 0 || ! test.loaded || test.slot != value.slot || test.offset != value.offset || found.negative ){
+			return NULL;
+		}
+		expect[value.slot] = 1;
+	}
+	else{
+		// 残り回数が 0 か負になると抜け、そうでなければ書き込んで次のアドレスに進む
+		// 同じ位置の値を回数とアドレスに兼ねる場合は、差分の食い違いを下の比較で弾く
+		if( address.loaded || address.slot < 0 || test.loaded || test.slot < 0
+		|| ( ! value.loaded && 0 <= value.slot && ( value.slot == address.slot || value.slot == test.slot ) )
+		|| ( value.loaded && value.slot < 0 ) || ( delta[test.slot] != 1 && delta[test.slot] != -1 ) ){
+			return NULL;
+		}
+		expect[test.slot] = delta[test.slot];
+		expect[address.slot] = 1;
+		if( value.loaded ){
+			expect[value.slot] = 1;
+		}
+		found.copy = value.loaded;
+		found.counter = test.slot;
+		found.counterOffset = test.offset;
+		found.step = ( int ) delta[test.slot];
+		found.destination = address.slot;
+		found.destinationOffset = address.offset;
+	}
+	for( slot = 0 ; slot < IDIOM_DEPTH ; slot++ ){
+		if( delta[slot] != expect[slot] ){
+			return NULL;
+		}
+	}
+	instruction = createInstruction();
+	if( shape.output ){
+		instruction->imp = IO;
+		instruction->c_io = PUT_STRING;
+	}
+	else{
+		instruction->imp = HEAP;
+		instruction->c_heap = value.loaded ? BLOCK_COPY : BLOCK_FILL;
+	}
+	instruction->p_idiom = ( Idiom * ) createArea( sizeof( Idiom ) );
+	*instruction->p_idiom = found;
+	return instruction;
+}
+
+static bool analyze( Instruction *head , Instruction *last , Shape *shape ){
+	Instruction *position;
+	int slot;
+	memset( shape , 0 , sizeof( Shape ) );
+	for( slot = 0 ; slot < IDIOM_DEPTH ; slot++ ){
+		terms[IDIOM_DEPTH - 1 - slot] = ( Term ){ slot , 0 , false };
+	}
+	termCount = lowest = IDIOM_DEPTH;
+	for( position = last->next ; position != NULL ; position = position->next ){
+		if( position->imp != FLOW_CONTROL ){
+			if( ! evaluate( position , shape ) ){
+				return false;
+			}
+			continue;
+		}
+		switch( position->c_control ){
+			case ZERO_JUMP:
+			case MINUS_JUMP:
+				if( shape->branch != NULL || position->jump == NULL || isRun( head , last , position->jump ) || ! need( 1 ) ){
+					return false;
+				}
+				shape->branch = position;
+				shape->test = popTerm();
+				break;
+
+			case JUMP:
+				shape->back = position;
+				return shape->branch != NULL && isRun( head , last , position->jump );
+
+			default:
+				return false;
+		}
+	}
+	return false;
+}
+
+static bool evaluate( Instruction *instruction , Shape *shape ){
+	Term left , right;
+	int count;
+	switch( instruction->imp ){
+		case STACK:
+			switch( instruction->c_stack ){
+				case PUSH_NUMBER:
+					return pushTerm( ( Term ){ -1 , instruction->p_value , false } );
+
+				case TOP_COPY:
+					return need( 1 ) && pushTerm( terms[termCount - 1] );
+
+				case N_COPY:
+					if( instruction->p_value < 0 || IDIOM_STACK_SIZE <= instruction->p_value ){
+						return false;
+					}
+					count = ( int ) instruction->p_value;
+					return need( count + 1 ) && pushTerm( terms[termCount - count - 1] );
+
+				case PUSH_EXCHANGE:
+					if( ! need( 2 ) ){
+						return false;
+					}
+					left = terms[termCount - 2];
+					terms[termCount - 2] = terms[termCount - 1];
+					terms[termCount - 1] = left;
+					return true;
+
+				case TOP_DESTRUCTION:
+					if( ! need( 1 ) ){
+						return false;
+					}
+					termCount--;
+					return true;
+
+				case N_SLIDE:
+					if( instruction->p_value < 0 || IDIOM_STACK_SIZE <= instruction->p_value ){
+						return false;
+					}
+					count = ( int ) instruction->p_value;
+					if( ! need( count + 1 ) ){
+						return false;
+					}
+					terms[termCount - count - 1] = terms[termCount - 1];
+					termCount -= count;
+					return true;
+
+				default:
+					return false;
+			}
+
+		case OPERATION:
+			if( ! need( 2 ) ){
+				return false;
+			}
+			right = popTerm();
+			left = popTerm();
+			if( left.loaded || right.loaded ){
+				return false;
+			}
+			// 位置の値に定数を足し引きする場合のみ追跡する
+			if( instruction->c_operation == ADDTION && ( left.slot < 0 || right.slot < 0 ) ){
+				return pushTerm( ( Term ){ left.slot < 0 ? right.slot : left.slot , shift( left.offset , right.offset ) , false } );
+			}
+			if( instruction->c_operation == SUBTRACTION && right.slot < 0 ){
+				return pushTerm( ( Term ){ left.slot , shift( left.offset , ( long ) ( 0UL - ( unsigned long ) right.offset ) ) , false } );
+			}
+			return false;
+
+		case HEAP:
+			if( instruction->c_heap == TO_ADDRESS ){
+				if( ! need( 2 ) ){
+					return false;
+				}
+				shape->value = popTerm();
+				shape->address = popTerm();
+				shape->output = false;
+				return ! shape->address.loaded && shape->effects++ == 0;
+			}
+			if( instruction->c_heap == TO_STACK ){
+				if( ! need( 1 ) ){
+					return false;
+				}
+				left = popTerm();
+				if( left.loaded ){
+					return false;
+				}
+				left.loaded = true;
+				return pushTerm( left );
+			}
+			return false;
+
+		case IO:
+			if( instruction->c_io != PUT_CHAR || ! need( 1 ) ){
+				return false;
+			}
+			shape->value = popTerm();
+			shape->output = true;
+			return shape->effects++ == 0;
+
+		default:
+			return false;
+	}
+}
+
+static bool isRun( Instruction *head , Instruction *last , Instruction *instruction ){
+	Instruction *position;
+	for( position = head ; position != NULL ; position = position->next ){
+		if( position == instruction ){
+			return true;
+		}
+		if( position == last ){
+			break;
+		}
+	}
+	return false;
+}
+
+static bool need( int count ){
+	if( termCount < count ){
+		return false;
+	}
+	if( termCount - count < lowest ){
+		lowest = termCount - count;
+	}
+	return true;
+}
+
+static bool pushTerm( Term term ){
+	if( IDIOM_STACK_SIZE <= termCount ){
+		return false;
+	}
+	terms[termCount++] = term;
+	return true;
+}
+
+static Term popTerm( void ){
+	return terms[--termCount];
+}
+
+static void fillBlock( Idiom *idiom , long *top ){
+	long count = countIteration( idiom , shift( top[-idiom->counter] , idiom->counterOffset ) );
+	long address = shift( top[-idiom->destination] , idiom->destinationOffset );
+	long value = idiom->source < 0 ? idiom->sourceOffset : shift( top[-idiom->source] , idiom->sourceOffset );
+	long done;
+	count = clampRange( address , count );
+	if( ! machine->governed && isPlain( address , count ) ){
+		for( done = 0 ; done < count ; done++ ){
+			machine->heap[address + done] = value;
+		}
+	}
+	else{
+		for( done = 0 ; done < count ; done++ ){
+			setHeapValue( ( int ) ( address + done ) , value );
+			if( machine->governed ){
+				consumeFuel( idiom->back->index - idiom->back->jump->index + 1 );
+			}
+		}
+	}
+	advance( idiom , top , count );
+	return;
+}
+
+static void copyBlock( Idiom *idiom , long *top ){
+	long count = countIteration( idiom , shift( top[-idiom->counter] , idiom->counterOffset ) );
+	long destination = shift( top[-idiom->destination] , idiom->destinationOffset );
+	long source = shift( top[-idiom->source] , idiom->sourceOffset );
+	long done;
+	count = clampRange( source , clampRange( destination , count ) );
+	if( ! machine->governed && isPlain( destination , count ) && isPlain( source , count ) ){
+		if( destination <= source || source + count <= destination ){
+			memmove( machine->heap + destination , machine->heap + source , sizeof( long ) * count );
+		}
+		else{
+			// 複写先が後ろに重なる場合は、1つずつ複写した時と同じく先頭の値が繰り返される
+			for( done = 0 ; done < count ; done++ ){
+				machine->heap[destination + done] = machine->heap[source + done];
+			}
+		}
+	}
+	else{
+		// 読み込めないアドレスに達したら止め、エラーは元のループに任せる
+		for( done = 0 ; done < count && isReadable( source + done ) ; done++ ){
+			setHeapValue( ( int ) ( destination + done ) , getHeapValue( ( int ) ( source + done ) ) );
+			if( machine->governed ){
+				consumeFuel( idiom->back->index - idiom->back->jump->index + 1 );
+			}
+		}
+		count = done;
+	}
+	advance( idiom , top , count );
+	return;
+}
+
+static void putString( Idiom *idiom , long *top ){
+	long address = shift( top[-idiom->source] , idiom->sourceOffset ) , value , count , limit;
+	limit = clampRange( address , LONG_MAX );
+	for( count = 0 ; count < limit && isReadable( address + count ) ; count++ ){
+		if( ( value = getHeapValue( ( int ) ( address + count ) ) ) == 0 ){
+			break;
+		}
+		putc( ( char ) ( value & 0xFF ) , machine->output );
+		machine->outputOffset++;
+		if( machine->governed ){
+			consumeFuel( idiom->back->index - idiom->back->jump->index + 1 );
+		}
+	}
+	// 1文字ずつではなく、まとめて書き出す
+	fflush( machine->output );
+	top[-idiom->source] = shift( top[-idiom->source] , count );
+	return;
+}
+
+static void advance( Idiom *idiom , long *top , long count ){
+	top[-idiom->counter] = shift( top[-idiom->counter] , idiom->step * count );
+	if( idiom->destination != idiom->counter ){
+		top[-idiom->destination] = shift( top[-idiom->destination] , count );
+	}
+	// 埋める値の位置は進めない
+	if( idiom->copy && idiom->source != idiom->counter && idiom->source != idiom->destination ){
+		top[-idiom->source] = shift( top[-idiom->source] , count );
+	}
+	return;
+}
+
+static long countIteration( Idiom *idiom , long value ){
+	if( idiom->negative ){
+		// 減っていく場合は 0 を含めて負になるまで繰り返す
+		return idiom->step < 0 && 0 <= value && value < LONG_MAX ? value + 1 : 0;
+	}
+	if( idiom->step < 0 ){
+		return 0 <= value ? value : 0;
+	}
+	return value <= 0 && LONG_MIN < value ? -value : 0;
+}
+
+static long clampRange( long address , long count ){
+	if( address < 0 || INT_MAX < address ){
+		return 0;
+	}
+	return ( long ) INT_MAX - address + 1 < count ? ( long ) INT_MAX - address + 1 : count;
+}
+
+static bool isPlain( long address , long count ){
+	return machine->variableLimit <= address && address + count <= ( long ) machine->heapAllocation;
+}
+
+static bool isReadable( long address ){
+	return address < ( long ) machine->heapAllocation;
+}
+
+static long shift( long value , long offset ){
+	return ( long ) ( ( unsigned long ) value + ( unsigned long ) offset );
+}
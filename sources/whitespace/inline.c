@@ -0,0 +1,186 @@
+//
+//  inline.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include "whitespace.h"
+
+/**
+ * 展開したサブルーチン
+ */
+struct{
+	Instruction *label;	// サブルーチンのラベル定義
+	int size;			// サブルーチンの命令数
+	int count;			// 展開した呼び出し箇所の数
+} typedef Inlined;
+
+/**
+ * 展開したサブルーチンの一覧
+ */
+static Inlined *inlined = NULL;
+
+/**
+ * 展開したサブルーチンの数
+ */
+static int inlinedCount = 0;
+
+/**
+ * 展開したサブルーチンの一覧の確保サイズ
+ */
+static int inlinedAllocation = 0;
+
+/**
+ * サブルーチンが展開できる場合にその命令数を取得する
+ * 展開できるのはフロー制御を含まない命令のみでサブルーチン終了に到達するものに限る
+ * @param label
+ *	サブルーチンのラベル定義
+ * @param budget
+ *	展開できる命令数の上限
+ * @return
+ *	展開できる場合は命令数を返す
+ *	展開できない場合は -1 を返す
+ */
+static int getInlineSize( Instruction *label , int budget );
+
+/**
+ * サブルーチンの命令を複製する
+ * @param label
+ *	サブルーチンのラベル定義
+ * @param tail
+ *	複製した最後の命令が格納される
+ * @return
+ *	複製した最初の命令
+ */
+static Instruction *copyRoutine( Instruction *label , Instruction **tail );
+
+/**
+ * 展開したサブルーチンを記録する
+ * @param label
+ *	サブルーチンのラベル定義
+ * @param size
+ *	サブルーチンの命令数
+ */
+static void record( Instruction *label , int size );
+
+/**
+ * 展開したサブルーチンの一覧を標準エラー出力に表示する
+ */
+static void report( void );
+
+/**
+ * エラーメッセージを表示してプログラムを終了する
+ * @param message
+ *	表示するメッセージ
+ */
+static void error( char *message );
+
+
+
+Instruction *inlineRoutine( Instruction *instruction , int budget ){
+	Instruction *position , *next , *previous = NULL , *start = NULL , *head , *tail;
+	int size , index = 0;
+	for( position = instruction ; position != NULL ; position = next ){
+		next = position->next;
+		if( position->imp == FLOW_CONTROL && ( position->c_control == CALL_ROUTINE || position->c_control == TAIL_CALL )
+		&& position->jump != NULL && 0 < ( size = getInlineSize( position->jump , budget ) ) ){
+			record( position->jump , size );
+			head = copyRoutine( position->jump , &tail );
+			destroyInstruction( position );
+			if( previous != NULL ){
+				previous->next = head;
+			}
+			if( start == NULL ){
+				start = head;
+			}
+			tail->next = next;
+			previous = tail;
+			continue;
+		}
+		if( start == NULL ){
+			start = position;
+		}
+		previous = position;
+	}
+	for( position = start ; position != NULL ; position = position->next ){
+		position->index = index++;
+	}
+	report();
+	return start;
+}
+
+static int getInlineSize( Instruction *label , int budget ){
+	Instruction *position;
+	int size = 0;
+	for( position = label->next ; position != NULL ; position = position->next ){
+		if( position->imp == FLOW_CONTROL ){
+			return position->c_control == END_ROUTINE && 0 < size ? size : -1;
+		}
+		if( budget < ++size ){
+			return -1;
+		}
+	}
+	return -1;
+}
+
+static Instruction *copyRoutine( Instruction *label , Instruction **tail ){
+	Instruction *position , *copy , *head = NULL , *previous = NULL;
+	for( position = label->next ; position->imp != FLOW_CONTROL ; position = position->next ){
+		copy = createInstruction();
+		*copy = *position;
+		copy->next = NULL;
+		if( previous != NULL ){
+			previous->next = copy;
+		}
+		else{
+			head = copy;
+		}
+		previous = copy;
+	}
+	*tail = previous;
+	return head;
+}
+
+static void record( Instruction *label , int size ){
+	int index;
+	for( index = 0 ; index < inlinedCount ; index++ ){
+		if( inlined[index].label == label ){
+			inlined[index].count++;
+			return;
+		}
+	}
+	if( inlinedAllocation <= inlinedCount ){
+		inlinedAllocation += BUFFER_SIZE;
+		if( ( inlined = ( Inlined * ) realloc( inlined , sizeof( Inlined ) * inlinedAllocation ) ) == NULL ){
+			error( "inline: out of memory error" );
+		}
+	}
+	inlined[inlinedCount].label = label;
+	inlined[inlinedCount].size = size;
+	inlined[inlinedCount].count = 1;
+	inlinedCount++;
+	return;
+}
+
+static void report( void ){
+	int index;
+	for( index = 0 ; index < inlinedCount ; index++ ){
+		fputs( "inline: " , stderr );
+		writeLabel( inlined[index].label->p_label , stderr );
+		fprintf( stderr , " ( %d instructions ) at %d call sites\n" , inlined[index].size , inlined[index].count );
+	}
+	if( inlined != NULL ){
+		free( inlined );
+		inlined = NULL;
+	}
+	inlinedCount = inlinedAllocation = 0;
+	return;
+}
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	exit( EXIT_FAILURE );
+}
@@ -12,70 +12,316 @@
 
 char buffer[BUFFER_SIZE];
 
+bool verbose = false;
+
 void line( int length );
 
+void message( const char *text );
+
+const char *getOptionValue( const char *argument , const char *option );
+
 int main(int argc, const char * argv[])
 {
 
 	FILE *file = stdin;
+	FILE *listing = NULL;
+	const char *engine = STACK_ENGINE , *checkpoint = NULL , *restore = NULL , *server = NULL , *client = NULL , *emit = NULL , *heapFile = NULL , *heapSwap = NULL , *profile = NULL , *value;
+	bool optimize = false , run = true , counters = false , lazy = false;
+	const char *batch[argc];
+	int budget = 0 , workers = DEFAULT_WORKER_COUNT , status = EXIT_SUCCESS , batchCount = 0;
+	long interval = 0 , quantum = 0 , frequency = 0;
+	Limit limit = { 0 };
+	Halt reason;
 
-	if( 2 < argc && strcmp( argv[1] , FILE_OPTION ) == 0 ){
-		if( ( file = fopen( argv[2] , "r" ) ) == NULL ){
-			fputs( "open file error.\n" , stderr );
+	for( int argument = 1 ; argument < argc ; argument++ ){
+		if( strcmp( argv[argument] , FILE_OPTION ) == 0 && argument + 1 < argc ){
+			if( ( file = fopen( argv[++argument] , "r" ) ) == NULL ){
+				fputs( "open file error.\n" , stderr );
+				return EXIT_FAILURE;
+			}
+		}
+		else if( strcmp( argv[argument] , OPTIMIZE_OPTION ) == 0 ){
+			optimize = true;
+		}
+		else if( strcmp( argv[argument] , PERF_COUNTERS_OPTION ) == 0 ){
+			counters = true;
+		}
+		else if( strcmp( argv[argument] , LAZY_OPTION ) == 0 ){
+			lazy = true;
+		}
+		else if( strcmp( argv[argument] , VERBOSE_OPTION ) == 0 ){
+			verbose = true;
+		}
+		else if( strcmp( argv[argument] , DISASSEMBLE_OPTION ) == 0 ){
+			listing = stdout;
+			run = false;
+		}
+		else if( ( value = getOptionValue( argv[argument] , DISASSEMBLE_FILE_OPTION ) ) != NULL ){
+			if( ( listing = fopen( value , "w" ) ) == NULL ){
+				fputs( "open file error.\n" , stderr );
+				return EXIT_FAILURE;
+			}
+		}
+		else if( ( value = getOptionValue( argv[argument] , INLINE_OPTION ) ) != NULL ){
+			budget = atoi( value );
+		}
+		else if( ( value = getOptionValue( argv[argument] , ENGINE_OPTION ) ) != NULL ){
+			if( strcmp( value , STACK_ENGINE ) != 0 && strcmp( value , REGISTER_ENGINE ) != 0 && strcmp( value , TRACE_ENGINE ) != 0 && strcmp( value , CACHE_ENGINE ) != 0 ){
+				fputs( "unknown engine.\n" , stderr );
+				return EXIT_FAILURE;
+			}
+			engine = value;
+		}
+		else if( ( value = getOptionValue( argv[argument] , EMIT_OPTION ) ) != NULL ){
+			emit = value;
+		}
+		else if( ( value = getOptionValue( argv[argument] , CHECKPOINT_OPTION ) ) != NULL ){
+			checkpoint = value;
+		}
+		else if( ( value = getOptionValue( argv[argument] , CHECKPOINT_INTERVAL_OPTION ) ) != NULL ){
+			interval = atol( value );
+		}
+		else if( ( value = getOptionValue( argv[argument] , RESTORE_OPTION ) ) != NULL ){
+			restore = value;
+		}
+		else if( ( value = getOptionValue( argv[argument] , BATCH_OPTION ) ) != NULL ){
+			batch[batchCount++] = value;
+		}
+		else if( ( value = getOptionValue( argv[argument] , SERVE_OPTION ) ) != NULL ){
+			server = value;
+		}
+		else if( ( value = getOptionValue( argv[argument] , WORKER_OPTION ) ) != NULL ){
+			workers = atoi( value );
+		}
+		else if( ( value = getOptionValue( argv[argument] , QUANTUM_OPTION ) ) != NULL ){
+			quantum = atol( value );
+		}
+		else if( ( value = getOptionValue( argv[argument] , CONNECT_OPTION ) ) != NULL ){
+			client = value;
+		}
+		else if( ( value = getOptionValue( argv[argument] , FUEL_OPTION ) ) != NULL ){
+			limit.fuel = atol( value );
+		}
+		else if( ( value = getOptionValue( argv[argument] , HEAP_LIMIT_OPTION ) ) != NULL ){
+			limit.heap = strtoul( value , NULL , 10 );
+		}
+		else if( ( value = getOptionValue( argv[argument] , HEAP_FILE_OPTION ) ) != NULL ){
+			heapFile = value;
+		}
+		else if( ( value = getOptionValue( argv[argument] , HEAP_SWAP_OPTION ) ) != NULL ){
+			heapSwap = value;
+		}
+		else if( ( value = getOptionValue( argv[argument] , STACK_LIMIT_OPTION ) ) != NULL ){
+			limit.stack = strtoul( value , NULL , 10 );
+		}
+		else if( ( value = getOptionValue( argv[argument] , CALL_LIMIT_OPTION ) ) != NULL ){
+			limit.call = strtoul( value , NULL , 10 );
+		}
+		else if( ( value = getOptionValue( argv[argument] , TIME_LIMIT_OPTION ) ) != NULL ){
+			limit.milliseconds = atol( value );
+		}
+		else if( ( value = getOptionValue( argv[argument] , PROFILE_OPTION ) ) != NULL ){
+			profile = value;
+		}
+		else if( ( value = getOptionValue( argv[argument] , SAMPLE_PROFILE_OPTION ) ) != NULL ){
+			frequency = atol( value );
+		}
+	}
+
+	if( server != NULL && 0 < quantum && strcmp( engine , STACK_ENGINE ) != 0 ){
+		fputs( "quantum can only be used with the stack engine.\n" , stderr );
+		return EXIT_FAILURE;
+	}
+	if( server != NULL ){
+		return serve( server , workers , engine , optimize , budget , quantum , &limit );
+	}
+	if( client != NULL ){
+		if( file == stdin ){
+			fputs( "program file is required.\n" , stderr );
+			return EXIT_FAILURE;
+		}
+		return connectServer( client , file );
+	}
+	if( 0 < batchCount && ( checkpoint != NULL || restore != NULL || heapFile != NULL || heapSwap != NULL ) ){
+		fputs( "batch can not be used with snapshot or heap file.\n" , stderr );
+		return EXIT_FAILURE;
+	}
+	if( profile != NULL && ( 0 < batchCount || checkpoint != NULL || restore != NULL ) ){
+		fputs( "profile can not be used with batch or snapshot.\n" , stderr );
+		return EXIT_FAILURE;
+	}
+	if( lazy && ( optimize || 0 < budget || listing != NULL || emit != NULL || strcmp( engine , STACK_ENGINE ) != 0
+	|| 0 < batchCount || checkpoint != NULL || restore != NULL || profile != NULL || 0 < frequency || counters ) ){
+		fputs( "lazy can only be used with the stack engine and without optimization or analysis.\n" , stderr );
+		return EXIT_FAILURE;
+	}
+	if( ( 0 < frequency || counters ) && 0 < batchCount ){
+		fputs( "sample-profile and perf-counters can not be used with batch.\n" , stderr );
+		return EXIT_FAILURE;
+	}
+	setStream( stdin , stdout );
+	if( heapFile != NULL || heapSwap != NULL ){
+		if( restore != NULL ){
+			fputs( "heap file can not be used with restore.\n" , stderr );
 			return EXIT_FAILURE;
 		}
-		fputs( "source loading" , stdout );
+		setHeapFile( heapFile != NULL ? heapFile : heapSwap , heapFile == NULL );
+	}
+
+	if( file != stdin ){
+		message( "source loading" );
 	}
 
 	size_t count;
 	int index = 0;
-	while( ( count = fread( buffer , sizeof( char ) , BUFFER_SIZE , file ) ) != 0 ){
+	if( counters ){
+		openCounters();
+		startCounters();
+	}
+	while( ( count = fread( buffer , sizeof( char ) , BUFFER_SIZE - 1 , file ) ) != 0 ){
 		buffer[count] = '\0';
 		setProgram( buffer , BUFFER_SIZE );
 		if( file != stdin && index++ % 10 == 0 ){
-			fputc( '.' , stdout );
+			message( "." );
 		}
 	}
-	fputc( '\n' , stdout );
+	message( "\n" );
 	if( feof( file ) == 0 ){
 		fputs( "read error!\n" , stderr );
 	}
-	fputs( "load finished\n" , stdout );
+	message( "load finished\n" );
 
-	fputs( "initialize instruction\n" , stdout );
-	Instruction *instruction = getInstruction();
+	message( "initialize instruction\n" );
+	Instruction *instruction = lazy ? getLazyInstruction() : getInstruction();
+	if( 0 < budget ){
+		instruction = inlineRoutine( instruction , budget );
+	}
+	if( optimize ){
+		instruction = foldConstant( instruction );
+		instruction = promoteHeap( instruction );
+		instruction = recognizeIdiom( instruction );
+	}
+	if( ! lazy ){
+		instruction = linkInstruction( instruction );
+	}
+	if( counters ){
+		long decoded = 0;
+		for( Instruction *position = instruction ; position != NULL ; position = position->next ){
+			decoded++;
+		}
+		reportCounters( "parse" , decoded , stderr );
+	}
 
-	programClear();
-	fputs( "initialize finished\n\n" , stdout );
+	// 遅延読み込みでは実行しながら解析するため、プログラムは実行を終えてから破棄する
+	if( ! lazy ){
+		programClear();
+	}
+	message( "initialize finished\n\n" );
 
-	fputs( "disassemble start\n" , stdout );
-	line( LINE_LENGTH );
-	disassemble( instruction );
-	line( LINE_LENGTH );
-	fputs( "disassemble finished\n\n" , stdout );
+	if( listing != NULL ){
+		disassemble( instruction , listing );
+		if( listing != stdout ){
+			fclose( listing );
+		}
+	}
+	if( emit != NULL ){
+		emitExecutable( instruction , emit );
+		run = false;
+	}
+	if( ! run ){
+		freeInstruction( instruction );
+		return EXIT_SUCCESS;
+	}
 
-	fputs( "program start\n" , stdout );
+	message( "program start\n" );
 	line( LINE_LENGTH );
-	execute( instruction );
+	setLimit( &limit );
+	if( 0 < frequency ){
+		startSample( instruction , frequency );
+	}
+	if( counters ){
+		startCounters();
+	}
+	if( 0 < batchCount ){
+		status = executeBatch( instruction , batch , batchCount , workers , &limit );
+		reason = HALT_NONE;
+	}
+	else if( checkpoint != NULL || restore != NULL ){
+		setSnapshot( instruction , checkpoint , interval );
+		reason = executeGoverned( executeSnapshot , restore != NULL ? restoreSnapshot( restore ) : instruction );
+		snapshotClear();
+	}
+	else if( profile != NULL ){
+		reason = executeGoverned( executeProfile , instruction );
+		writeProfile( profile );
+	}
+	else if( strcmp( engine , REGISTER_ENGINE ) == 0 ){
+		reason = executeGoverned( executeRegister , instruction );
+	}
+	else if( strcmp( engine , TRACE_ENGINE ) == 0 ){
+		reason = executeGoverned( executeTrace , instruction );
+	}
+	else if( strcmp( engine , CACHE_ENGINE ) == 0 ){
+		reason = executeGoverned( executeCache , instruction );
+	}
+	else if( counters ){
+		reason = executeGoverned( executeCounted , instruction );
+	}
+	else{
+		reason = executeGoverned( execute , instruction );
+	}
+	fflush( stdout );
+	if( counters ){
+		reportCounters( "execute" , getExecutedCount() , stderr );
+		closeCounters();
+	}
+	if( 0 < frequency ){
+		reportSample( stderr );
+	}
+	if( reason != HALT_NONE ){
+		reportHalt( reason );
+		status = reason == HALT_ERROR ? EXIT_FAILURE : LIMIT_EXIT_STATUS;
+	}
 
 	line( LINE_LENGTH );
-	fputs( "program finish\n" , stdout );
+	message( "program finish\n" );
 
-	fputc( '\n' , stdout );
-	fputs( "end process\n" , stdout );
+	message( "\n" );
+	message( "end process\n" );
 	freeInstruction( instruction );
+	if( lazy ){
+		programClear();
+	}
 	stackClear();
 	heapClear();
-	fputs( "all finished\n" , stdout );
+	message( "all finished\n" );
 
-	return EXIT_SUCCESS;
+	return status;
 }
 
 
 void line( int length ){
+	if( ! verbose ){
+		return;
+	}
 	while( length-- ){
-		fputc( '-' , stdout );
+		fputc( '-' , stderr );
 	}
-	fputc( '\n' , stdout );
+	fputc( '\n' , stderr );
 	return;
 }
+
+void message( const char *text ){
+	if( verbose ){
+		fputs( text , stderr );
+	}
+	return;
+}
+
+const char *getOptionValue( const char *argument , const char *option ){
+	size_t size = strlen( option );
+	if( strncmp( argument , option , size ) == 0 ){
+		return argument + size;
+	}
+	return NULL;
+}
@@ -0,0 +1,93 @@
+//
+//  number.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include <limits.h>
+#include "whitespace.h"
+
+/**
+ * 00 から 99 までの2桁の数字を並べた表
+ * 2桁ずつ変換することで除算の回数を半分にする
+ */
+static const char digitPairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/**
+ * 文字が isspace と同じ空白か判定する
+ * @param character
+ *	判定する文字
+ * @return
+ *	空白の場合は true
+ */
+static bool isBlank( char character );
+
+
+
+int formatNumber( long value , char *destination ){
+	char buffer[NUMBER_LENGTH] , *position = buffer + NUMBER_LENGTH;
+	unsigned long magnitude = value < 0 ? 0UL - ( unsigned long ) value : ( unsigned long ) value;
+	int length;
+	while( 100 <= magnitude ){
+		position -= 2;
+		memcpy( position , digitPairs + ( magnitude % 100 ) * 2 , 2 );
+		magnitude /= 100;
+	}
+	if( 10 <= magnitude ){
+		position -= 2;
+		memcpy( position , digitPairs + magnitude * 2 , 2 );
+	}
+	else{
+		*--position = ( char ) ( '0' + magnitude );
+	}
+	if( value < 0 ){
+		*--position = '-';
+	}
+	length = ( int ) ( buffer + NUMBER_LENGTH - position );
+	memcpy( destination , position , length );
+	return length;
+}
+
+bool parseNumber( const char *text , long *value ){
+	unsigned long magnitude = 0 , limit , digit;
+	bool negative = false , overflow = false , found = false;
+	while( isBlank( *text ) ){
+		text++;
+	}
+	if( *text == '-' || *text == '+' ){
+		negative = *text++ == '-';
+	}
+	limit = negative ? ( unsigned long ) LONG_MAX + 1 : ( unsigned long ) LONG_MAX;
+	for( ; '0' <= *text && *text <= '9' ; text++ ){
+		found = true;
+		digit = ( unsigned long ) ( *text - '0' );
+		if( ( limit - digit ) / 10 < magnitude ){
+			overflow = true;
+			magnitude = limit;
+		}
+		else{
+			magnitude = magnitude * 10 + digit;
+		}
+	}
+	*value = negative ? ( long ) ( 0UL - magnitude ) : ( long ) magnitude;
+	while( isBlank( *text ) ){
+		text++;
+	}
+	return found && ! overflow && *text == '\0';
+}
+
+static bool isBlank( char character ){
+	return character == ' ' || ( '\t' <= character && character <= '\r' );
+}
@@ -0,0 +1,228 @@
+//
+//  perf.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#define _GNU_SOURCE
+#if defined( __linux__ )
+	#include <errno.h>
+	#include <stdint.h>
+	#include <unistd.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <linux/perf_event.h>
+#endif
+#include "whitespace.h"
+
+/**
+ * 計測するハードウェアカウンタの数
+ */
+#define PERF_COUNTER_COUNT 7
+
+/**
+ * 命令を実行した CPU のサイクル数を数えるカウンタ
+ */
+#define PERF_CYCLES 0
+
+/**
+ * CPU が実行した命令数を数えるカウンタ
+ */
+#define PERF_INSTRUCTIONS 1
+
+/**
+ * 計測するハードウェアカウンタの名前
+ */
+static const char *names[PERF_COUNTER_COUNT] = {
+	"cycles" ,
+	"instructions" ,
+	"branches" ,
+	"branch-misses" ,
+	"cache-misses" ,
+	"dTLB-load-misses" ,
+	"iTLB-load-misses"
+};
+
+/**
+ * ハードウェアカウンタの記述子 開けなかったカウンタは -1
+ */
+static int descriptors[PERF_COUNTER_COUNT] = { -1 , -1 , -1 , -1 , -1 , -1 , -1 };
+
+/**
+ * 読み取ったハードウェアカウンタの値 計測できなかったカウンタは -1
+ */
+static long long values[PERF_COUNTER_COUNT];
+
+/**
+ * 計測しながら実行した命令数
+ */
+static long executed = 0;
+
+/**
+ * ハードウェアカウンタの計測を止めて値を読み取る
+ * 他のカウンタと交代で計測した場合は、計測していた時間の割合で補正する
+ */
+static void readCounters( void );
+
+
+
+#if defined( __linux__ )
+
+void openCounters( void ){
+	static const struct{
+		uint32_t type;
+		uint64_t config;
+	} kinds[PERF_COUNTER_COUNT] = {
+		{ PERF_TYPE_HARDWARE , PERF_COUNT_HW_CPU_CYCLES } ,
+		{ PERF_TYPE_HARDWARE , PERF_COUNT_HW_INSTRUCTIONS } ,
+		{ PERF_TYPE_HARDWARE , PERF_COUNT_HW_BRANCH_INSTRUCTIONS } ,
+		{ PERF_TYPE_HARDWARE , PERF_COUNT_HW_BRANCH_MISSES } ,
+		{ PERF_TYPE_HARDWARE , PERF_COUNT_HW_CACHE_MISSES } ,
+		{ PERF_TYPE_HW_CACHE , PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 } ,
+		{ PERF_TYPE_HW_CACHE , PERF_COUNT_HW_CACHE_ITLB | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 }
+	};
+	struct perf_event_attr attribute;
+	int index , opened = 0 , reason = 0;
+	for( index = 0 ; index < PERF_COUNTER_COUNT ; index++ ){
+		memset( &attribute , 0 , sizeof( attribute ) );
+		attribute.size = sizeof( attribute );
+		attribute.type = kinds[index].type;
+		attribute.config = kinds[index].config;
+		attribute.disabled = 1;
+		// 権限の無いコンテナでも開けるよう、ユーザー空間だけを計測する
+		attribute.exclude_kernel = 1;
+		attribute.exclude_hv = 1;
+		attribute.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		if( ( descriptors[index] = syscall( SYS_perf_event_open , &attribute , 0 , -1 , -1 , 0 ) ) < 0 ){
+			reason = errno;
+			descriptors[index] = -1;
+			continue;
+		}
+		opened++;
+	}
+	if( opened == 0 ){
+		fprintf( stderr , "perf: counters unavailable ( %s )\n" , strerror( reason ) );
+	}
+	return;
+}
+
+void startCounters( void ){
+	int index;
+	for( index = 0 ; index < PERF_COUNTER_COUNT ; index++ ){
+		if( 0 <= descriptors[index] ){
+			ioctl( descriptors[index] , PERF_EVENT_IOC_RESET , 0 );
+			ioctl( descriptors[index] , PERF_EVENT_IOC_ENABLE , 0 );
+		}
+	}
+	return;
+}
+
+void closeCounters( void ){
+	int index;
+	for( index = 0 ; index < PERF_COUNTER_COUNT ; index++ ){
+		if( 0 <= descriptors[index] ){
+			close( descriptors[index] );
+			descriptors[index] = -1;
+		}
+	}
+	return;
+}
+
+static void readCounters( void ){
+	uint64_t data[3];
+	int index;
+	for( index = 0 ; index < PERF_COUNTER_COUNT ; index++ ){
+		values[index] = -1;
+		if( descriptors[index] < 0 ){
+			continue;
+		}
+		ioctl( descriptors[index] , PERF_EVENT_IOC_DISABLE , 0 );
+		if( read( descriptors[index] , data , sizeof( data ) ) != sizeof( data ) || data[2] == 0 ){
+			continue;
+		}
+		values[index] = data[2] < data[1] ? ( long long ) ( ( double ) data[0] * data[1] / data[2] ) : ( long long ) data[0];
+	}
+	return;
+}
+
+#else
+
+void openCounters( void ){
+	fputs( "perf: counters unavailable ( not supported on this platform )\n" , stderr );
+	return;
+}
+
+void startCounters( void ){
+	return;
+}
+
+void closeCounters( void ){
+	return;
+}
+
+static void readCounters( void ){
+	int index;
+	for( index = 0 ; index < PERF_COUNTER_COUNT ; index++ ){
+		values[index] = -1;
+	}
+	return;
+}
+
+#endif
+
+void reportCounters( const char *phase , long count , FILE *output ){
+	int index , available = 0;
+	readCounters();
+	for( index = 0 ; index < PERF_COUNTER_COUNT ; index++ ){
+		if( 0 <= values[index] ){
+			available++;
+		}
+	}
+	if( available == 0 ){
+		return;
+	}
+	if( 0 < count ){
+		fprintf( output , "perf: %s: %ld instructions\n" , phase , count );
+	}
+	for( index = 0 ; index < PERF_COUNTER_COUNT ; index++ ){
+		fprintf( output , "perf: %s: %-18s" , phase , names[index] );
+		if( values[index] < 0 ){
+			fprintf( output , "%15s\n" , "not counted" );
+		}
+		else if( 0 < count ){
+			fprintf( output , "%15lld %10.3f / instruction\n" , values[index] , ( double ) values[index] / count );
+		}
+		else{
+			fprintf( output , "%15lld\n" , values[index] );
+		}
+	}
+	if( 0 < values[PERF_CYCLES] && 0 <= values[PERF_INSTRUCTIONS] ){
+		fprintf( output , "perf: %s: %-18s%15.3f\n" , phase , "IPC" , ( double ) values[PERF_INSTRUCTIONS] / values[PERF_CYCLES] );
+	}
+	return;
+}
+
+void executeCounted( Instruction *instruction ){
+	Machine *machine = getMachine();
+	executed = 0;
+	machine->current = instruction;
+	while( true ){
+		while( machine->current != NULL ){
+			executed++;
+			if( baseProcess( machine->current ) ){
+				return;
+			}
+		}
+		if( machine->callPointer == 0 ){
+			break;
+		}
+		machine->current = machine->calls[--machine->callPointer];
+	}
+	return;
+}
+
+long getExecutedCount( void ){
+	return executed;
+}
@@ -6,8 +6,52 @@
 //  Copyright (c) 2015年 kuroneko. All rights reserved.
 //
 
+#include <stdint.h>
+#if defined( __SSE2__ )
+	#include <emmintrin.h>
+#endif
 #include "whitespace.h"
-#include "hash.h"
+
+/**
+ * 末尾位置の判定で辿る命令数の上限
+ */
+#define TAIL_SEARCH_LIMIT 64
+
+/**
+ * 無条件ジャンプの連鎖を畳み込む際に辿る無条件ジャンプの数の上限
+ */
+#define THREAD_SEARCH_LIMIT 64
+
+/**
+ * 数値とラベルの解析で一度に調べる文字数
+ */
+#if defined( __SSE2__ )
+	#define LITERAL_CHUNK 16
+#else
+	#define LITERAL_CHUNK 8
+#endif
+
+/**
+ * LITERAL_CHUNK 文字分のビットが立った値
+ */
+#define LITERAL_MASK ( ( 1U << LITERAL_CHUNK ) - 1 )
+
+/**
+ * 命令とラベルを確保する領域の1ブロックのサイズ
+ * ブロックはこの大きさの境界に揃えて確保し、命令のアドレスから所属するブロックを求めるため2の累乗にする
+ */
+#define ARENA_CHUNK_SIZE ( 256 * 1024 )
+
+/**
+ * ラベルの対応表の最初の大きさ
+ * 登録したラベルの数が大きさを超えると2倍にする
+ */
+#define LABEL_TABLE_SIZE 256
+
+/**
+ * 領域から切り出す際の境界
+ */
+#define ARENA_ALIGNMENT 16
 
 /**
  * 読み込まれたプログラムのコメントを除いたもの
@@ -25,9 +69,93 @@ static int length = 0;
 static size_t allocation = 0;
 
 /**
- * ラベルのハッシュマップ
+ * 遅延読み込みで解析している場合に true
+ * ラベル定義の対応は事前の走査で登録済みのため、解析時には登録しない
+ */
+static bool lazy = false;
+
+/**
+ * 遅延読み込みで解析する範囲の終わりのプログラムの位置
+ * 事前の走査で解析できなかった命令以降はプログラムに含めない
+ */
+static int decodeLimit = 0;
+
+/**
+ * 遅延読み込みでラベル定義の位置毎に作った未解析の命令
+ * プログラムの位置の順に並ぶ
+ */
+static Instruction **labelBlocks = NULL;
+
+/**
+ * ラベル定義の位置毎に作った未解析の命令のプログラムの位置
+ */
+static int *labelOffsets = NULL;
+
+/**
+ * ラベル定義の位置毎に作った未解析の命令の数
  */
-static HashMap *labelMap = NULL;
+static int labelBlockCount = 0;
+
+/**
+ * 命令とラベルを確保する領域の1ブロック
+ * ブロックの先頭に置き、続く領域から切り出す
+ */
+struct chunk{
+	struct chunk *next;		// 前に確保したブロック
+	struct arena *arena;	// ブロックを確保した命令セットの領域
+	size_t used;			// 使用済みのバイト数
+	size_t size;			// 切り出せるバイト数
+	char *data;				// 切り出す領域
+} typedef Chunk;
+
+/**
+ * ラベルと命令の対応
+ */
+struct label{
+	struct label *next;			// 対応表の同じ位置の次の対応
+	char *name;					// ラベル
+	Instruction *instruction;	// ラベルの命令
+} typedef Label;
+
+/**
+ * 1つの命令セットの命令とラベルを確保する領域
+ * ラベルの対応表も同じ領域に確保し、命令セットと共に開放する
+ */
+struct arena{
+	struct arena *next;		// 前に作成した命令セットの領域
+	struct arena *previous;	// 後に作成した命令セットの領域
+	Chunk *chunks;			// 先頭から順に切り出すブロックの一覧
+	Label **labels;			// ラベルの対応表
+	int labelSize;			// ラベルの対応表の大きさ
+	int labelCount;			// 登録したラベルの数
+} typedef Arena;
+
+/**
+ * 命令セット毎の領域の一覧
+ * 先頭が作成中の命令セットの領域で、命令セットの開放時にその命令セットの領域だけをまとめて開放する
+ */
+static Arena *arenas = NULL;
+
+/**
+ * 作成中の命令セットの領域
+ * 命令セットの作成に失敗した場合に開放する
+ */
+static Arena *building = NULL;
+
+/**
+ * 命令セットの作成に失敗した場合の戻り先
+ * 設定していない場合はプログラムを終了する
+ */
+static jmp_buf *rescue = NULL;
+
+/**
+ * 領域から指定したバイト数を切り出す
+ * @param size
+ *	切り出すバイト数
+ * @return
+ *	切り出した領域
+ */
+static void *allocate( size_t size );
 
 /**
  * 命令の構造体に命令・コマンド・パラメータを設定する
@@ -150,8 +278,59 @@ static char *setNumber( char *position , Instruction *instruction );
  */
 static char *setLabel( char *position , Instruction *instruction );
 
+/**
+ * 数値やラベルのパラメータを解析せずに読み飛ばす
+ * @param position
+ *	パラメータの位置
+ * @return
+ *	パラメータの次の位置 パラメータが不正な場合は NULL
+ */
+static char *skipLiteral( char *position );
+
+/**
+ * 未解析の命令を作成する
+ * @param offset
+ *	解析を始めるプログラムの位置
+ * @param index
+ *	最初の命令の番号
+ * @return
+ *	未解析の命令
+ */
+static Instruction *createBlock( int offset , int index );
+
+/**
+ * ラベル定義の位置に作った未解析の命令を探す
+ * @param offset
+ *	プログラムの位置
+ * @return
+ *	指定した位置の命令 ラベル定義の位置でない場合は NULL
+ */
+static Instruction *findBlock( int offset );
+
+/**
+ * ソースの指定した位置から LITERAL_CHUNK 文字をまとめて調べ、タブと空白が続く文字数を求める
+ * プログラムの終端の後ろにも LITERAL_CHUNK 文字分の領域があるため、まとめて読み込める
+ * @param position
+ *	調べる位置
+ * @param bits
+ *	続いたタブと空白をタブを 1 空白を 0 として先頭の文字から上位ビットに並べた値が格納される
+ * @return
+ *	タブと空白が続く文字数 LITERAL_CHUNK の場合は次の文字以降も続いている可能性がある
+ */
+static int scanLiteral( const char *position , unsigned int *bits );
+
+/**
+ * LITERAL_CHUNK ビットの並びを反転する
+ * @param value
+ *	反転する値
+ * @return
+ *	反転した値
+ */
+static unsigned int reverseBits( unsigned int value );
+
 /**
  * ラベルと命令をマッピングする
+ * 同じラベルを登録した場合は後から登録した命令に置き換える
  * @param label
  *	マッピングする際にキーとなるラベル
  * @param instruction
@@ -159,6 +338,24 @@ static char *setLabel( char *position , Instruction *instruction );
  */
 static void addLabel( char *label , Instruction *instruction );
 
+/**
+ * ラベルの対応表の位置を求める
+ * @param label
+ *	ラベル
+ * @param size
+ *	対応表の大きさ
+ * @return
+ *	対応表の位置
+ */
+static int getLabelIndex( const char *label , int size );
+
+/**
+ * 作成中の命令セットのラベルの対応表を指定した大きさで作り直す
+ * @param size
+ *	対応表の大きさ
+ */
+static void resizeLabels( int size );
+
 /**
  * ラベルを参照している命令との関係を設定する
  * @param instruction
@@ -166,6 +363,64 @@ static void addLabel( char *label , Instruction *instruction );
  */
 static void setRelation( Instruction *instruction );
 
+/**
+ * 命令がサブルーチン呼び出しの直後から副作用無しにサブルーチン終了へ到達するかを判定する
+ * ラベル定義と無条件ジャンプのみを辿る
+ * @param instruction
+ *	サブルーチン呼び出しの次の命令
+ * @return
+ *	末尾位置の場合に true を返す
+ */
+static bool isTailPosition( Instruction *instruction );
+
+/**
+ * ジャンプした場合に最終的に実行する命令を取得する
+ * ラベル定義は読み飛ばし、無条件ジャンプはジャンプ先を辿る
+ * @param instruction
+ *	ジャンプ先の命令
+ * @return
+ *	最終的に実行する命令
+ */
+static Instruction *getDestination( Instruction *instruction );
+
+/**
+ * ラベル定義を読み飛ばした命令を取得する
+ * プログラムの末尾のラベル定義は実行する命令が無いためそのまま残す
+ * @param instruction
+ *	命令
+ * @return
+ *	ラベル定義以外の命令
+ */
+static Instruction *skipLabel( Instruction *instruction );
+
+/**
+ * 新しく作成する命令セットの領域を用意する
+ */
+static void openArena( void );
+
+/**
+ * 命令を確保した領域を取得する
+ * 命令を切り出したブロックの先頭から求める
+ * @param instruction
+ *	命令
+ * @return
+ *	命令を確保した領域
+ */
+static Arena *findArena( Instruction *instruction );
+
+/**
+ * 命令セットの命令とラベルを確保した領域をまとめて開放する
+ * @param arena
+ *	開放する領域
+ */
+static void releaseArena( Arena *arena );
+
+/**
+ * 命令セットの作成に失敗したことを通知する
+ * 戻り先が設定されている場合は作成中の命令セットを破棄して戻り先に戻り、そうでなければプログラムを終了する
+ */
+static void fail( void );
+
 /**
  * エラーメッセージを表示する
  * @param message
@@ -175,28 +430,47 @@ static void error( char *message );
 
 
 
+void setRescue( jmp_buf *escape ){
+	rescue = escape;
+	return;
+}
+
 void programClear( void ){
 	if( program != NULL ){
 		free( program );
+		program = NULL;
 	}
 	allocation = 0;
 	length = 0;
+	free( labelBlocks );
+	free( labelOffsets );
+	labelBlocks = NULL;
+	labelOffsets = NULL;
+	labelBlockCount = 0;
+	decodeLimit = 0;
+	lazy = false;
+	building = NULL;
+	// 対応表の領域は命令セットと共に開放する
+	if( arenas != NULL ){
+		arenas->labels = NULL;
+		arenas->labelSize = arenas->labelCount = 0;
+	}
 	return;
 }
 
 void setProgram( char *source , size_t size ){
 	if( program == NULL ){
-		allocation = size;
+		allocation = size + 1 + LITERAL_CHUNK;
 		if( ( program = ( char * ) malloc( sizeof( char ) * allocation ) ) == NULL ){
 			error( "out of memory error" );
-			exit( EXIT_FAILURE );
+			fail();
 		}
 	}
-	else if( allocation < length + size ){
-		allocation += size;
+	else if( allocation < length + size + 1 + LITERAL_CHUNK ){
+		allocation = ( length + size + 1 ) * 2 + LITERAL_CHUNK;
 		if( ( program = ( char * ) realloc( program , sizeof( char ) * allocation ) ) == NULL ){
 			error( "out of memory error" );
-			exit( EXIT_FAILURE );
+			fail();
 		}
 	}
 	char current;
@@ -213,7 +487,7 @@ char *getOptimizationProgram( size_t *size ){
 	char *copyProgram;
 	if( ( copyProgram= ( char * ) malloc( sizeof( char ) * allocation ) ) == NULL ){
 		error( "out of memory error" );
-		exit( EXIT_FAILURE );
+		fail();
 	}
 	*size = length;
 	memcpy( copyProgram , program , allocation );
@@ -223,20 +497,23 @@ char *getOptimizationProgram( size_t *size ){
 Instruction *getInstruction( void ){
 	if( program == NULL ){
 		error( "do not have program" );
-		exit( EXIT_FAILURE );
+		fail();
 	}
 	char *position = program;
 	Instruction *instruction = NULL , *previous = NULL , *start = NULL;
+	int index = 0;
+	openArena();
 	while( *position != '\0' ){
-		instruction = ( Instruction * ) malloc( sizeof( Instruction ) );
+		instruction = createInstruction();
 		if( start == NULL ){
 			start = instruction;
 		}
 		position = setInstruction( position , instruction );
 		if( position == NULL ){
-			free( instruction );
+			destroyInstruction( instruction );
 			break;
 		}
+		instruction->index = index++;
 		if( previous != NULL ){
 			previous->next = instruction;
 		}
@@ -246,35 +523,154 @@ Instruction *getInstruction( void ){
 	return start;
 }
 
+Instruction *getLazyInstruction( void ){
+	if( program == NULL ){
+		error( "do not have program" );
+		fail();
+	}
+	Instruction scanned;
+	char *position = program , *start;
+	int index = 0 , capacity = 0;
+	lazy = true;
+	openArena();
+	// 命令の区切りを辿るだけで命令は作らず、ラベル定義の位置にだけ未解析の命令を置く
+	while( *position != '\0' ){
+		start = position;
+		memset( &scanned , 0 , sizeof( Instruction ) );
+		if( ( position = setIMP( position , &scanned ) ) == NULL || ( position = setCommand( position , &scanned ) ) == NULL ){
+			break;
+		}
+		if( scanned.imp == FLOW_CONTROL && scanned.c_control == LABEL_DEFINE ){
+			if( ( position = setLabel( position , &scanned ) ) == NULL ){
+				break;
+			}
+			if( capacity <= labelBlockCount ){
+				capacity = capacity == 0 ? BUFFER_SIZE : capacity * 2;
+				if( ( labelBlocks = ( Instruction ** ) realloc( labelBlocks , sizeof( Instruction * ) * capacity ) ) == NULL
+				|| ( labelOffsets = ( int * ) realloc( labelOffsets , sizeof( int ) * capacity ) ) == NULL ){
+					error( "out of memory error" );
+					fail();
+				}
+			}
+			labelOffsets[labelBlockCount] = ( int ) ( start - program );
+			labelBlocks[labelBlockCount] = createBlock( labelOffsets[labelBlockCount] , index );
+			addLabel( scanned.p_label , labelBlocks[labelBlockCount++] );
+		}
+		else if( scanned.imp == STACK && scanned.c_stack == PUSH_NUMBER ){
+			// 値は実行する時に解析するため、符号があることだけを確かめて読み飛ばす
+			if( ( *position != '\t' && *position != ' ' ) || ( position = skipLiteral( position ) ) == NULL ){
+				error( "illegal number parameter." );
+				break;
+			}
+		}
+		else if( scanned.imp == FLOW_CONTROL && scanned.c_control != END_ROUTINE && scanned.c_control != FINISH ){
+			if( ( position = skipLiteral( position ) ) == NULL ){
+				error( "illegal label parameter" );
+				break;
+			}
+		}
+		index++;
+		decodeLimit = ( int ) ( position - program );
+	}
+	if( decodeLimit == 0 ){
+		return NULL;
+	}
+	return labelBlockCount != 0 && labelOffsets[0] == 0 ? labelBlocks[0] : createBlock( 0 , 0 );
+}
+
+Instruction *decodeBlock( Instruction *instruction ){
+	Instruction *current = instruction , *block;
+	char *position = program + instruction->p_value;
+	int index = instruction->index;
+	if( decodeLimit <= instruction->p_value ){
+		return NULL;
+	}
+	// 未解析の命令自体を最初の命令にするため、この命令への参照は張り替えずに済む
+	while( true ){
+		position = setInstruction( position , current );
+		current->index = index++;
+		if( current->imp == FLOW_CONTROL && current->c_control != LABEL_DEFINE && current->p_label != NULL ){
+			current->jump = getInstructionAtLabel( current->p_label );
+		}
+		if( decodeLimit <= position - program ){
+			break;
+		}
+		if( ( block = findBlock( ( int ) ( position - program ) ) ) != NULL ){
+			current->next = block;
+			break;
+		}
+		if( current->imp == FLOW_CONTROL && current->c_control != LABEL_DEFINE ){
+			current->next = createBlock( ( int ) ( position - program ) , index );
+			break;
+		}
+		current = current->next = createInstruction();
+	}
+	return instruction;
+}
+
+Instruction *linkInstruction( Instruction *instruction ){
+	Instruction *position , *label = NULL , *start = skipLabel( instruction );
+	for( position = instruction ; position != NULL ; position = position->next ){
+		if( position->imp == FLOW_CONTROL && position->c_control == LABEL_DEFINE ){
+			if( label == NULL ){
+				label = position;
+			}
+			continue;
+		}
+		position->labels = label;
+		label = NULL;
+		if( position->imp == FLOW_CONTROL && position->jump != NULL ){
+			position->jump = getDestination( position->jump );
+		}
+	}
+	// ジャンプ先を全て張り替えてから並びを繋ぎ替える
+	for( position = start ; position != NULL ; position = position->next ){
+		position->next = skipLabel( position->next );
+	}
+	return start;
+}
+
 void freeInstruction( Instruction *instruction ){
 	if( instruction == NULL ){
 		error( "do not have instruction" );
-		exit( EXIT_FAILURE );
-	}
-	Instruction *next = instruction;
-	do{
-		instruction = next;
-		next = instruction->next;
-		instruction->next = NULL;
-		instruction->jump = NULL;
-		if( instruction->imp == FLOW_CONTROL && instruction->p_label != NULL ){
-			free( instruction->p_label );
-			instruction->p_label = NULL;
-		}
-		free( instruction );
-	} while( next != NULL );
-	if( labelMap != NULL ){
-		finishHashMap( labelMap );
-		labelMap = NULL;
+		fail();
 	}
+	releaseArena( findArena( instruction ) );
+	return;
+}
+
+Instruction *createInstruction( void ){
+	Instruction *instruction = ( Instruction * ) allocate( sizeof( Instruction ) );
+	memset( instruction , 0 , sizeof( Instruction ) );
+	return instruction;
+}
+
+void *createArea( size_t size ){
+	void *area = allocate( size );
+	memset( area , 0 , size );
+	return area;
+}
+
+void destroyInstruction( Instruction *instruction ){
+	instruction->next = NULL;
+	instruction->jump = NULL;
 	return;
 }
 
 Instruction *getInstructionAtLabel( char *label ){
-	Instruction *instruction = getHashValue( labelMap , label );
+	Instruction *instruction = NULL;
+	Label *entry;
+	if( arenas != NULL && arenas->labels != NULL ){
+		for( entry = arenas->labels[getLabelIndex( label , arenas->labelSize )] ; entry != NULL ; entry = entry->next ){
+			if( strcmp( entry->name , label ) == 0 ){
+				instruction = entry->instruction;
+				break;
+			}
+		}
+	}
 	if( instruction == NULL ){
 		error( "do not have instruction at label" );
-		exit( EXIT_FAILURE );
+		fail();
 	}
 	return instruction;
 }
@@ -573,7 +969,7 @@ static char *setParameter( char *position , Instruction *instruction ){
 	else if( instruction->imp == FLOW_CONTROL ){
 		if( instruction->c_control != END_ROUTINE && instruction->c_control != FINISH ){
 			position = setLabel( position , instruction );
-			if( instruction->c_control == LABEL_DEFINE ){
+			if( instruction->c_control == LABEL_DEFINE && ! lazy ){
 				addLabel( instruction->p_label , instruction );
 			}
 		}
@@ -590,98 +986,183 @@ static char *setNumber( char *position , Instruction *instruction ){
 		error( "illegal number parameter. do not have sign" );
 		return NULL;
 	}
-	long number = 0;
-	while( true ){
-		switch( *position++ ){
-			case '\t':
-				number <<= 1;
-				number++;
-				break;
+	unsigned long number = 0;
+	unsigned int bits;
+	int count;
+	do{
+		count = scanLiteral( position , &bits );
+		// 上位に溢れたビットは捨てる
+		number = number << count | bits;
+		position += count;
+	} while( count == LITERAL_CHUNK );
+	if( *position++ != '\n' ){
+		error( "illegal number parameter." );
+		return NULL;
+	}
 
-			case ' ':
-				number <<= 1;
-				break;
+	number &= 0x7FFFFFFFFFFFFFFF;
+	instruction->p_value = minus ? -( long ) number : ( long ) number;
+	return position;
+}
 
-			case '\n':
-				goto END_SET_NUMBER;
+static char *setLabel( char *position , Instruction *instruction ){
+	char *label;
+	unsigned int bits;
+	int count , remain;
+	size_t total = 0;
+	// 先に文字数を数えてラベルの領域を確保する
+	do{
+		count = scanLiteral( position + total , &bits );
+		total += count;
+	} while( count == LITERAL_CHUNK );
+	if( position[total] != '\n' ){
+		error( "illegal label parameter" );
+		return NULL;
+	}
 
-			default:
-				error( "illegal number parameter." );
-				return NULL;
+	// 8文字を1バイトとして先頭から詰め、最後の端数は下位ビットに詰める
+	label = instruction->p_label = ( char * ) allocate( sizeof( char ) * ( ( total >> 3 ) + 2 ) );
+	do{
+		count = scanLiteral( position , &bits );
+		position += count;
+		for( remain = count ; 8 <= remain ; remain -= 8 ){
+			*label++ = ( char ) ( bits >> ( remain - 8 ) );
 		}
+		if( 0 < remain ){
+			*label++ = ( char ) ( bits & ( ( 1U << remain ) - 1 ) );
+		}
+	} while( count == LITERAL_CHUNK );
+	if( ( total & 7 ) == 0 ){
+		*label++ = '\0';
 	}
+	*label = '\0';
+	return position + 1;
+}
 
-END_SET_NUMBER:
-	number &= 0x7FFFFFFFFFFFFFFF;
-	if( minus ){
-		number *= -1;
+static char *skipLiteral( char *position ){
+	unsigned int bits;
+	int count;
+	do{
+		count = scanLiteral( position , &bits );
+		position += count;
+	} while( count == LITERAL_CHUNK );
+	if( *position++ != '\n' ){
+		return NULL;
 	}
-	instruction->p_value = number;
-	number &= 0xFF;
 	return position;
 }
 
-static char *setLabel( char *position , Instruction *instruction ){
-	char buffer[BUFFER_SIZE];
-	memset( buffer , 0 , BUFFER_SIZE );
-	int index = 0 , count = 0;
-	size_t size;
-	while( BUFFER_SIZE - index ){
-		index = count >> 3;
-		switch( *position++ ){
-			case '\t':
-				buffer[index] <<= 1;
-				buffer[index]++;
-				break;
+static Instruction *createBlock( int offset , int index ){
+	Instruction *block = createInstruction();
+	block->imp = FLOW_CONTROL;
+	block->c_control = LAZY_BLOCK;
+	block->p_value = offset;
+	block->index = index;
+	return block;
+}
 
-			case ' ':
-				buffer[index] <<= 1;
-				break;
+static Instruction *findBlock( int offset ){
+	int low = 0 , high = labelBlockCount , middle;
+	while( low < high ){
+		middle = ( low + high ) / 2;
+		if( labelOffsets[middle] < offset ){
+			low = middle + 1;
+		}
+		else{
+			high = middle;
+		}
+	}
+	return low < labelBlockCount && labelOffsets[low] == offset ? labelBlocks[low] : NULL;
+}
 
-			case '\n':
-				goto END_SET_LABEL;
+static int scanLiteral( const char *position , unsigned int *bits ){
+	unsigned int tabs , spaces , stop;
+	int count;
+#if defined( __SSE2__ )
+	__m128i data = _mm_loadu_si128( ( const __m128i * ) position );
+	tabs = ( unsigned int ) _mm_movemask_epi8( _mm_cmpeq_epi8( data , _mm_set1_epi8( '\t' ) ) );
+	spaces = ( unsigned int ) _mm_movemask_epi8( _mm_cmpeq_epi8( data , _mm_set1_epi8( ' ' ) ) );
+#else
+	const uint64_t low = 0x7F7F7F7F7F7F7F7FULL , gather = 0x0102040810204080ULL;
+	uint64_t word , match;
+	memcpy( &word , position , sizeof( word ) );
+	// 一致したバイトだけ最上位ビットを立て、各バイトの最上位ビットを集める
+	match = word ^ 0x0909090909090909ULL;
+	match = ~( ( ( match & low ) + low ) | match | low );
+	tabs = ( unsigned int ) ( ( match >> 7 ) * gather >> 56 );
+	match = word ^ 0x2020202020202020ULL;
+	match = ~( ( ( match & low ) + low ) | match | low );
+	spaces = ( unsigned int ) ( ( match >> 7 ) * gather >> 56 );
+#endif
+	stop = ~( tabs | spaces ) & LITERAL_MASK;
+	count = stop == 0 ? LITERAL_CHUNK : __builtin_ctz( stop );
+	*bits = count == 0 ? 0 : reverseBits( tabs ) >> ( LITERAL_CHUNK - count );
+	return count;
+}
 
-			default:
-				error( "illegal label parameter" );
-				return NULL;
+static unsigned int reverseBits( unsigned int value ){
+	value = ( ( value >> 1 ) & 0x5555 ) | ( ( value & 0x5555 ) << 1 );
+	value = ( ( value >> 2 ) & 0x3333 ) | ( ( value & 0x3333 ) << 2 );
+	value = ( ( value >> 4 ) & 0x0F0F ) | ( ( value & 0x0F0F ) << 4 );
+#if LITERAL_CHUNK == 16
+	value = ( ( value >> 8 ) & 0x00FF ) | ( ( value & 0x00FF ) << 8 );
+#endif
+	return value & LITERAL_MASK;
+}
+
+static void addLabel( char *label , Instruction *instruction ){
+	Label *entry , **head;
+	if( arenas == NULL || arenas->labels == NULL ){
+		resizeLabels( LABEL_TABLE_SIZE );
+	}
+	head = &arenas->labels[getLabelIndex( label , arenas->labelSize )];
+	for( entry = *head ; entry != NULL ; entry = entry->next ){
+		if( strcmp( entry->name , label ) == 0 ){
+			entry->instruction = instruction;
+			return;
 		}
-		count++;
 	}
-	error( "illegal label parameter: overflow." );
-	return NULL;
+	entry = ( Label * ) allocate( sizeof( Label ) );
+	entry->name = label;
+	entry->instruction = instruction;
+	entry->next = *head;
+	*head = entry;
+	if( arenas->labelSize < ++arenas->labelCount ){
+		resizeLabels( arenas->labelSize * 2 );
+	}
+	return;
+}
 
-END_SET_LABEL:
-	size = sizeof( char ) * ( ( count >> 3 ) + 2 );
-	if( ( instruction->p_label = ( char * ) malloc( size ) ) == NULL ){
-		error( "out of memory error" );
-		exit( EXIT_FAILURE );
+static int getLabelIndex( const char *label , int size ){
+	unsigned long value = 14695981039346656037UL;
+	while( *label != '\0' ){
+		value ^= ( unsigned char ) *label++;
+		value *= 1099511628211UL;
 	}
-	memcpy( instruction->p_label , buffer , size );
-	return position;
+	return ( int ) ( value % ( unsigned long ) size );
 }
 
-static void addLabel( char *label , Instruction *instruction ){
-	if( labelMap == NULL ){
-		labelMap = newHashMap( HASH_MAP_TYPE_VOID );
+static void resizeLabels( int size ){
+	// 古い対応表の領域は命令セットと共に開放する
+	Label **labels = ( Label ** ) createArea( sizeof( Label * ) * size ) , *entry , *next;
+	int index;
+	for( index = 0 ; index < arenas->labelSize ; index++ ){
+		for( entry = arenas->labels[index] ; entry != NULL ; entry = next ){
+			next = entry->next;
+			entry->next = labels[getLabelIndex( entry->name , size )];
+			labels[getLabelIndex( entry->name , size )] = entry;
+		}
 	}
-	putHashMapValue( labelMap , label , instruction , sizeof( Instruction * ) );
+	arenas->labels = labels;
+	arenas->labelSize = size;
 	return;
 }
 
 static void setRelation( Instruction *instruction ){
-	Instruction *stack[labelMap->aSize];
-	int count = 0;
-	while( instruction->next != NULL ){
-		if( instruction->imp == FLOW_CONTROL ){
-			switch( instruction->c_control ){
-				case LABEL_DEFINE:
-					stack[count++] = instruction;
-					break;
-
-				case END_ROUTINE:
-					stack[--count]->jump = instruction;
-					break;
-
+	Instruction *position;
+	for( position = instruction ; position != NULL ; position = position->next ){
+		if( position->imp == FLOW_CONTROL ){
+			switch( position->c_control ){
 				case CALL_ROUTINE:
 					// FALL THROUGH
 
@@ -692,18 +1173,175 @@ static void setRelation( Instruction *instruction ){
 					// FALL THROUGH
 
 				case MINUS_JUMP:
-					instruction->jump = getInstructionAtLabel( instruction->p_label );
+					position->jump = getInstructionAtLabel( position->p_label );
 					break;
 
 				default:
 					break;
 			}
 		}
-		instruction = instruction->next;
 	}
+	for( position = instruction ; position != NULL ; position = position->next ){
+		if( position->imp == FLOW_CONTROL && position->c_control == CALL_ROUTINE && isTailPosition( position->next ) ){
+			position->c_control = TAIL_CALL;
+		}
+	}
+	return;
+}
+
+static bool isTailPosition( Instruction *instruction ){
+	int count;
+	for( count = 0 ; count < TAIL_SEARCH_LIMIT ; count++ ){
+		if( instruction == NULL ){
+			return true;
+		}
+		if( instruction->imp != FLOW_CONTROL ){
+			return false;
+		}
+		switch( instruction->c_control ){
+			case LABEL_DEFINE:
+				instruction = instruction->next;
+				break;
+
+			case JUMP:
+				instruction = instruction->jump;
+				break;
+
+			case END_ROUTINE:
+				return true;
+
+			default:
+				return false;
+		}
+	}
+	return false;
+}
+
+static Instruction *getDestination( Instruction *instruction ){
+	int count;
+	instruction = skipLabel( instruction );
+	for( count = 0 ; count < THREAD_SEARCH_LIMIT ; count++ ){
+		if( instruction->imp != FLOW_CONTROL || instruction->c_control != JUMP || instruction->jump == NULL ){
+			break;
+		}
+		instruction = skipLabel( instruction->jump );
+	}
+	return instruction;
+}
+
+static Instruction *skipLabel( Instruction *instruction ){
+	Instruction *position = instruction;
+	while( position != NULL && position->imp == FLOW_CONTROL && position->c_control == LABEL_DEFINE ){
+		if( position->next == NULL ){
+			return instruction;
+		}
+		position = position->next;
+	}
+	return position;
+}
+
+static void *allocate( size_t size ){
+	size_t header = ( sizeof( Chunk ) + ARENA_ALIGNMENT - 1 ) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+	Chunk *chunk;
+	void *block;
+	if( arenas == NULL ){
+		openArena();
+	}
+	Chunk *current = arenas->chunks;
+	size = ( size + ARENA_ALIGNMENT - 1 ) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+	if( current == NULL || current->size - current->used < size ){
+		// 1ブロックに収まらない領域は境界に揃えずに確保し、切り出し中のブロックの後ろに繋ぐ
+		if( ARENA_CHUNK_SIZE - header < size ){
+			if( ( chunk = ( Chunk * ) malloc( header + size ) ) == NULL ){
+				error( "out of memory error" );
+				fail();
+			}
+			chunk->arena = arenas;
+			chunk->size = chunk->used = size;
+			chunk->data = ( char * ) chunk + header;
+			if( current == NULL ){
+				chunk->next = NULL;
+				arenas->chunks = chunk;
+			}
+			else{
+				chunk->next = current->next;
+				current->next = chunk;
+			}
+			return chunk->data;
+		}
+		if( posix_memalign( &block , ARENA_CHUNK_SIZE , ARENA_CHUNK_SIZE ) != 0 ){
+			error( "out of memory error" );
+			fail();
+		}
+		chunk = ( Chunk * ) block;
+		chunk->arena = arenas;
+		chunk->size = ARENA_CHUNK_SIZE - header;
+		chunk->used = 0;
+		chunk->data = ( char * ) chunk + header;
+		chunk->next = current;
+		current = arenas->chunks = chunk;
+	}
+	void *area = current->data + current->used;
+	current->used += size;
+	return area;
+}
+
+static void openArena( void ){
+	Arena *arena;
+	if( ( arena = ( Arena * ) malloc( sizeof( Arena ) ) ) == NULL ){
+		error( "out of memory error" );
+		fail();
+	}
+	arena->chunks = NULL;
+	arena->labels = NULL;
+	arena->labelSize = arena->labelCount = 0;
+	arena->previous = NULL;
+	arena->next = arenas;
+	if( arenas != NULL ){
+		arenas->previous = arena;
+	}
+	arenas = building = arena;
+	return;
+}
+
+static Arena *findArena( Instruction *instruction ){
+	// 命令は1ブロックに収まるため、境界に揃えたブロックの先頭にある
+	return ( ( Chunk * ) ( ( uintptr_t ) instruction & ~( uintptr_t ) ( ARENA_CHUNK_SIZE - 1 ) ) )->arena;
+}
+
+static void releaseArena( Arena *arena ){
+	Chunk *next;
+	while( arena->chunks != NULL ){
+		next = arena->chunks->next;
+		free( arena->chunks );
+		arena->chunks = next;
+	}
+	if( arena->previous != NULL ){
+		arena->previous->next = arena->next;
+	}
+	else{
+		arenas = arena->next;
+	}
+	if( arena->next != NULL ){
+		arena->next->previous = arena->previous;
+	}
+	if( arena == building ){
+		building = NULL;
+	}
+	free( arena );
 	return;
 }
 
+static void fail( void ){
+	if( rescue == NULL ){
+		exit( EXIT_FAILURE );
+	}
+	if( building != NULL ){
+		releaseArena( building );
+	}
+	longjmp( *rescue , 1 );
+}
+
 static void error( char *message ){
 	fputs( message , stderr );
 	fputc( '\n' , stderr );
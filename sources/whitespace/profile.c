@@ -0,0 +1,273 @@
+//
+//  profile.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include "whitespace.h"
+
+/**
+ * サブルーチンの外で実行した命令を数える呼び出し経路の根の名前
+ */
+#define PROFILE_ROOT_NAME "[main]"
+
+/**
+ * 呼び出し経路の木の節
+ * 根からこの節までの経路が、実行中のサブルーチン呼び出しの並びを表す
+ */
+struct{
+	Instruction *routine;	// 呼び出したサブルーチンの最初の命令 根の場合は NULL
+	const char *label;		// 呼び出したサブルーチンのラベル
+	int parent;				// 呼び出し元の節 根の場合は -1
+	int child;				// 最初の呼び出し先の節 無い場合は -1
+	int sibling;			// 呼び出し元が同じ次の節 無い場合は -1
+	long count;				// この経路で実行した命令数
+} typedef ProfileNode;
+
+/**
+ * 呼び出し経路の木の節
+ * 0 番目が根になる
+ */
+static ProfileNode *nodes = NULL;
+
+/**
+ * 呼び出し経路の木の節の数
+ */
+static int nodeCount = 0;
+
+/**
+ * 呼び出し経路の木の節の確保数
+ */
+static int nodeAllocation = 0;
+
+/**
+ * 書き出し中の根からの経路
+ */
+static int *trail = NULL;
+
+/**
+ * 呼び出しの深さ毎の呼び出し元の節
+ * サブルーチンから戻る時にこの節に戻る
+ */
+static int *frames = NULL;
+
+/**
+ * 呼び出し元の節の確保数
+ */
+static int frameAllocation = 0;
+
+/**
+ * 呼び出し元の節を記録する
+ * @param depth
+ *	呼び出す前の呼び出しの深さ
+ * @param node
+ *	呼び出し元の節
+ */
+static void save( int depth , int node );
+
+/**
+ * 呼び出し経路の木の節を探し、無ければ追加する
+ * 呼び出し元と同じサブルーチンを呼び出す直接の再帰は、呼び出し元の節にまとめる
+ * @param parent
+ *	呼び出し元の節
+ * @param instruction
+ *	サブルーチン呼び出しの命令
+ * @return
+ *	呼び出し先の節
+ */
+static int enter( int parent , Instruction *instruction );
+
+/**
+ * 呼び出し経路の木の節を追加する
+ * @param parent
+ *	呼び出し元の節
+ * @param routine
+ *	呼び出したサブルーチンの最初の命令
+ * @param label
+ *	呼び出したサブルーチンのラベル
+ * @return
+ *	追加した節
+ */
+static int createNode( int parent , Instruction *routine , const char *label );
+
+/**
+ * 1つの経路を畳み込んだ呼び出し経路として書き出す
+ * @param node
+ *	経路の末端の節
+ * @param output
+ *	書き込み先
+ */
+static void writePath( int node , FILE *output );
+
+/**
+ * 記録した呼び出し経路の木を破棄する
+ */
+static void clear( void );
+
+/**
+ * エラーメッセージを表示してプログラムを終了する
+ * @param message
+ *	表示するメッセージ
+ */
+static void error( char *message );
+
+
+
+void executeProfile( Instruction *instruction ){
+	Machine *machine = getMachine();
+	Instruction *current;
+	int node , depth;
+	clear();
+	node = createNode( -1 , NULL , PROFILE_ROOT_NAME );
+	machine->current = instruction;
+	while( true ){
+		while( ( current = machine->current ) != NULL ){
+			nodes[node].count++;
+			depth = machine->callPointer;
+			if( baseProcess( current ) ){
+				return;
+			}
+			if( current->imp != FLOW_CONTROL ){
+				continue;
+			}
+			switch( current->c_control ){
+				case CALL_ROUTINE:
+					save( depth , node );
+					node = enter( node , current );
+					break;
+
+				case TAIL_CALL:
+					// サブルーチン内では実行中のサブルーチンを呼び出し先に置き換える
+					if( depth == 0 ){
+						save( depth , node );
+						node = enter( node , current );
+					}
+					else{
+						node = enter( frames[depth - 1] , current );
+					}
+					break;
+
+				case END_ROUTINE:
+					if( 0 < depth ){
+						node = frames[depth - 1];
+					}
+					break;
+
+				default:
+					break;
+			}
+		}
+		if( machine->callPointer == 0 ){
+			break;
+		}
+		machine->current = machine->calls[--machine->callPointer];
+		node = frames[machine->callPointer];
+	}
+	return;
+}
+
+void writeProfile( const char *path ){
+	FILE *output;
+	int node;
+	if( ( output = fopen( path , "w" ) ) == NULL ){
+		fputs( "profile: open file error\n" , stderr );
+		clear();
+		return;
+	}
+	for( node = 0 ; node < nodeCount ; node++ ){
+		if( 0 < nodes[node].count ){
+			writePath( node , output );
+		}
+	}
+	fclose( output );
+	clear();
+	return;
+}
+
+static void save( int depth , int node ){
+	if( frameAllocation <= depth ){
+		frameAllocation = depth + STACK_ALLOCATION_SIZE;
+		if( ( frames = ( int * ) realloc( frames , sizeof( int ) * frameAllocation ) ) == NULL ){
+			error( "profile: out of memory error" );
+		}
+	}
+	frames[depth] = node;
+	return;
+}
+
+static int enter( int parent , Instruction *instruction ){
+	int node;
+	if( nodes[parent].routine == instruction->jump ){
+		return parent;
+	}
+	for( node = nodes[parent].child ; 0 <= node ; node = nodes[node].sibling ){
+		if( nodes[node].routine == instruction->jump ){
+			return node;
+		}
+	}
+	return createNode( parent , instruction->jump , instruction->p_label );
+}
+
+static int createNode( int parent , Instruction *routine , const char *label ){
+	ProfileNode *node;
+	if( nodeAllocation <= nodeCount ){
+		nodeAllocation += BUFFER_SIZE;
+		if( ( nodes = ( ProfileNode * ) realloc( nodes , sizeof( ProfileNode ) * nodeAllocation ) ) == NULL
+		|| ( trail = ( int * ) realloc( trail , sizeof( int ) * nodeAllocation ) ) == NULL ){
+			error( "profile: out of memory error" );
+		}
+	}
+	node = &nodes[nodeCount];
+	node->routine = routine;
+	node->label = label;
+	node->parent = parent;
+	node->child = -1;
+	node->count = 0;
+	if( 0 <= parent ){
+		node->sibling = nodes[parent].child;
+		nodes[parent].child = nodeCount;
+	}
+	else{
+		node->sibling = -1;
+	}
+	return nodeCount++;
+}
+
+static void writePath( int node , FILE *output ){
+	char buffer[NUMBER_LENGTH];
+	int depth = 0;
+	for( ; 0 <= node ; node = nodes[node].parent ){
+		trail[depth++] = node;
+	}
+	fputs( PROFILE_ROOT_NAME , output );
+	// 根の次から、逆アセンブル結果と同じ表記でラベルを並べる
+	while( 1 < depth-- ){
+		fputc( ';' , output );
+		if( nodes[trail[depth - 1]].label != NULL ){
+			writeLabel( nodes[trail[depth - 1]].label , output );
+		}
+	}
+	fputc( ' ' , output );
+	fwrite( buffer , sizeof( char ) , formatNumber( nodes[trail[0]].count , buffer ) , output );
+	fputc( '\n' , output );
+	return;
+}
+
+static void clear( void ){
+	free( nodes );
+	free( trail );
+	free( frames );
+	nodes = NULL;
+	trail = NULL;
+	frames = NULL;
+	nodeCount = nodeAllocation = frameAllocation = 0;
+	return;
+}
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	exit( EXIT_FAILURE );
+}
@@ -0,0 +1,383 @@
+//
+//  promote.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include "whitespace.h"
+
+/**
+ * 固定スロットに割り当てるヒープのアドレスの上限
+ */
+#define PROMOTE_ADDRESS_LIMIT 65536
+
+/**
+ * 固定スロットの最大数
+ */
+#define PROMOTE_LIMIT 256
+
+/**
+ * ブロック内で追跡しているスタックの値
+ */
+struct{
+	Instruction *producer;	// 値を積んだ即値の命令 他の命令から参照された場合は NULL
+} typedef Entry;
+
+/**
+ * 即値のアドレスでヒープにアクセスしている命令の組
+ */
+struct{
+	Instruction *push;		// アドレスを積む命令
+	Instruction *access;	// ヒープにアクセスする命令
+} typedef Access;
+
+/**
+ * ブロック内で追跡しているスタック
+ */
+static Entry *entries = NULL;
+
+/**
+ * 追跡しているスタックの値の個数
+ */
+static int entryCount = 0;
+
+/**
+ * 追跡しているスタックの確保サイズ
+ */
+static int entryAllocation = 0;
+
+/**
+ * 即値のアドレスによるヒープアクセス
+ */
+static Access *accesses = NULL;
+
+/**
+ * 即値のアドレスによるヒープアクセスの個数
+ */
+static int accessCount = 0;
+
+/**
+ * 即値のアドレスによるヒープアクセスの確保サイズ
+ */
+static int accessAllocation = 0;
+
+/**
+ * 命令セットから即値のアドレスによるヒープアクセスを探す
+ * @param instruction
+ *	探す命令セット
+ */
+static void collect( Instruction *instruction );
+
+/**
+ * 1つの命令を実行した後のスタックを求める
+ * @param instruction
+ *	実行する命令
+ */
+static void trace( Instruction *instruction );
+
+/**
+ * スタックの上から指定した個数の値を参照したものとして扱う
+ * 参照された値を積んだ命令は取り除けなくなる
+ * @param count
+ *	参照する値の個数
+ */
+static void touch( int count );
+
+/**
+ * スタックに値を積む
+ * @param producer
+ *	値を積んだ即値の命令
+ */
+static void pushEntry( Instruction *producer );
+
+/**
+ * スタックから値を取り出す
+ * @return
+ *	値を積んだ即値の命令
+ */
+static Instruction *popEntry( void );
+
+/**
+ * ヒープアクセスを記録する
+ * @param push
+ *	アドレスを積む命令
+ * @param access
+ *	ヒープにアクセスする命令
+ */
+static void record( Instruction *push , Instruction *access );
+
+/**
+ * 参照回数の多い順にアドレスを固定スロットへ割り当てる
+ * @param addresses
+ *	割り当てたアドレスが格納される
+ * @return
+ *	割り当てた固定スロットの数
+ */
+static int assign( long *addresses );
+
+/**
+ * 固定スロットを割り当てたアクセスを書き換え、アドレスを積む命令を取り除く
+ * 取り除く命令には通し番号として -1 を設定して区別する
+ * @param instruction
+ *	書き換える命令セット
+ * @param addresses
+ *	固定スロットに割り当てたアドレス
+ * @param count
+ *	固定スロットの数
+ * @return
+ *	書き換えた命令セット
+ */
+static Instruction *rewrite( Instruction *instruction , long *addresses , int count );
+
+/**
+ * 探索に使用した領域を破棄する
+ */
+static void clear( void );
+
+/**
+ * エラーメッセージを表示してプログラムを終了する
+ * @param message
+ *	表示するメッセージ
+ */
+static void error( char *message );
+
+
+
+Instruction *promoteHeap( Instruction *instruction ){
+	long addresses[PROMOTE_LIMIT];
+	if( instruction == NULL ){
+		return NULL;
+	}
+	collect( instruction );
+	int count = assign( addresses );
+	if( 0 < count ){
+		instruction = rewrite( instruction , addresses , count );
+		setVariable( addresses , count );
+	}
+	clear();
+	return instruction;
+}
+
+static void collect( Instruction *instruction ){
+	for( ; instruction != NULL ; instruction = instruction->next ){
+		if( instruction->imp == FLOW_CONTROL ){
+			entryCount = 0;
+			continue;
+		}
+		trace( instruction );
+	}
+	return;
+}
+
+static void trace( Instruction *instruction ){
+	Instruction *address;
+	int count;
+	switch( instruction->imp ){
+		case STACK:
+			switch( instruction->c_stack ){
+				case PUSH_NUMBER:
+					pushEntry( instruction );
+					break;
+
+				case TOP_COPY:
+					touch( 1 );
+					pushEntry( NULL );
+					break;
+
+				case N_COPY:
+					touch( ( int ) instruction->p_value + 1 );
+					pushEntry( NULL );
+					break;
+
+				case PUSH_EXCHANGE:
+					touch( 2 );
+					break;
+
+				case TOP_DESTRUCTION:
+					popEntry();
+					break;
+
+				case N_SLIDE:
+					touch( ( int ) instruction->p_value + 1 );
+					popEntry();
+					for( count = ( int ) instruction->p_value ; 0 < count ; count-- ){
+						popEntry();
+					}
+					pushEntry( NULL );
+					break;
+
+				default:
+					entryCount = 0;
+					break;
+			}
+			break;
+
+		case OPERATION:
+			popEntry();
+			popEntry();
+			pushEntry( NULL );
+			break;
+
+		case HEAP:
+			if( instruction->c_heap == TO_ADDRESS ){
+				popEntry();
+				if( ( address = popEntry() ) != NULL ){
+					record( address , instruction );
+				}
+			}
+			else if( instruction->c_heap == TO_STACK ){
+				if( ( address = popEntry() ) != NULL ){
+					record( address , instruction );
+				}
+				pushEntry( NULL );
+			}
+			else if( instruction->c_heap == TO_VARIABLE ){
+				popEntry();
+			}
+			else{
+				pushEntry( NULL );
+			}
+			break;
+
+		case IO:
+			if( instruction->c_io == PUT_CHAR || instruction->c_io == PUT_NUMBER ){
+				popEntry();
+			}
+			else{
+				touch( 1 );
+			}
+			break;
+
+		default:
+			entryCount = 0;
+			break;
+	}
+	return;
+}
+
+static void touch( int count ){
+	int position;
+	for( position = entryCount - 1 ; 0 <= position && entryCount - position <= count ; position-- ){
+		entries[position].producer = NULL;
+	}
+	return;
+}
+
+static void pushEntry( Instruction *producer ){
+	if( entryAllocation <= entryCount ){
+		entryAllocation += STACK_ALLOCATION_SIZE;
+		if( ( entries = ( Entry * ) realloc( entries , sizeof( Entry ) * entryAllocation ) ) == NULL ){
+			error( "promote: out of memory error" );
+		}
+	}
+	entries[entryCount++].producer = producer;
+	return;
+}
+
+static Instruction *popEntry( void ){
+	if( entryCount == 0 ){
+		return NULL;
+	}
+	return entries[--entryCount].producer;
+}
+
+static void record( Instruction *push , Instruction *access ){
+	if( push->p_value < 0 || PROMOTE_ADDRESS_LIMIT <= push->p_value ){
+		return;
+	}
+	if( accessAllocation <= accessCount ){
+		accessAllocation += BUFFER_SIZE;
+		if( ( accesses = ( Access * ) realloc( accesses , sizeof( Access ) * accessAllocation ) ) == NULL ){
+			error( "promote: out of memory error" );
+		}
+	}
+	accesses[accessCount].push = push;
+	accesses[accessCount].access = access;
+	accessCount++;
+	return;
+}
+
+static int assign( long *addresses ){
+	int *uses , index , count = 0 , best;
+	if( accessCount == 0 ){
+		return 0;
+	}
+	if( ( uses = ( int * ) calloc( PROMOTE_ADDRESS_LIMIT , sizeof( int ) ) ) == NULL ){
+		error( "promote: out of memory error" );
+	}
+	for( index = 0 ; index < accessCount ; index++ ){
+		uses[accesses[index].push->p_value]++;
+	}
+	while( count < PROMOTE_LIMIT ){
+		best = -1;
+		for( index = 0 ; index < PROMOTE_ADDRESS_LIMIT ; index++ ){
+			if( 0 < uses[index] && ( best < 0 || uses[best] < uses[index] ) ){
+				best = index;
+			}
+		}
+		if( best < 0 ){
+			break;
+		}
+		addresses[count++] = best;
+		uses[best] = 0;
+	}
+	free( uses );
+	return count;
+}
+
+static Instruction *rewrite( Instruction *instruction , long *addresses , int count ){
+	Access *access;
+	Instruction *position , *next , *previous = NULL , *start = NULL;
+	int index , slot , number = 0;
+	for( index = 0 ; index < accessCount ; index++ ){
+		access = &accesses[index];
+		for( slot = 0 ; slot < count && addresses[slot] != access->push->p_value ; slot++ );
+		if( count <= slot ){
+			continue;
+		}
+		access->access->c_heap = access->access->c_heap == TO_ADDRESS ? TO_VARIABLE : VARIABLE_TO_STACK;
+		access->access->p_value = slot;
+		access->push->index = -1;
+	}
+	for( position = instruction ; position != NULL ; position = next ){
+		next = position->next;
+		if( position->index < 0 ){
+			destroyInstruction( position );
+			continue;
+		}
+		if( start == NULL ){
+			start = position;
+		}
+		if( previous != NULL ){
+			previous->next = position;
+		}
+		position->index = number++;
+		previous = position;
+	}
+	if( previous != NULL ){
+		previous->next = NULL;
+	}
+	return start;
+}
+
+static void clear( void ){
+	if( entries != NULL ){
+		free( entries );
+		entries = NULL;
+	}
+	entryCount = entryAllocation = 0;
+	if( accesses != NULL ){
+		free( accesses );
+		accesses = NULL;
+	}
+	accessCount = accessAllocation = 0;
+	return;
+}
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	exit( EXIT_FAILURE );
+}
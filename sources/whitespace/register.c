@@ -0,0 +1,778 @@
+//
+//  register.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include "whitespace.h"
+
+/**
+ * 中間表現の命令
+ */
+enum{
+	REGISTER_CONSTANT ,			// 即値をレジスタに設定する
+	REGISTER_LOAD ,				// ブロック開始時のスタックの値をレジスタに読み込む
+	REGISTER_ADDTION ,			// 足し算
+	REGISTER_SUBTRACTION ,		// 引き算
+	REGISTER_MULTIPLICATION ,	// 掛け算
+	REGISTER_DIVISION ,			// 割り算
+	REGISTER_MODULO ,			// 余剰
+	REGISTER_HEAP_LOAD ,		// ヒープの値をレジスタに読み込む
+	REGISTER_HEAP_STORE ,		// レジスタの値をヒープに保存する
+	REGISTER_VARIABLE_LOAD ,	// 固定スロットの値をレジスタに読み込む
+	REGISTER_VARIABLE_STORE ,	// レジスタの値を固定スロットに保存する
+	REGISTER_COMMIT ,			// レジスタの値をスタックに書き戻す
+	REGISTER_FALLBACK ,			// 元の命令をスタックマシンとして実行する
+	REGISTER_JUMP ,				// 無条件ジャンプ
+	REGISTER_ZERO_JUMP ,		// レジスタの値が0の場合にジャンプ
+	REGISTER_MINUS_JUMP ,		// レジスタの値が負の場合にジャンプ
+	REGISTER_CALL ,				// サブルーチン呼び出し
+	REGISTER_TAIL_CALL ,		// 末尾位置のサブルーチン呼び出し
+	REGISTER_RETURN ,			// サブルーチン終了
+	REGISTER_FINISH ,			// プログラム終了
+	REGISTER_NEXT				// 次のブロックへ進む
+} typedef RegisterCode;
+
+/**
+ * 中間表現の命令を保持する構造体
+ */
+struct{
+	RegisterCode code;			// 中間表現の命令
+	int target;					// 結果を格納するレジスタ
+	int left;					// 1つ目のオペランドのレジスタ
+	int right;					// 2つ目のオペランドのレジスタ
+	long value;					// 即値・スタックの深さ・書き戻し時に取り除く値の個数
+	int *registers;				// 書き戻し時にスタックに積むレジスタ
+	int count;					// 書き戻し時にスタックに積むレジスタの個数
+	Instruction *instruction;	// 元の命令
+	struct block *jump;			// 分岐先のブロック
+} typedef RegisterInstruction;
+
+/**
+ * 基本ブロックを保持する構造体
+ */
+struct block{
+	Instruction *head;			// ブロックの最初の命令
+	RegisterInstruction *code;	// 中間表現の命令列
+	int length;					// 中間表現の命令数
+	struct block *next;			// 分岐しなかった場合に実行するブロック
+} typedef Block;
+
+/**
+ * 命令の通し番号から、その命令で始まる基本ブロックを引くための表
+ */
+static Block **blocks = NULL;
+
+/**
+ * 命令の総数
+ */
+static int instructionCount = 0;
+
+/**
+ * 仮想レジスタ
+ */
+static long *registers = NULL;
+
+/**
+ * 1ブロックで使用する仮想レジスタの最大数
+ */
+static int registerCount = 0;
+
+/**
+ * 変換中のブロックの中間表現
+ */
+static RegisterInstruction *buffer = NULL;
+
+/**
+ * 変換中のブロックの中間表現の命令数
+ */
+static int bufferLength = 0;
+
+/**
+ * 変換中のブロックの中間表現の確保サイズ
+ */
+static int bufferAllocation = 0;
+
+/**
+ * 変換中のブロックでまだスタックに書き戻していない値のレジスタ
+ */
+static int *symbols = NULL;
+
+/**
+ * 書き戻していない値の個数
+ */
+static int symbolCount = 0;
+
+/**
+ * 書き戻していない値の確保サイズ
+ */
+static int symbolAllocation = 0;
+
+/**
+ * 変換中のブロックでスタックから取り除いた値の個数
+ */
+static int consumed = 0;
+
+/**
+ * 変換中のブロックで使用した仮想レジスタの数
+ */
+static int used = 0;
+
+/**
+ * 実行中の仮想マシン
+ */
+static Machine *machine = NULL;
+
+/**
+ * 命令セットを基本ブロックに分割して中間表現へ変換する
+ * @param instruction
+ *	変換する命令セット
+ * @return
+ *	最初に実行するブロック
+ */
+static Block *translate( Instruction *instruction );
+
+/**
+ * 1つの基本ブロックを中間表現へ変換する
+ * @param instruction
+ *	ブロックの先頭の命令
+ * @param block
+ *	変換結果を格納するブロック
+ */
+static void translateBlock( Instruction *instruction , Block *block );
+
+/**
+ * スタック操作を中間表現へ変換する
+ * @param instruction
+ *	変換する命令
+ */
+static void translateStack( Instruction *instruction );
+
+/**
+ * フロー制御をブロックの終端として中間表現へ変換する
+ * @param instruction
+ *	変換する命令
+ * @param block
+ *	変換中のブロック
+ */
+static void translateFlowControl( Instruction *instruction , Block *block );
+
+/**
+ * 中間表現の命令を追加する
+ * 返した命令は次に emit を呼び出すまでの間だけ有効となる
+ * @param code
+ *	追加する命令
+ * @return
+ *	追加した命令
+ */
+static RegisterInstruction *emit( RegisterCode code );
+
+/**
+ * 値を保存する新しいレジスタを割り当てる
+ * @return
+ *	割り当てたレジスタ
+ */
+static int allocate( void );
+
+/**
+ * 書き戻していない値としてレジスタを積む
+ * @param target
+ *	積むレジスタ
+ */
+static void pushSymbol( int target );
+
+/**
+ * 書き戻していない値を取り出す
+ * 足りない場合はブロック開始時のスタックから読み込む
+ * @return
+ *	値を保持しているレジスタ
+ */
+static int popSymbol( void );
+
+/**
+ * n 番目の値を保持しているレジスタを取得する
+ * @param position
+ *	n 番目の n
+ *	0 を指定すると 1個目の値が取得される
+ * @return
+ *	値を保持しているレジスタ
+ */
+static int peekSymbol( int position );
+
+/**
+ * 書き戻していない値をスタックに書き戻す命令を追加する
+ */
+static void commit( void );
+
+/**
+ * 命令の通し番号に対応するブロックを取得する
+ * @param instruction
+ *	ブロックの先頭の命令
+ * @return
+ *	対応するブロック
+ */
+static Block *getBlock( Instruction *instruction );
+
+/**
+ * 命令から始まるブロックを確保する
+ * 既に確保している場合は何もしない
+ * @param instruction
+ *	ブロックの先頭の命令
+ */
+static void addBlock( Instruction *instruction );
+
+/**
+ * 中間表現を実行する
+ * サブルーチンの戻り先は仮想マシンの呼び出しスタックに元の命令として積む
+ * @param block
+ *	最初に実行するブロック
+ */
+static void run( Block *block );
+
+/**
+ * 変換した中間表現を破棄する
+ */
+static void clear( void );
+
+/**
+ * エラーメッセージを表示してプログラムを終了する
+ * @param message
+ *	表示するメッセージ
+ */
+static void error( char *message );
+
+
+
+void executeRegister( Instruction *instruction ){
+	Block *block;
+	// 前回の実行が途中で中断されていても、変換したブロックとレジスタを持ち越さない
+	clear();
+	machine = getMachine();
+	machine->discard = clear;
+	block = translate( instruction );
+	if( ( registers = ( long * ) malloc( sizeof( long ) * ( registerCount + 1 ) ) ) == NULL ){
+		error( "register: out of memory error" );
+	}
+	run( block );
+	clear();
+	return;
+}
+
+static Block *translate( Instruction *instruction ){
+	Instruction *position;
+	instructionCount = 0;
+	for( position = instruction ; position != NULL ; position = position->next ){
+		instructionCount = position->index + 1;
+	}
+	if( ( blocks = ( Block ** ) calloc( instructionCount + 1 , sizeof( Block * ) ) ) == NULL ){
+		error( "register: out of memory error" );
+	}
+	bool leader = true;
+	for( position = instruction ; position != NULL ; position = position->next ){
+		if( leader || ( position->imp == FLOW_CONTROL && position->c_control == LABEL_DEFINE ) ){
+			addBlock( position );
+		}
+		// ラベル定義を取り除いた命令セットではジャンプ先がブロックの先頭になる
+		if( position->imp == FLOW_CONTROL && position->c_control != LABEL_DEFINE && position->jump != NULL ){
+			addBlock( position->jump );
+		}
+		leader = position->imp == FLOW_CONTROL && position->c_control != LABEL_DEFINE;
+	}
+	for( position = instruction ; position != NULL ; position = position->next ){
+		if( blocks[position->index] != NULL ){
+			translateBlock( position , blocks[position->index] );
+		}
+	}
+	return instruction != NULL ? blocks[instruction->index] : NULL;
+}
+
+static void translateBlock( Instruction *instruction , Block *block ){
+	RegisterInstruction *code;
+	int left , right;
+	bool head = true;
+	bufferLength = 0;
+	symbolCount = 0;
+	consumed = 0;
+	used = 0;
+	if( instruction->imp == FLOW_CONTROL && instruction->c_control == LABEL_DEFINE ){
+		instruction = instruction->next;
+		head = false;
+	}
+	while( true ){
+		if( instruction == NULL || ( ! head && blocks[instruction->index] != NULL ) ){
+			commit();
+			emit( REGISTER_NEXT );
+			block->next = getBlock( instruction );
+			break;
+		}
+		if( instruction->imp == FLOW_CONTROL ){
+			translateFlowControl( instruction , block );
+			break;
+		}
+		switch( instruction->imp ){
+			case STACK:
+				translateStack( instruction );
+				break;
+
+			case OPERATION:
+				right = popSymbol();
+				left = popSymbol();
+				code = emit( REGISTER_ADDTION + instruction->c_operation );
+				code->left = left;
+				code->right = right;
+				code->target = allocate();
+				pushSymbol( code->target );
+				break;
+
+			case HEAP:
+				switch( instruction->c_heap ){
+					case TO_ADDRESS:
+						right = popSymbol();
+						left = popSymbol();
+						code = emit( REGISTER_HEAP_STORE );
+						code->left = left;
+						code->right = right;
+						break;
+
+					case TO_STACK:
+						left = popSymbol();
+						code = emit( REGISTER_HEAP_LOAD );
+						code->left = left;
+						code->target = allocate();
+						pushSymbol( code->target );
+						break;
+
+					case TO_VARIABLE:
+						left = popSymbol();
+						code = emit( REGISTER_VARIABLE_STORE );
+						code->left = left;
+						code->value = instruction->p_value;
+						break;
+
+					case VARIABLE_TO_STACK:
+						code = emit( REGISTER_VARIABLE_LOAD );
+						code->target = allocate();
+						code->value = instruction->p_value;
+						pushSymbol( code->target );
+						break;
+
+					default:
+						commit();
+						emit( REGISTER_FALLBACK )->instruction = instruction;
+						break;
+				}
+				break;
+
+			default:
+				commit();
+				emit( REGISTER_FALLBACK )->instruction = instruction;
+				break;
+		}
+		instruction = instruction->next;
+		head = false;
+	}
+	if( ( block->code = ( RegisterInstruction * ) malloc( sizeof( RegisterInstruction ) * bufferLength ) ) == NULL ){
+		error( "register: out of memory error" );
+	}
+	memcpy( block->code , buffer , sizeof( RegisterInstruction ) * bufferLength );
+	block->length = bufferLength;
+	if( registerCount < used ){
+		registerCount = used;
+	}
+	return;
+}
+
+static void translateStack( Instruction *instruction ){
+	int first , second , count;
+	RegisterInstruction *code;
+	switch( instruction->c_stack ){
+		case PUSH_NUMBER:
+			code = emit( REGISTER_CONSTANT );
+			code->target = allocate();
+			code->value = instruction->p_value;
+			pushSymbol( code->target );
+			break;
+
+		case TOP_COPY:
+			pushSymbol( peekSymbol( 0 ) );
+			break;
+
+		case N_COPY:
+			pushSymbol( peekSymbol( ( int ) instruction->p_value ) );
+			break;
+
+		case PUSH_EXCHANGE:
+			first = popSymbol();
+			second = popSymbol();
+			pushSymbol( first );
+			pushSymbol( second );
+			break;
+
+		case TOP_DESTRUCTION:
+			if( 0 < symbolCount ){
+				symbolCount--;
+			}
+			else{
+				consumed++;
+			}
+			break;
+
+		case N_SLIDE:
+			first = popSymbol();
+			for( count = ( int ) instruction->p_value ; 0 < count ; count-- ){
+				if( 0 < symbolCount ){
+					symbolCount--;
+				}
+				else{
+					consumed++;
+				}
+			}
+			pushSymbol( first );
+			break;
+
+		default:
+			commit();
+			emit( REGISTER_FALLBACK )->instruction = instruction;
+			break;
+	}
+	return;
+}
+
+static void translateFlowControl( Instruction *instruction , Block *block ){
+	RegisterInstruction *code;
+	int condition;
+	switch( instruction->c_control ){
+		case CALL_ROUTINE:
+			// FALL THROUGH
+
+		case TAIL_CALL:
+			commit();
+			code = emit( instruction->c_control == CALL_ROUTINE ? REGISTER_CALL : REGISTER_TAIL_CALL );
+			code->instruction = instruction;
+			code->jump = getBlock( instruction->jump );
+			break;
+
+		case JUMP:
+			commit();
+			code = emit( REGISTER_JUMP );
+			code->instruction = instruction;
+			code->jump = getBlock( instruction->jump );
+			break;
+
+		case ZERO_JUMP:
+			// FALL THROUGH
+
+		case MINUS_JUMP:
+			condition = popSymbol();
+			commit();
+			code = emit( instruction->c_control == ZERO_JUMP ? REGISTER_ZERO_JUMP : REGISTER_MINUS_JUMP );
+			code->left = condition;
+			code->instruction = instruction;
+			code->jump = getBlock( instruction->jump );
+			break;
+
+		case END_ROUTINE:
+			commit();
+			emit( REGISTER_RETURN )->instruction = instruction;
+			break;
+
+		case FINISH:
+			commit();
+			emit( REGISTER_FINISH );
+			break;
+
+		default:
+			commit();
+			emit( REGISTER_FALLBACK )->instruction = instruction;
+			emit( REGISTER_NEXT );
+			break;
+	}
+	block->next = getBlock( instruction->next );
+	return;
+}
+
+static RegisterInstruction *emit( RegisterCode code ){
+	if( bufferAllocation <= bufferLength ){
+		bufferAllocation += BUFFER_SIZE;
+		if( ( buffer = ( RegisterInstruction * ) realloc( buffer , sizeof( RegisterInstruction ) * bufferAllocation ) ) == NULL ){
+			error( "register: out of memory error" );
+		}
+	}
+	RegisterInstruction *instruction = &buffer[bufferLength++];
+	memset( instruction , 0 , sizeof( RegisterInstruction ) );
+	instruction->code = code;
+	return instruction;
+}
+
+static int allocate( void ){
+	return used++;
+}
+
+static void pushSymbol( int target ){
+	if( symbolAllocation <= symbolCount ){
+		symbolAllocation += STACK_ALLOCATION_SIZE;
+		if( ( symbols = ( int * ) realloc( symbols , sizeof( int ) * symbolAllocation ) ) == NULL ){
+			error( "register: out of memory error" );
+		}
+	}
+	symbols[symbolCount++] = target;
+	return;
+}
+
+static int popSymbol( void ){
+	if( 0 < symbolCount ){
+		return symbols[--symbolCount];
+	}
+	RegisterInstruction *code = emit( REGISTER_LOAD );
+	code->target = allocate();
+	code->value = consumed++;
+	return code->target;
+}
+
+static int peekSymbol( int position ){
+	if( position < symbolCount ){
+		return symbols[symbolCount - position - 1];
+	}
+	RegisterInstruction *code = emit( REGISTER_LOAD );
+	code->target = allocate();
+	code->value = consumed + position - symbolCount;
+	return code->target;
+}
+
+static void commit( void ){
+	if( consumed == 0 && symbolCount == 0 ){
+		return;
+	}
+	RegisterInstruction *code = emit( REGISTER_COMMIT );
+	code->value = consumed;
+	code->count = symbolCount;
+	if( 0 < symbolCount ){
+		if( ( code->registers = ( int * ) malloc( sizeof( int ) * symbolCount ) ) == NULL ){
+			error( "register: out of memory error" );
+		}
+		memcpy( code->registers , symbols , sizeof( int ) * symbolCount );
+	}
+	consumed = 0;
+	symbolCount = 0;
+	return;
+}
+
+static Block *getBlock( Instruction *instruction ){
+	return instruction != NULL ? blocks[instruction->index] : NULL;
+}
+
+static void addBlock( Instruction *instruction ){
+	if( blocks[instruction->index] == NULL && ( blocks[instruction->index] = ( Block * ) calloc( 1 , sizeof( Block ) ) ) == NULL ){
+		error( "register: out of memory error" );
+	}
+	blocks[instruction->index]->head = instruction;
+	return;
+}
+
+static void run( Block *block ){
+	RegisterInstruction *code;
+	long *stack;
+	int base , index;
+	while( block != NULL || 0 < machine->callPointer ){
+		if( block == NULL ){
+			block = getBlock( machine->calls[--machine->callPointer] );
+			continue;
+		}
+		// 標本を取る割り込みから見えるよう、実行中のブロックの最初の命令を公開する
+		machine->current = block->head;
+		for( code = block->code ; ; code++ ){
+			switch( code->code ){
+				case REGISTER_CONSTANT:
+					registers[code->target] = code->value;
+					continue;
+
+				case REGISTER_LOAD:
+					if( machine->stackPointer <= code->value ){
+						error( "do not have value in stack" );
+					}
+					registers[code->target] = machine->stack[machine->stackPointer - code->value - 1];
+					continue;
+
+				case REGISTER_ADDTION:
+					registers[code->target] = registers[code->left] + registers[code->right];
+					continue;
+
+				case REGISTER_SUBTRACTION:
+					registers[code->target] = registers[code->left] - registers[code->right];
+					continue;
+
+				case REGISTER_MULTIPLICATION:
+					registers[code->target] = registers[code->left] * registers[code->right];
+					continue;
+
+				case REGISTER_DIVISION:
+					registers[code->target] = registers[code->left] / registers[code->right];
+					continue;
+
+				case REGISTER_MODULO:
+					registers[code->target] = registers[code->left] % registers[code->right];
+					continue;
+
+				case REGISTER_HEAP_LOAD:
+					registers[code->target] = getHeapValue( ( int ) registers[code->left] );
+					continue;
+
+				case REGISTER_HEAP_STORE:
+					setHeapValue( ( int ) registers[code->left] , registers[code->right] );
+					continue;
+
+				case REGISTER_VARIABLE_LOAD:
+					registers[code->target] = machine->heapAllocation < machine->variableLimit ? getVariableValue( code->value ) : machine->variables[code->value];
+					continue;
+
+				case REGISTER_VARIABLE_STORE:
+					if( machine->heapAllocation < machine->variableLimit ){
+						setVariableValue( code->value , registers[code->left] );
+					}
+					else{
+						machine->variables[code->value] = registers[code->left];
+					}
+					continue;
+
+				case REGISTER_COMMIT:
+					if( machine->stackPointer < code->value ){
+						error( "do not have value in stack" );
+					}
+					base = machine->stackPointer - ( int ) code->value;
+					machine->stackPointer = base;
+					if( machine->stackAllocation < base + code->count ){
+						reserveStack( code->count );
+					}
+					stack = machine->stack + base;
+					for( index = 0 ; index < code->count ; index++ ){
+						stack[index] = registers[code->registers[index]];
+					}
+					machine->stackPointer = base + code->count;
+					continue;
+
+				case REGISTER_FALLBACK:
+					if( baseProcess( code->instruction ) ){
+						return;
+					}
+					continue;
+
+				case REGISTER_JUMP:
+					if( machine->governed ){
+						chargeFuel( code->instruction , code->instruction->jump );
+					}
+					block = code->jump;
+					break;
+
+				case REGISTER_ZERO_JUMP:
+					if( registers[code->left] != 0 ){
+						block = block->next;
+						break;
+					}
+					if( machine->governed ){
+						chargeFuel( code->instruction , code->instruction->jump );
+					}
+					block = code->jump;
+					break;
+
+				case REGISTER_MINUS_JUMP:
+					if( 0 <= registers[code->left] ){
+						block = block->next;
+						break;
+					}
+					if( machine->governed ){
+						chargeFuel( code->instruction , code->instruction->jump );
+					}
+					block = code->jump;
+					break;
+
+				case REGISTER_CALL:
+					if( machine->governed ){
+						chargeFuel( code->instruction , code->instruction->jump );
+					}
+					pushCall( code->instruction->next );
+					block = code->jump;
+					break;
+
+				case REGISTER_TAIL_CALL:
+					if( machine->governed ){
+						chargeFuel( code->instruction , code->instruction->jump );
+					}
+					if( machine->callPointer == 0 ){
+						pushCall( code->instruction->next );
+					}
+					block = code->jump;
+					break;
+
+				case REGISTER_RETURN:
+					if( 0 < machine->callPointer ){
+						machine->current = machine->calls[--machine->callPointer];
+						block = getBlock( machine->current );
+					}
+					else{
+						machine->current = code->instruction->next;
+						block = block->next;
+					}
+					if( machine->governed ){
+						chargeFuel( code->instruction , machine->current );
+					}
+					break;
+
+				case REGISTER_FINISH:
+					return;
+
+				case REGISTER_NEXT:
+					block = block->next;
+					break;
+
+				default:
+					error( "register: illegal code" );
+					break;
+			}
+			break;
+		}
+	}
+	return;
+}
+
+static void clear( void ){
+	int index , position;
+	for( index = 0 ; index < instructionCount ; index++ ){
+		if( blocks[index] == NULL ){
+			continue;
+		}
+		for( position = 0 ; position < blocks[index]->length ; position++ ){
+			if( blocks[index]->code[position].registers != NULL ){
+				free( blocks[index]->code[position].registers );
+			}
+		}
+		free( blocks[index]->code );
+		free( blocks[index] );
+	}
+	free( blocks );
+	blocks = NULL;
+	instructionCount = 0;
+	if( registers != NULL ){
+		free( registers );
+		registers = NULL;
+	}
+	registerCount = 0;
+	if( buffer != NULL ){
+		free( buffer );
+		buffer = NULL;
+	}
+	bufferLength = bufferAllocation = 0;
+	if( symbols != NULL ){
+		free( symbols );
+		symbols = NULL;
+	}
+	symbolCount = symbolAllocation = 0;
+	return;
+}
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	halt( HALT_ERROR );
+}
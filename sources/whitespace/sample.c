@@ -0,0 +1,321 @@
+//
+//  sample.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/time.h>
+#include "whitespace.h"
+
+/**
+ * 割り込みから集計に標本を渡すリングバッファの要素数
+ * 2 の累乗にする
+ */
+#define SAMPLE_RING_SIZE 4096
+
+/**
+ * 書き出す命令とラベルのそれぞれの最大数
+ */
+#define SAMPLE_REPORT_COUNT 10
+
+/**
+ * ラベルより前の命令をまとめる名前
+ */
+#define SAMPLE_ROOT_NAME "[main]"
+
+/**
+ * 1つの標本
+ */
+struct{
+	int index;	// 割り込み時点で実行中の命令の番号 命令の外の場合は -1
+	int depth;	// 割り込み時点の呼び出しの深さ
+} typedef Sample;
+
+/**
+ * 割り込みから集計に標本を渡すリングバッファ
+ */
+static Sample ring[SAMPLE_RING_SIZE];
+
+/**
+ * 次に標本を書き込む位置
+ * 割り込みだけが進める
+ */
+static atomic_ulong head = 0;
+
+/**
+ * 次に集計する標本の位置
+ * 集計する側だけが進める
+ */
+static atomic_ulong tail = 0;
+
+/**
+ * 標本を取る間に実行している仮想マシン
+ */
+static Machine *machine = NULL;
+
+/**
+ * 実行する命令セットの最初の命令
+ */
+static Instruction *program = NULL;
+
+/**
+ * 命令の番号毎の命令
+ */
+static Instruction **instructions = NULL;
+
+/**
+ * 命令の番号の上限
+ */
+static int instructionCount = 0;
+
+/**
+ * 命令の番号毎の標本数
+ */
+static long *counts = NULL;
+
+/**
+ * 命令の番号毎の標本の呼び出しの深さの合計
+ */
+static long *depths = NULL;
+
+/**
+ * 命令の外で取った標本の数
+ */
+static long outside = 0;
+
+/**
+ * 1秒あたりの標本数
+ */
+static long rate = 0;
+
+/**
+ * 割り込み時点で実行中の命令と呼び出しの深さをリングバッファに書き込む
+ * リングバッファが一杯の場合は先に割り込みの中で集計して空ける
+ * @param number
+ *	シグナル番号
+ */
+static void record( int number );
+
+/**
+ * リングバッファに溜まった標本を集計する
+ */
+static void drain( void );
+
+/**
+ * 標本数の多い順に命令の番号を選ぶ
+ * @param values
+ *	番号毎の標本数
+ * @param count
+ *	番号の上限
+ * @param selected
+ *	選んだ番号の書き込み先
+ * @return
+ *	選んだ番号の数
+ */
+static int choose( long *values , int count , int *selected );
+
+/**
+ * 標本の割合を書き込む
+ * @param count
+ *	標本数
+ * @param total
+ *	全体の標本数
+ * @param output
+ *	書き込み先
+ */
+static void writeShare( long count , long total , FILE *output );
+
+/**
+ * 記録した標本を破棄する
+ */
+static void clear( void );
+
+/**
+ * エラーメッセージを表示してプログラムを終了する
+ * @param message
+ *	表示するメッセージ
+ */
+static void error( char *message );
+
+
+
+void startSample( Instruction *instruction , long frequency ){
+	struct sigaction action;
+	struct itimerval timer;
+	Instruction *position;
+	clear();
+	machine = getMachine();
+	program = instruction;
+	rate = frequency;
+	for( position = instruction ; position != NULL ; position = position->next ){
+		if( instructionCount <= position->index ){
+			instructionCount = position->index + 1;
+		}
+	}
+	// 割り込みの中で確保しないよう、集計先は全て先に確保する
+	instructions = ( Instruction ** ) calloc( instructionCount + 1 , sizeof( Instruction * ) );
+	counts = ( long * ) calloc( instructionCount + 1 , sizeof( long ) );
+	depths = ( long * ) calloc( instructionCount + 1 , sizeof( long ) );
+	if( instructions == NULL || counts == NULL || depths == NULL ){
+		error( "sample: out of memory error" );
+	}
+	for( position = instruction ; position != NULL ; position = position->next ){
+		instructions[position->index] = position;
+	}
+	memset( &action , 0 , sizeof( action ) );
+	action.sa_handler = record;
+	action.sa_flags = SA_RESTART;
+	sigemptyset( &action.sa_mask );
+	sigaction( SIGPROF , &action , NULL );
+	memset( &timer , 0 , sizeof( timer ) );
+	timer.it_interval.tv_sec = 1 / frequency;
+	timer.it_interval.tv_usec = 1000000 / frequency % 1000000;
+	if( timer.it_interval.tv_sec == 0 && timer.it_interval.tv_usec == 0 ){
+		timer.it_interval.tv_usec = 1;
+	}
+	timer.it_value = timer.it_interval;
+	setitimer( ITIMER_PROF , &timer , NULL );
+	return;
+}
+
+void reportSample( FILE *output ){
+	struct sigaction action;
+	struct itimerval timer;
+	Instruction *owner , *position;
+	long *labelCounts , total;
+	int selected[SAMPLE_REPORT_COUNT] , count , index;
+	if( machine == NULL ){
+		return;
+	}
+	// 割り込みを止めてから残りを集計するため、以降は集計する側だけが触る
+	// 止める前に発生した割り込みでプロセスが終了しないよう、既定の処理には戻さず無視する
+	memset( &timer , 0 , sizeof( timer ) );
+	setitimer( ITIMER_PROF , &timer , NULL );
+	memset( &action , 0 , sizeof( action ) );
+	action.sa_handler = SIG_IGN;
+	sigemptyset( &action.sa_mask );
+	sigaction( SIGPROF , &action , NULL );
+	drain();
+	total = outside;
+	for( index = 0 ; index < instructionCount ; index++ ){
+		total += counts[index];
+	}
+	fprintf( output , "sample: %ld samples at %ld Hz\n" , total , rate );
+	if( total == 0 ){
+		clear();
+		return;
+	}
+	fputs( "sample: hot instructions\n" , output );
+	count = choose( counts , instructionCount , selected );
+	for( index = 0 ; index < count ; index++ ){
+		writeShare( counts[selected[index]] , total , output );
+		fprintf( output , "%6.1f  " , ( double ) depths[selected[index]] / counts[selected[index]] );
+		writeInstruction( instructions[selected[index]] , output );
+	}
+	// 各命令の標本を直前のラベルにまとめる ラベルより前の命令は根にまとめる
+	if( ( labelCounts = ( long * ) calloc( instructionCount + 1 , sizeof( long ) ) ) == NULL ){
+		error( "sample: out of memory error" );
+	}
+	owner = NULL;
+	for( position = program ; position != NULL ; position = position->next ){
+		if( position->labels != NULL ){
+			owner = position;
+		}
+		labelCounts[owner != NULL ? owner->index : instructionCount] += counts[position->index];
+	}
+	labelCounts[instructionCount] += outside;
+	fputs( "sample: hot labels\n" , output );
+	count = choose( labelCounts , instructionCount + 1 , selected );
+	for( index = 0 ; index < count ; index++ ){
+		writeShare( labelCounts[selected[index]] , total , output );
+		if( selected[index] == instructionCount ){
+			fputs( SAMPLE_ROOT_NAME , output );
+		}
+		else{
+			writeLabel( instructions[selected[index]]->labels->p_label , output );
+		}
+		fputc( '\n' , output );
+	}
+	free( labelCounts );
+	clear();
+	return;
+}
+
+static void record( int number ){
+	Instruction *current = machine->current;
+	unsigned long position = atomic_load_explicit( &head , memory_order_relaxed );
+	if( position - atomic_load_explicit( &tail , memory_order_acquire ) == SAMPLE_RING_SIZE ){
+		drain();
+	}
+	ring[position & ( SAMPLE_RING_SIZE - 1 )].index = current != NULL ? current->index : -1;
+	ring[position & ( SAMPLE_RING_SIZE - 1 )].depth = machine->callPointer;
+	atomic_store_explicit( &head , position + 1 , memory_order_release );
+	return;
+}
+
+static void drain( void ){
+	Sample *sample;
+	unsigned long position = atomic_load_explicit( &tail , memory_order_relaxed );
+	unsigned long end = atomic_load_explicit( &head , memory_order_acquire );
+	for( ; position != end ; position++ ){
+		sample = &ring[position & ( SAMPLE_RING_SIZE - 1 )];
+		if( 0 <= sample->index && sample->index < instructionCount ){
+			counts[sample->index]++;
+			depths[sample->index] += sample->depth;
+		}
+		else{
+			outside++;
+		}
+	}
+	atomic_store_explicit( &tail , position , memory_order_release );
+	return;
+}
+
+static int choose( long *values , int count , int *selected ){
+	int found = 0 , index , rank;
+	for( index = 0 ; index < count ; index++ ){
+		if( values[index] <= 0 ){
+			continue;
+		}
+		// 上位の数だけを標本数の多い順に並べておき、挿入する位置を探す
+		for( rank = found < SAMPLE_REPORT_COUNT ? found++ : SAMPLE_REPORT_COUNT ; 0 < rank && values[selected[rank - 1]] < values[index] ; rank-- ){
+			if( rank < SAMPLE_REPORT_COUNT ){
+				selected[rank] = selected[rank - 1];
+			}
+		}
+		if( rank < SAMPLE_REPORT_COUNT ){
+			selected[rank] = index;
+		}
+	}
+	return found;
+}
+
+static void writeShare( long count , long total , FILE *output ){
+	fprintf( output , "%8ld %5.1f%%  " , count , 100.0 * count / total );
+	return;
+}
+
+static void clear( void ){
+	free( instructions );
+	free( counts );
+	free( depths );
+	instructions = NULL;
+	counts = depths = NULL;
+	instructionCount = 0;
+	outside = 0;
+	machine = NULL;
+	program = NULL;
+	atomic_store( &head , 0 );
+	atomic_store( &tail , 0 );
+	return;
+}
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	exit( EXIT_FAILURE );
+}
@@ -0,0 +1,719 @@
+//
+//  schedule.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#define _GNU_SOURCE
+#if defined( __linux__ )
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <time.h>
+	#include <unistd.h>
+	#include <sys/epoll.h>
+	#include <sys/socket.h>
+#endif
+#include "whitespace.h"
+
+/**
+ * 1回の epoll_wait で受け取るイベントの最大数
+ */
+#define SCHEDULE_EVENT_COUNT 256
+
+/**
+ * 1つのタスクが溜めておく入力の最大バイト数
+ * 超えた場合はプログラムが読み込むまで接続から読み込まない
+ */
+#define SCHEDULE_INPUT_LIMIT ( 1024 * 1024 )
+
+/**
+ * プログラムを受け取っている間に溜めておく最大バイト数
+ * 先頭行と最大のプログラムが収まる大きさで、超えた分はプログラムを受け取るまで接続から読み込まない
+ */
+#define SCHEDULE_REQUEST_LIMIT ( SERVER_PROGRAM_LIMIT + BUFFER_SIZE )
+
+/**
+ * 1つのタスクが溜めておく出力の最大バイト数
+ * 超えた場合は接続に書き込めるまでタスクを止める
+ */
+#define SCHEDULE_OUTPUT_LIMIT ( 1024 * 1024 )
+
+/**
+ * 指定した命令数を実行したら他のタスクに切り替える
+ */
+#define SCHEDULE_DEFAULT_QUANTUM 10000
+
+/**
+ * タスクの状態
+ */
+enum{
+	TASK_REQUEST ,	// プログラムを受け取っている
+	TASK_RUNNABLE ,	// 実行できる
+	TASK_INPUT ,	// 入力を待っている
+	TASK_OUTPUT ,	// 出力を書き込めるのを待っている
+	TASK_CLOSING	// 終了して残りの出力を書き込んでいる
+} typedef TaskState;
+
+/**
+ * 読み書きするデータを溜めておくバッファ
+ */
+struct{
+	char *data;			// データ
+	size_t start;		// 未処理のデータの位置
+	size_t length;		// 未処理のデータのバイト数
+	size_t allocation;	// 確保したバイト数
+} typedef Buffer;
+
+/**
+ * 接続毎に1つの仮想マシンを実行するタスク
+ */
+struct task{
+	int descriptor;			// 接続したソケット
+	TaskState state;		// タスクの状態
+	Machine machine;		// 切り替えている間の仮想マシンの実行状態
+	FILE *reader;			// プログラムの入力
+	FILE *writer;			// プログラムの出力
+	Buffer input;			// 接続から読み込んだ入力
+	Buffer output;			// 接続に書き込む出力
+	bool end;				// 接続から全て読み込んだ場合に true
+	bool queued;			// 実行待ちの列に入っている場合に true
+	unsigned int events;	// epoll に登録しているイベント
+	unsigned long hash;		// ソースコードのハッシュ値
+	bool hit;				// 保持していた命令セットを使用した場合に true
+	Instruction *program;	// 実行している命令セット
+	long start;				// 接続を受け付けた時刻
+	struct task *next;		// 実行待ちの列の次のタスク
+} typedef Task;
+
+#if defined( __linux__ )
+
+/**
+ * 実行中の仮想マシン
+ */
+static Machine *machine = NULL;
+
+/**
+ * タスクを実行していない間の仮想マシンの実行状態
+ */
+static Machine idle;
+
+/**
+ * 実行中のタスク
+ */
+static Task *running = NULL;
+
+/**
+ * 実行待ちの列の先頭
+ */
+static Task *queueHead = NULL;
+
+/**
+ * 実行待ちの列の末尾
+ */
+static Task *queueTail = NULL;
+
+/**
+ * 実行待ちのタスクの数
+ */
+static int queueLength = 0;
+
+/**
+ * epoll のファイルディスクリプタ
+ */
+static int poller = -1;
+
+/**
+ * 1回に実行する命令数
+ */
+static long quantum = 0;
+
+/**
+ * タスク毎の資源の上限
+ */
+static Limit taskLimit;
+
+/**
+ * 接続を受け付けてタスクを作成する
+ * @param listener
+ *	接続を待ち受けるソケット
+ */
+static void acceptTask( int listener );
+
+/**
+ * 接続のイベントを処理する
+ * @param task
+ *	タスク
+ * @param events
+ *	発生したイベント
+ */
+static void handleTask( Task *task , unsigned int events );
+
+/**
+ * 先頭行のプログラムのバイト数とプログラムを受け取り、実行できる状態にする
+ * @param task
+ *	タスク
+ * @return
+ *	要求が不正な場合に false を返す
+ */
+static bool acceptRequest( Task *task );
+
+/**
+ * タスクを1回分実行する
+ * @param task
+ *	タスク
+ */
+static void runTask( Task *task );
+
+/**
+ * 仮想マシンを切り替えて指定した命令数まで実行する
+ * 入力が無い入力命令に達した場合や、プログラムが終了した場合はその時点で戻る
+ * @param instruction
+ *	最初に実行する命令
+ */
+static void slice( Instruction *instruction );
+
+/**
+ * 入力命令を実行しても入力を待たずに済むかを判定する
+ * @param task
+ *	タスク
+ * @param instruction
+ *	次に実行する命令
+ * @return
+ *	実行できる場合に true を返す
+ */
+static bool isReady( Task *task , Instruction *instruction );
+
+/**
+ * プログラムを終了させ、仮想マシンの領域を破棄する
+ * @param task
+ *	タスク
+ */
+static void retire( Task *task );
+
+/**
+ * 接続を閉じてタスクを破棄する
+ * @param task
+ *	タスク
+ */
+static void destroyTask( Task *task );
+
+/**
+ * 実行待ちの列にタスクを追加する
+ * @param task
+ *	タスク
+ */
+static void enqueue( Task *task );
+
+/**
+ * 実行待ちの列からタスクを取り出す
+ * @return
+ *	タスク
+ */
+static Task *dequeue( void );
+
+/**
+ * タスクの状態に合わせて epoll に登録するイベントを変更する
+ * @param task
+ *	タスク
+ */
+static void watch( Task *task );
+
+/**
+ * 接続から読み込めるだけ読み込む
+ * @param task
+ *	タスク
+ */
+static void receiveTask( Task *task );
+
+/**
+ * 溜めている出力を書き込めるだけ接続に書き込む
+ * 接続が切れていた場合は出力を捨てる
+ * @param task
+ *	タスク
+ * @return
+ *	接続が切れていた場合に false を返す
+ */
+static bool sendTask( Task *task );
+
+/**
+ * バッファの後ろに指定したバイト数を書き込めるだけの空きを作る
+ * @param buffer
+ *	バッファ
+ * @param size
+ *	書き込むバイト数
+ */
+static void reserveBuffer( Buffer *buffer , size_t size );
+
+/**
+ * プログラムの入力として溜めている入力を読み込む
+ * @param cookie
+ *	タスク
+ * @param data
+ *	読み込み先
+ * @param size
+ *	読み込むバイト数
+ * @return
+ *	読み込んだバイト数
+ */
+static ssize_t readTask( void *cookie , char *data , size_t size );
+
+/**
+ * プログラムの出力を溜める
+ * @param cookie
+ *	タスク
+ * @param data
+ *	書き込むデータ
+ * @param size
+ *	書き込むバイト数
+ * @return
+ *	書き込んだバイト数
+ */
+static ssize_t writeTask( void *cookie , const char *data , size_t size );
+
+/**
+ * 単調増加する時刻をマイクロ秒で取得する
+ * @return
+ *	時刻
+ */
+static long now( void );
+
+#endif
+
+/**
+ * エラーメッセージを表示してプログラムを終了する
+ * @param message
+ *	表示するメッセージ
+ */
+static void error( char *message );
+
+
+
+#if defined( __linux__ )
+
+void schedule( int listener , long count , Limit *limit ){
+	struct epoll_event event , events[SCHEDULE_EVENT_COUNT];
+	Task *task;
+	int received , index , pending;
+
+	machine = getMachine();
+	idle = *machine;
+	quantum = 0 < count ? count : SCHEDULE_DEFAULT_QUANTUM;
+	taskLimit = *limit;
+	fcntl( listener , F_SETFL , fcntl( listener , F_GETFL ) | O_NONBLOCK );
+	if( ( poller = epoll_create1( 0 ) ) < 0 ){
+		error( "schedule: epoll error" );
+	}
+	memset( &event , 0 , sizeof( event ) );
+	event.events = EPOLLIN | EPOLLEXCLUSIVE;
+	event.data.ptr = NULL;
+	if( epoll_ctl( poller , EPOLL_CTL_ADD , listener , &event ) != 0 ){
+		error( "schedule: epoll error" );
+	}
+
+	while( true ){
+		// 実行できるタスクがある間はイベントを待たずに確認だけする
+		if( ( received = epoll_wait( poller , events , SCHEDULE_EVENT_COUNT , queueHead != NULL ? 0 : -1 ) ) < 0 ){
+			if( errno == EINTR ){
+				continue;
+			}
+			error( "schedule: epoll error" );
+		}
+		for( index = 0 ; index < received ; index++ ){
+			if( events[index].data.ptr == NULL ){
+				acceptTask( listener );
+			}
+			else{
+				handleTask( ( Task * ) events[index].data.ptr , events[index].events );
+			}
+		}
+		// 列に並んでいたタスクを1回ずつ実行してからイベントを確認し直す
+		for( pending = queueLength ; 0 < pending && queueHead != NULL ; pending-- ){
+			task = dequeue();
+			if( task->state == TASK_RUNNABLE ){
+				runTask( task );
+			}
+			else if( task->state == TASK_CLOSING && task->output.length == 0 ){
+				destroyTask( task );
+			}
+		}
+	}
+	return;
+}
+
+static void acceptTask( int listener ){
+	cookie_io_functions_t functions = { readTask , writeTask , NULL , NULL };
+	struct epoll_event event;
+	Task *task;
+	int connection;
+	while( ( connection = accept4( listener , NULL , NULL , SOCK_NONBLOCK ) ) >= 0 ){
+		if( ( task = ( Task * ) calloc( 1 , sizeof( Task ) ) ) == NULL ){
+			error( "schedule: out of memory error" );
+		}
+		task->descriptor = connection;
+		task->state = TASK_REQUEST;
+		task->start = now();
+		if( ( task->reader = fopencookie( task , "r" , functions ) ) == NULL || ( task->writer = fopencookie( task , "w" , functions ) ) == NULL ){
+			error( "schedule: open connection error" );
+		}
+		// 溜めている入力の量で入力を待つかを判定するため、標準入出力側では溜めない
+		setvbuf( task->reader , NULL , _IONBF , 0 );
+		setvbuf( task->writer , NULL , _IONBF , 0 );
+		memset( &event , 0 , sizeof( event ) );
+		event.events = task->events = EPOLLIN;
+		event.data.ptr = task;
+		if( epoll_ctl( poller , EPOLL_CTL_ADD , connection , &event ) != 0 ){
+			error( "schedule: epoll error" );
+		}
+	}
+	if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED ){
+		error( "schedule: accept error" );
+	}
+	return;
+}
+
+static void handleTask( Task *task , unsigned int events ){
+	if( events & ( EPOLLIN | EPOLLHUP | EPOLLERR ) ){
+		receiveTask( task );
+	}
+	if( ( events & ( EPOLLOUT | EPOLLHUP | EPOLLERR ) ) && ! sendTask( task ) && task->state != TASK_CLOSING ){
+		retire( task );
+	}
+	switch( task->state ){
+		case TASK_REQUEST:
+			if( ! acceptRequest( task ) ){
+				fputs( "schedule: illegal request\n" , stderr );
+				task->state = TASK_CLOSING;
+			}
+			break;
+
+		case TASK_INPUT:
+			if( isReady( task , task->machine.current ) ){
+				task->state = TASK_RUNNABLE;
+				enqueue( task );
+			}
+			break;
+
+		case TASK_OUTPUT:
+			if( task->output.length <= SCHEDULE_OUTPUT_LIMIT / 2 ){
+				task->state = TASK_RUNNABLE;
+				enqueue( task );
+			}
+			break;
+
+		default:
+			break;
+	}
+	if( task->state == TASK_CLOSING && task->output.length == 0 && ! task->queued ){
+		destroyTask( task );
+		return;
+	}
+	watch( task );
+	return;
+}
+
+static bool acceptRequest( Task *task ){
+	Buffer *input = &task->input;
+	Instruction *program;
+	Limit sliced;
+	char *header = input->data + input->start , *newline , *source;
+	size_t length , size;
+	if( input->length == 0 ){
+		return ! task->end;
+	}
+	if( ( newline = ( char * ) memchr( header , '\n' , input->length ) ) == NULL ){
+		return ! task->end && input->length < BUFFER_SIZE;
+	}
+	if( ( length = strtoul( header , NULL , 10 ) ) == 0 || SERVER_PROGRAM_LIMIT < length ){
+		return false;
+	}
+	size = newline - header + 1;
+	if( input->length < size + length ){
+		return ! task->end;
+	}
+	if( ( source = ( char * ) malloc( length + 1 ) ) == NULL ){
+		error( "schedule: out of memory error" );
+	}
+	memcpy( source , header + size , length );
+	source[length] = '\0';
+	input->start += size + length;
+	input->length -= size + length;
+
+	// 固定スロットは待機中の仮想マシンに割り当てられるため、タスク側へ移す
+	if( ( program = loadServed( source , length , &task->hash , &task->hit ) ) == NULL ){
+		fputs( "schedule: illegal program\n" , stderr );
+		fputs( "illegal program\n" , task->writer );
+		task->state = TASK_CLOSING;
+		return true;
+	}
+	// 実行時間はタスクを切り替える時に確認するため、タイマーは設定しない
+	sliced = taskLimit;
+	sliced.milliseconds = 0;
+	setLimit( &sliced );
+	task->machine = *machine;
+	*machine = idle;
+	task->program = program;
+	task->machine.current = program;
+	task->machine.input = task->reader;
+	task->machine.output = task->writer;
+	task->machine.inputOffset = task->machine.outputOffset = 0;
+	task->state = TASK_RUNNABLE;
+	enqueue( task );
+	return true;
+}
+
+static void runTask( Task *task ){
+	Halt reason;
+	*machine = task->machine;
+	running = task;
+	if( 0 < taskLimit.milliseconds && taskLimit.milliseconds * 1000 < now() - task->start ){
+		reason = HALT_TIME;
+	}
+	else{
+		reason = executeGoverned( slice , machine->current );
+	}
+	if( reason != HALT_NONE ){
+		fprintf( stderr , "schedule: %016lx: " , task->hash );
+		reportHalt( reason );
+		task->state = TASK_CLOSING;
+	}
+	running = NULL;
+	task->machine = *machine;
+	*machine = idle;
+	if( ! sendTask( task ) || task->state == TASK_CLOSING ){
+		retire( task );
+	}
+	else if( task->state == TASK_RUNNABLE ){
+		if( SCHEDULE_OUTPUT_LIMIT < task->output.length ){
+			task->state = TASK_OUTPUT;
+		}
+		else{
+			enqueue( task );
+		}
+	}
+	if( task->state == TASK_CLOSING && task->output.length == 0 && ! task->queued ){
+		destroyTask( task );
+		return;
+	}
+	watch( task );
+	return;
+}
+
+static void slice( Instruction *instruction ){
+	Instruction *current;
+	long count;
+	machine->current = instruction;
+	for( count = 0 ; count < quantum ; count++ ){
+		if( ( current = machine->current ) == NULL ){
+			if( machine->callPointer == 0 ){
+				running->state = TASK_CLOSING;
+				return;
+			}
+			machine->current = machine->calls[--machine->callPointer];
+			continue;
+		}
+		if( ! isReady( running , current ) ){
+			running->state = TASK_INPUT;
+			return;
+		}
+		if( baseProcess( current ) ){
+			running->state = TASK_CLOSING;
+			return;
+		}
+	}
+	return;
+}
+
+static bool isReady( Task *task , Instruction *instruction ){
+	Buffer *input = &task->input;
+	if( instruction == NULL || instruction->imp != IO || task->end ){
+		return true;
+	}
+	switch( instruction->c_io ){
+		case GET_CHAR:
+			return 0 < input->length;
+
+		case GET_NUMBER:
+			// fgets が読み込む最大の長さに達していれば改行が無くても読み込める
+			return BUFFER_SIZE - 2 <= input->length || memchr( input->data + input->start , '\n' , input->length ) != NULL;
+
+		default:
+			return true;
+	}
+}
+
+static void retire( Task *task ){
+	if( task->reader == NULL ){
+		return;
+	}
+	*machine = task->machine;
+	stackClear();
+	heapClear();
+	*machine = idle;
+	fclose( task->reader );
+	fclose( task->writer );
+	task->reader = task->writer = NULL;
+	task->state = TASK_CLOSING;
+	finishServed( task->program , task->hash , task->hit , now() - task->start );
+	return;
+}
+
+static void destroyTask( Task *task ){
+	if( task->reader != NULL ){
+		// プログラムを受け取る前に閉じた接続
+		fclose( task->reader );
+		fclose( task->writer );
+	}
+	epoll_ctl( poller , EPOLL_CTL_DEL , task->descriptor , NULL );
+	close( task->descriptor );
+	free( task->input.data );
+	free( task->output.data );
+	free( task );
+	return;
+}
+
+static void enqueue( Task *task ){
+	if( task->queued ){
+		return;
+	}
+	task->queued = true;
+	task->next = NULL;
+	if( queueTail != NULL ){
+		queueTail->next = task;
+	}
+	else{
+		queueHead = task;
+	}
+	queueTail = task;
+	queueLength++;
+	return;
+}
+
+static Task *dequeue( void ){
+	Task *task = queueHead;
+	if( ( queueHead = task->next ) == NULL ){
+		queueTail = NULL;
+	}
+	task->queued = false;
+	queueLength--;
+	return task;
+}
+
+static void watch( Task *task ){
+	struct epoll_event event;
+	unsigned int events = 0;
+	if( ! task->end && ( task->input.length < ( task->state == TASK_REQUEST ? SCHEDULE_REQUEST_LIMIT : SCHEDULE_INPUT_LIMIT ) ) ){
+		events |= EPOLLIN;
+	}
+	if( 0 < task->output.length ){
+		events |= EPOLLOUT;
+	}
+	if( task->events == events ){
+		return;
+	}
+	memset( &event , 0 , sizeof( event ) );
+	event.events = task->events = events;
+	event.data.ptr = task;
+	epoll_ctl( poller , EPOLL_CTL_MOD , task->descriptor , &event );
+	return;
+}
+
+static void receiveTask( Task *task ){
+	Buffer *input = &task->input;
+	ssize_t size;
+	while( ! task->end && ( input->length < ( task->state == TASK_REQUEST ? SCHEDULE_REQUEST_LIMIT : SCHEDULE_INPUT_LIMIT ) ) ){
+		reserveBuffer( input , BUFFER_SIZE );
+		if( ( size = read( task->descriptor , input->data + input->start + input->length , BUFFER_SIZE ) ) > 0 ){
+			input->length += size;
+		}
+		else if( size < 0 && errno == EINTR ){
+			continue;
+		}
+		else if( size < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ){
+			break;
+		}
+		else{
+			task->end = true;
+		}
+	}
+	return;
+}
+
+static bool sendTask( Task *task ){
+	Buffer *output = &task->output;
+	ssize_t size;
+	while( 0 < output->length ){
+		if( ( size = write( task->descriptor , output->data + output->start , output->length ) ) >= 0 ){
+			output->start += size;
+			output->length -= size;
+		}
+		else if( errno == EINTR ){
+			continue;
+		}
+		else if( errno == EAGAIN || errno == EWOULDBLOCK ){
+			return true;
+		}
+		else{
+			output->start = output->length = 0;
+			return false;
+		}
+	}
+	output->start = 0;
+	return true;
+}
+
+static void reserveBuffer( Buffer *buffer , size_t size ){
+	if( buffer->allocation < buffer->start + buffer->length + size ){
+		if( 0 < buffer->start ){
+			memmove( buffer->data , buffer->data + buffer->start , buffer->length );
+			buffer->start = 0;
+		}
+		if( buffer->allocation < buffer->length + size ){
+			buffer->allocation = ( buffer->length + size ) * 2;
+			if( ( buffer->data = ( char * ) realloc( buffer->data , buffer->allocation ) ) == NULL ){
+				error( "schedule: out of memory error" );
+			}
+		}
+	}
+	return;
+}
+
+static ssize_t readTask( void *cookie , char *data , size_t size ){
+	Buffer *input = &( ( Task * ) cookie )->input;
+	if( input->length < size ){
+		size = input->length;
+	}
+	memcpy( data , input->data + input->start , size );
+	input->start += size;
+	input->length -= size;
+	return size;
+}
+
+static ssize_t writeTask( void *cookie , const char *data , size_t size ){
+	Buffer *output = &( ( Task * ) cookie )->output;
+	reserveBuffer( output , size );
+	memcpy( output->data + output->start + output->length , data , size );
+	output->length += size;
+	return size;
+}
+
+static long now( void ){
+	struct timespec time;
+	clock_gettime( CLOCK_MONOTONIC , &time );
+	return time.tv_sec * 1000000L + time.tv_nsec / 1000;
+}
+
+#else
+
+void schedule( int listener , long count , Limit *limit ){
+	error( "schedule: not supported on this platform" );
+}
+
+#endif
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	exit( EXIT_FAILURE );
+}
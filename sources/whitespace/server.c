@@ -0,0 +1,658 @@
+//
+//  server.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "whitespace.h"
+
+/**
+ * 接続を待ち受ける数
+ */
+#define SERVER_BACKLOG 64
+
+/**
+ * ワーカーの最大数
+ */
+#define SERVER_WORKER_LIMIT 256
+
+/**
+ * ワーカーが保持する命令セットの最大数
+ * 超えた場合は最も長く使用していない命令セットから開放する
+ */
+#define SERVER_CACHE_LIMIT 256
+
+/**
+ * 保持している命令セットをハッシュ値で引くための表の大きさ
+ */
+#define SERVER_CACHE_BUCKETS 512
+
+/**
+ * ワーカーが保持している命令セット
+ */
+struct cached{
+	unsigned long hash;		// ソースコードのハッシュ値
+	char *source;			// ソースコード
+	size_t length;			// ソースコードのバイト数
+	Instruction *program;	// 命令セット
+	long *addresses;		// 固定スロットに割り当てたアドレス
+	int count;				// 固定スロットの数
+	int users;				// 命令セットを実行している要求の数
+	struct cached *chain;	// ハッシュ値で引くための表の同じ位置の次の命令セット
+	struct cached *newer;	// 次に使用した命令セット
+	struct cached *older;	// 前に使用した命令セット
+} typedef Cached;
+
+/**
+ * 全ワーカーで共有する統計
+ */
+struct{
+	long requests;			// 処理した要求の数
+	long hits;				// 保持していた命令セットを使用した要求の数
+	long microseconds;		// 要求の処理に掛かった時間の合計
+} typedef Statistics;
+
+/**
+ * 実行時の設定
+ */
+static struct{
+	const char *engine;		// 実行方式
+	bool optimize;			// 最適化を行うかどうか
+	int budget;				// サブルーチンを展開する命令数の上限
+	long quantum;			// 接続を切り替えながら実行する場合に1回に実行する命令数
+	Limit limit;			// 要求毎の資源の上限
+} setting;
+
+/**
+ * 保持している命令セットをハッシュ値で引くための表
+ */
+static Cached *buckets[SERVER_CACHE_BUCKETS];
+
+/**
+ * 最後に使用した命令セット
+ */
+static Cached *newest = NULL;
+
+/**
+ * 最も長く使用していない命令セット
+ */
+static Cached *oldest = NULL;
+
+/**
+ * 保持している命令セットの数
+ */
+static int cacheCount = 0;
+
+/**
+ * 全ワーカーで共有する統計
+ */
+static Statistics *statistics = NULL;
+
+/**
+ * 終了が要求されている場合に 0 以外
+ */
+static volatile sig_atomic_t stopping = 0;
+
+/**
+ * 終了の要求を受ける
+ * @param number
+ *	シグナル番号
+ */
+static void handler( int number );
+
+/**
+ * ワーカーを起動する
+ * @param listener
+ *	接続を待ち受けるソケット
+ * @return
+ *	ワーカーのプロセス ID
+ */
+static pid_t spawn( int listener );
+
+/**
+ * 接続を受け付けて要求を処理し続ける
+ * @param listener
+ *	接続を待ち受けるソケット
+ */
+static void work( int listener );
+
+/**
+ * 1つの要求を処理する
+ * 先頭行にプログラムのバイト数、続けてプログラム、以降はプログラムの入力として受け取る
+ * プログラムの出力はそのまま接続に書き込む
+ * @param connection
+ *	接続したソケット
+ */
+static void serveRequest( int connection );
+
+/**
+ * 命令セットを取得する
+ * 保持していない場合は作成して保持する
+ * @param source
+ *	ソースコード
+ * @param length
+ *	ソースコードのバイト数
+ * @param hit
+ *	保持していた命令セットを使用した場合に true が格納される
+ * @return
+ *	命令セット 作成できなかった場合は NULL
+ */
+static Cached *getCached( char *source , size_t length , bool *hit );
+
+/**
+ * 命令セットを最後に使用したものとして使用順の列に繋ぐ
+ * @param cached
+ *	命令セット
+ */
+static void touchCached( Cached *cached );
+
+/**
+ * 命令セットを使用順の列とハッシュ値で引くための表から外す
+ * @param cached
+ *	命令セット
+ */
+static void unlinkCached( Cached *cached );
+
+/**
+ * 保持している命令セットが上限を超えている間、実行していない中で最も長く使用していないものを開放する
+ */
+static void evictCached( void );
+
+/**
+ * ソースコードのハッシュ値を求める
+ * @param source
+ *	ソースコード
+ * @param length
+ *	ソースコードのバイト数
+ * @return
+ *	ハッシュ値
+ */
+static unsigned long hash( const char *source , size_t length );
+
+/**
+ * 単調増加する時刻をマイクロ秒で取得する
+ * @return
+ *	時刻
+ */
+static long now( void );
+
+/**
+ * 接続先ソケットのアドレスを設定する
+ * @param address
+ *	設定するアドレス
+ * @param path
+ *	ソケットのパス
+ */
+static void setAddress( struct sockaddr_un *address , const char *path );
+
+/**
+ * 全てのデータを書き込む
+ * @param descriptor
+ *	書き込み先
+ * @param data
+ *	書き込むデータ
+ * @param size
+ *	書き込むバイト数
+ * @return
+ *	書き込みに成功した場合に true を返す
+ */
+static bool writeAll( int descriptor , const char *data , size_t size );
+
+/**
+ * エラーメッセージを表示してプログラムを終了する
+ * @param message
+ *	表示するメッセージ
+ */
+static void error( char *message );
+
+
+
+int serve( const char *path , int workers , const char *engine , bool optimize , int budget , long quantum , Limit *limit ){
+	struct sockaddr_un address;
+	struct sigaction action;
+	pid_t pids[SERVER_WORKER_LIMIT] , pid;
+	int listener , index;
+
+	if( workers < 1 || SERVER_WORKER_LIMIT < workers ){
+		error( "server: illegal worker count" );
+	}
+	setting.engine = engine;
+	setting.optimize = optimize;
+	setting.budget = budget;
+	setting.quantum = quantum;
+	setting.limit = *limit;
+	if( ( statistics = ( Statistics * ) mmap( NULL , sizeof( Statistics ) , PROT_READ | PROT_WRITE , MAP_SHARED | MAP_ANONYMOUS , -1 , 0 ) ) == MAP_FAILED ){
+		error( "server: out of memory error" );
+	}
+	memset( statistics , 0 , sizeof( Statistics ) );
+
+	setAddress( &address , path );
+	if( ( listener = socket( AF_UNIX , SOCK_STREAM , 0 ) ) < 0 ){
+		error( "server: socket error" );
+	}
+	unlink( path );
+	if( bind( listener , ( struct sockaddr * ) &address , sizeof( address ) ) != 0 || listen( listener , SERVER_BACKLOG ) != 0 ){
+		error( "server: bind error" );
+	}
+
+	memset( &action , 0 , sizeof( action ) );
+	action.sa_handler = handler;
+	sigemptyset( &action.sa_mask );
+	sigaction( SIGINT , &action , NULL );
+	sigaction( SIGTERM , &action , NULL );
+	signal( SIGPIPE , SIG_IGN );
+
+	for( index = 0 ; index < workers ; index++ ){
+		pids[index] = spawn( listener );
+	}
+	fprintf( stderr , "server: listening on %s with %d %s workers\n" , path , workers , 0 < quantum ? "scheduling" : "blocking" );
+	while( ! stopping ){
+		if( ( pid = wait( NULL ) ) < 0 ){
+			if( errno == EINTR ){
+				continue;
+			}
+			break;
+		}
+		for( index = 0 ; index < workers ; index++ ){
+			if( pids[index] == pid && ! stopping ){
+				fprintf( stderr , "server: worker %d exited , respawning\n" , ( int ) pid );
+				pids[index] = spawn( listener );
+			}
+		}
+	}
+
+	for( index = 0 ; index < workers ; index++ ){
+		kill( pids[index] , SIGTERM );
+	}
+	while( wait( NULL ) > 0 || errno == EINTR );
+	close( listener );
+	unlink( path );
+	fprintf( stderr , "server: %ld requests , hit rate %.1f%% , mean latency %.3f ms\n" ,
+		statistics->requests ,
+		statistics->requests == 0 ? 0.0 : 100.0 * statistics->hits / statistics->requests ,
+		statistics->requests == 0 ? 0.0 : statistics->microseconds / 1000.0 / statistics->requests );
+	munmap( statistics , sizeof( Statistics ) );
+	return EXIT_SUCCESS;
+}
+
+int connectServer( const char *path , FILE *file ){
+	struct sockaddr_un address;
+	struct pollfd polls[2];
+	char data[BUFFER_SIZE] , header[BUFFER_SIZE];
+	char *source = NULL;
+	size_t length = 0 , count;
+	ssize_t size;
+	int connection;
+
+	while( ( count = fread( data , sizeof( char ) , BUFFER_SIZE , file ) ) != 0 ){
+		if( ( source = ( char * ) realloc( source , length + count ) ) == NULL ){
+			error( "client: out of memory error" );
+		}
+		memcpy( source + length , data , count );
+		length += count;
+	}
+
+	setAddress( &address , path );
+	if( ( connection = socket( AF_UNIX , SOCK_STREAM , 0 ) ) < 0 ){
+		error( "client: socket error" );
+	}
+	if( connect( connection , ( struct sockaddr * ) &address , sizeof( address ) ) != 0 ){
+		error( "client: connect error" );
+	}
+	signal( SIGPIPE , SIG_IGN );
+	snprintf( header , sizeof( header ) , "%zu\n" , length );
+	if( ! writeAll( connection , header , strlen( header ) ) || ! writeAll( connection , source , length ) ){
+		error( "client: write error" );
+	}
+	free( source );
+
+	polls[0].fd = STDIN_FILENO;
+	polls[0].events = POLLIN;
+	polls[1].fd = connection;
+	polls[1].events = POLLIN;
+	while( true ){
+		if( poll( polls , 2 , -1 ) < 0 ){
+			if( errno == EINTR ){
+				continue;
+			}
+			error( "client: poll error" );
+		}
+		if( polls[0].revents & ( POLLIN | POLLHUP | POLLERR ) ){
+			if( ( size = read( STDIN_FILENO , data , sizeof( data ) ) ) <= 0 ){
+				shutdown( connection , SHUT_WR );
+				polls[0].fd = -1;
+			}
+			else if( ! writeAll( connection , data , size ) ){
+				polls[0].fd = -1;
+			}
+		}
+		if( polls[1].revents & ( POLLIN | POLLHUP | POLLERR ) ){
+			if( ( size = read( connection , data , sizeof( data ) ) ) <= 0 ){
+				break;
+			}
+			if( ! writeAll( STDOUT_FILENO , data , size ) ){
+				break;
+			}
+		}
+	}
+	close( connection );
+	return EXIT_SUCCESS;
+}
+
+static void handler( int number ){
+	stopping = 1;
+	return;
+}
+
+static pid_t spawn( int listener ){
+	pid_t pid;
+	if( ( pid = fork() ) < 0 ){
+		error( "server: fork error" );
+	}
+	if( pid == 0 ){
+		signal( SIGINT , SIG_IGN );
+		signal( SIGTERM , SIG_DFL );
+		if( 0 < setting.quantum ){
+			schedule( listener , setting.quantum , &setting.limit );
+		}
+		work( listener );
+		exit( EXIT_SUCCESS );
+	}
+	return pid;
+}
+
+static void work( int listener ){
+	int connection;
+	while( true ){
+		if( ( connection = accept( listener , NULL , NULL ) ) < 0 ){
+			if( errno == EINTR || errno == ECONNABORTED ){
+				continue;
+			}
+			error( "server: accept error" );
+		}
+		serveRequest( connection );
+	}
+	return;
+}
+
+static void serveRequest( int connection ){
+	Machine *machine = getMachine();
+	FILE *input , *output;
+	Instruction *program;
+	void ( *engine )( Instruction * ) = execute;
+	Halt reason;
+	char header[BUFFER_SIZE] , *source;
+	unsigned long value;
+	long start = now();
+	size_t length;
+	bool hit;
+
+	if( ( input = fdopen( connection , "r" ) ) == NULL || ( output = fdopen( dup( connection ) , "w" ) ) == NULL ){
+		error( "server: open connection error" );
+	}
+	if( fgets( header , sizeof( header ) , input ) == NULL || ( length = strtoul( header , NULL , 10 ) ) == 0 || SERVER_PROGRAM_LIMIT < length ){
+		fputs( "server: illegal request\n" , stderr );
+		fclose( output );
+		fclose( input );
+		return;
+	}
+	if( ( source = ( char * ) malloc( length + 1 ) ) == NULL ){
+		error( "server: out of memory error" );
+	}
+	if( fread( source , sizeof( char ) , length , input ) != length ){
+		fputs( "server: illegal request\n" , stderr );
+		free( source );
+		fclose( output );
+		fclose( input );
+		return;
+	}
+	source[length] = '\0';
+	if( ( program = loadServed( source , length , &value , &hit ) ) == NULL ){
+		fputs( "server: illegal program\n" , stderr );
+		fputs( "illegal program\n" , output );
+		fclose( output );
+		fclose( input );
+		return;
+	}
+
+	machine->inputOffset = machine->outputOffset = 0;
+	setStream( input , output );
+	// 資源の上限と中断を報告する際の経過時間は要求毎に数え直す
+	setLimit( &setting.limit );
+	if( strcmp( setting.engine , REGISTER_ENGINE ) == 0 ){
+		engine = executeRegister;
+	}
+	else if( strcmp( setting.engine , TRACE_ENGINE ) == 0 ){
+		engine = executeTrace;
+	}
+	else if( strcmp( setting.engine , CACHE_ENGINE ) == 0 ){
+		engine = executeCache;
+	}
+	// 実行時エラーでワーカーごと終了しないよう、中断した場合もこの要求だけを終える
+	if( ( reason = executeGoverned( engine , program ) ) != HALT_NONE ){
+		fprintf( stderr , "server: %016lx: " , value );
+		reportHalt( reason );
+	}
+	fflush( output );
+	fclose( output );
+	fclose( input );
+	finishServed( program , value , hit , now() - start );
+	return;
+}
+
+Instruction *loadServed( char *source , size_t length , unsigned long *value , bool *hit ){
+	Cached *cached = getCached( source , length , hit );
+	if( cached == NULL ){
+		return NULL;
+	}
+	cached->users++;
+	stackClear();
+	heapClear();
+	if( 0 < cached->count ){
+		setVariable( cached->addresses , cached->count );
+	}
+	*value = cached->hash;
+	return cached->program;
+}
+
+void finishServed( Instruction *program , unsigned long value , bool hit , long elapsed ){
+	Cached *cached;
+	long requests = __sync_add_and_fetch( &statistics->requests , 1 );
+	long hits = hit ? __sync_add_and_fetch( &statistics->hits , 1 ) : statistics->hits;
+	__sync_fetch_and_add( &statistics->microseconds , elapsed );
+	for( cached = buckets[value % SERVER_CACHE_BUCKETS] ; program != NULL && cached != NULL ; cached = cached->chain ){
+		if( cached->program == program ){
+			cached->users--;
+			break;
+		}
+	}
+	evictCached();
+	fprintf( stderr , "server: %016lx %s %.3f ms ( hit rate %.1f%% of %ld requests )\n" ,
+		value , hit ? "hit" : "miss" , elapsed / 1000.0 , 100.0 * hits / requests , requests );
+	return;
+}
+
+static Cached *getCached( char *source , size_t length , bool *hit ){
+	Machine *machine = getMachine();
+	Cached *cached;
+	jmp_buf escape;
+	unsigned long value = hash( source , length );
+	int address;
+	for( cached = buckets[value % SERVER_CACHE_BUCKETS] ; cached != NULL ; cached = cached->chain ){
+		if( cached->hash == value && cached->length == length && memcmp( cached->source , source , length ) == 0 ){
+			free( source );
+			touchCached( cached );
+			*hit = true;
+			return cached;
+		}
+	}
+	*hit = false;
+	if( ( cached = ( Cached * ) calloc( 1 , sizeof( Cached ) ) ) == NULL ){
+		error( "server: out of memory error" );
+	}
+	cached->hash = value;
+	cached->source = source;
+	cached->length = length;
+
+	heapClear();
+	setProgram( source , length + 1 );
+	// 不正なプログラムでワーカーごと終了しないよう、作成に失敗した場合はこの要求だけを断る
+	if( setjmp( escape ) != 0 ){
+		setRescue( NULL );
+		programClear();
+		free( source );
+		free( cached );
+		return NULL;
+	}
+	setRescue( &escape );
+	cached->program = getInstruction();
+	if( 0 < setting.budget ){
+		cached->program = inlineRoutine( cached->program , setting.budget );
+	}
+	if( setting.optimize ){
+		cached->program = foldConstant( cached->program );
+		cached->program = promoteHeap( cached->program );
+		cached->program = recognizeIdiom( cached->program );
+	}
+	cached->program = linkInstruction( cached->program );
+	setRescue( NULL );
+	programClear();
+
+	if( 0 < machine->variableCount ){
+		cached->count = machine->variableCount;
+		if( ( cached->addresses = ( long * ) malloc( sizeof( long ) * cached->count ) ) == NULL ){
+			error( "server: out of memory error" );
+		}
+		for( address = 0 ; address < machine->variableLimit ; address++ ){
+			if( 0 <= machine->variableAt[address] ){
+				cached->addresses[machine->variableAt[address]] = address;
+			}
+		}
+	}
+	cached->chain = buckets[value % SERVER_CACHE_BUCKETS];
+	buckets[value % SERVER_CACHE_BUCKETS] = cached;
+	cacheCount++;
+	touchCached( cached );
+	return cached;
+}
+
+static void touchCached( Cached *cached ){
+	if( newest == cached ){
+		return;
+	}
+	if( cached->older != NULL || oldest == cached ){
+		if( cached->older != NULL ){
+			cached->older->newer = cached->newer;
+		}
+		else{
+			oldest = cached->newer;
+		}
+		cached->newer->older = cached->older;
+	}
+	cached->older = newest;
+	cached->newer = NULL;
+	if( newest != NULL ){
+		newest->newer = cached;
+	}
+	else{
+		oldest = cached;
+	}
+	newest = cached;
+	return;
+}
+
+static void unlinkCached( Cached *cached ){
+	Cached **link = &buckets[cached->hash % SERVER_CACHE_BUCKETS];
+	while( *link != cached ){
+		link = &( *link )->chain;
+	}
+	*link = cached->chain;
+	if( cached->older != NULL ){
+		cached->older->newer = cached->newer;
+	}
+	else{
+		oldest = cached->newer;
+	}
+	if( cached->newer != NULL ){
+		cached->newer->older = cached->older;
+	}
+	else{
+		newest = cached->older;
+	}
+	cacheCount--;
+	return;
+}
+
+static void evictCached( void ){
+	Cached *cached = oldest , *newer;
+	while( SERVER_CACHE_LIMIT < cacheCount && cached != NULL ){
+		newer = cached->newer;
+		// 他の接続で実行している命令セットは開放しない
+		if( cached->users == 0 ){
+			unlinkCached( cached );
+			freeInstruction( cached->program );
+			free( cached->source );
+			free( cached->addresses );
+			free( cached );
+		}
+		cached = newer;
+	}
+	return;
+}
+
+static unsigned long hash( const char *source , size_t length ){
+	unsigned long value = 14695981039346656037UL;
+	while( length-- ){
+		value ^= ( unsigned char ) *source++;
+		value *= 1099511628211UL;
+	}
+	return value;
+}
+
+static long now( void ){
+	struct timespec time;
+	clock_gettime( CLOCK_MONOTONIC , &time );
+	return time.tv_sec * 1000000L + time.tv_nsec / 1000;
+}
+
+static void setAddress( struct sockaddr_un *address , const char *path ){
+	memset( address , 0 , sizeof( *address ) );
+	address->sun_family = AF_UNIX;
+	if( sizeof( address->sun_path ) <= strlen( path ) ){
+		error( "server: socket path too long" );
+	}
+	strcpy( address->sun_path , path );
+	return;
+}
+
+static bool writeAll( int descriptor , const char *data , size_t size ){
+	ssize_t written;
+	while( 0 < size ){
+		if( ( written = write( descriptor , data , size ) ) < 0 ){
+			if( errno == EINTR ){
+				continue;
+			}
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	exit( EXIT_FAILURE );
+}
@@ -9,208 +9,268 @@
 #include "whitespace.h"
 
 /**
- * 逆アセンブルしたスタック操作コマンドの表示を行う
- * @param instruction
- *	表示する命令
+ * 逆アセンブル結果を溜めておくバッファのサイズ
  */
-static void showStack( Instruction *instruction );
+#define SHOW_BUFFER_SIZE ( 64 * 1024 )
 
 /**
- * 逆アセンブルした演算コマンドの表示を行う
- * @param instruction
- *	表示する命令
+ * 1行に書き込む最大のバイト数
+ * ラベルは別途書き込むため含めない
  */
-static void showOperation( Instruction *instruction );
+#define SHOW_LINE_SIZE 128
 
 /**
- * 逆アセンブルしたヒープアクセスコマンドの表示を行う
- * @param instruction
- *	表示する命令
+ * 命令の通し番号の表示幅
  */
-static void showHeap( Instruction *instruction );
+#define SHOW_INDEX_WIDTH 7
 
 /**
- * 逆アセンブルしたフロー制御コマンドの表示を行う
- * @param instruction
- *	表示する命令
+ * 命令名の表示幅
+ * 最も長い命令名の後にも空白が1つ入るよう、最も長い命令名より1つ広くする
  */
-static void showFlowControl( Instruction *instruction );
+#define SHOW_NAME_WIDTH 10
 
 /**
- * 逆アセンブルした入出力コマンドの表示を行う
- * @param instruction
- *	表示する命令
+ * スタック操作コマンドの命令名
  */
-static void showIO( Instruction *instruction );
-
-
-
-void disassemble( Instruction *instruction ){
-	while( instruction != NULL ){
-		switch( instruction->imp ){
-			case STACK:
-				fprintf( stdout , "%-15s: " , "stack" );
-				showStack( instruction );
-				break;
-
-			case OPERATION:
-				fprintf( stdout , "%-15s: " , "operation" );
-				showOperation( instruction );
-				break;
-
-			case HEAP:
-				fprintf( stdout , "%-15s: " , "heap" );
-				showHeap( instruction );
-				break;
+static const char *stackNames[] = { "push" , "dup" , "copy" , "swap" , "drop" , "slide" };
 
-			case FLOW_CONTROL:
-				fprintf( stdout , "%-15s: " , "flow control" );
-				showFlowControl( instruction );
-				break;
+/**
+ * 演算コマンドの命令名
+ */
+static const char *operationNames[] = { "add" , "sub" , "mul" , "div" , "mod" };
 
-			case IO:
-				fprintf( stdout , "%-15s: " , "io" );
-				showIO( instruction );
-				break;
+/**
+ * ヒープアクセスコマンドの命令名
+ */
+static const char *heapNames[] = { "store" , "retrieve" , "storev" , "retrievev" , "blockfill" , "blockcopy" };
 
-			default:
-				break;
-		}
-		fputc( '\n' , stdout );
-		instruction = instruction->next;
-	}
-	return;
-}
+/**
+ * フロー制御コマンドの命令名
+ */
+static const char *controlNames[] = { "label" , "call" , "jmp" , "jz" , "jn" , "ret" , "end" , "tcall" };
 
-static void showStack( Instruction *instruction ){
-	switch( instruction->c_stack ){
-		case PUSH_NUMBER:
-			fprintf( stdout , "%-20s: 0x%08lx( %ld )" , "push number" , instruction->p_value , instruction->p_value );
-			break;
+/**
+ * 入出力コマンドの命令名
+ */
+static const char *ioNames[] = { "outc" , "outn" , "inc" , "inn" , "outs" };
 
-		case TOP_COPY:
-			fprintf( stdout , "%-20s" , "top copy" );
-			break;
+/**
+ * 逆アセンブル結果を溜めておくバッファ
+ */
+static char text[SHOW_BUFFER_SIZE];
 
-		case N_COPY:
-			fprintf( stdout , "%-20s: 0x%08lx( %ld )" , "n position copy" , instruction->p_value , instruction->p_value );
-			break;
+/**
+ * バッファに溜めているバイト数
+ */
+static size_t used = 0;
 
-		case PUSH_EXCHANGE:
-			fprintf( stdout , "%-20s" , "exchange" );
-			break;
+/**
+ * 逆アセンブル結果の書き込み先
+ */
+static FILE *stream = NULL;
 
-		case TOP_DESTRUCTION:
-			fprintf( stdout , "%-20s" , "top destruction" );
-			break;
+/**
+ * 1命令分の逆アセンブル結果をバッファに書き込む
+ * @param instruction
+ *	命令
+ */
+static void appendInstruction( Instruction *instruction );
 
-		case N_SLIDE:
-			fprintf( stdout , "%-20s: 0x%08lx( %ld ) " , "n slide and keep top" , instruction->p_value , instruction->p_value );
+/**
+ * 命令名を取得する
+ * @param instruction
+ *	命令
+ * @return
+ *	命令名 不明な命令の場合は NULL
+ */
+static const char *getName( Instruction *instruction );
 
-		default:
-			break;
-	}
-	return;
-}
+/**
+ * バッファに指定したバイト数を書き込めるだけの空きを作る
+ * @param size
+ *	書き込むバイト数
+ */
+static void reserve( size_t size );
 
+/**
+ * 文字列をバッファに書き込む
+ * @param value
+ *	書き込む文字列
+ * @param width
+ *	表示幅 足りない分は空白で埋める
+ */
+static void appendText( const char *value , int width );
 
-static void showOperation( Instruction *instruction ){
-	switch( instruction->c_operation ){
-		case ADDTION:
-			fprintf( stdout , "%-20s" , "addtion" );
-			break;
+/**
+ * 数値をバッファに書き込む
+ * @param value
+ *	書き込む数値
+ * @param width
+ *	表示幅 足りない分は左側を空白で埋める
+ */
+static void appendNumber( long value , int width );
 
-		case SUBTRACTION:
-			fprintf( stdout , "%-20s" , "subtraction" );
-			break;
+/**
+ * ラベルをバッファに書き込む
+ * 表示できない文字は \xNN の形式で書き込む
+ * @param label
+ *	書き込むラベル
+ */
+static void appendLabel( const char *label );
 
-		case MULTIPLICATION:
-			fprintf( stdout , "%-20s" , "multiplication" );
-			break;
+/**
+ * バッファに溜めた逆アセンブル結果を書き込む
+ */
+static void flush( void );
 
-		case DIVISION:
-			fprintf( stdout , "%-20s" , "division" );
-			break;
 
-		case MODULO:
-			fprintf( stdout , "%-20s" , "modulo" );
-			break;
 
-		default :
-			break;
+void disassemble( Instruction *instruction , FILE *output ){
+	Instruction *label;
+	stream = output;
+	used = 0;
+	for( ; instruction != NULL ; instruction = instruction->next ){
+		// 実行する命令の並びから取り除いたラベル定義も元の位置に書き込む
+		for( label = instruction->labels ; label != NULL && label != instruction ; label = label->next ){
+			appendInstruction( label );
+		}
+		appendInstruction( instruction );
 	}
+	flush();
+	fflush( stream );
 	return;
 }
 
-static void showHeap( Instruction *instruction ){
-	switch( instruction->c_heap ){
-		case TO_ADDRESS:
-			fprintf( stdout , "%-20s" , "to address" );
-			break;
+void writeLabel( const char *label , FILE *output ){
+	stream = output;
+	used = 0;
+	appendLabel( label );
+	flush();
+	return;
+}
 
-		case TO_STACK:
-			fprintf( stdout , "%-20s" , "to stack" );
-			break;
+void writeInstruction( Instruction *instruction , FILE *output ){
+	stream = output;
+	used = 0;
+	appendInstruction( instruction );
+	flush();
+	return;
+}
 
-		default:
-			break;
+static void appendInstruction( Instruction *instruction ){
+	const char *name;
+	reserve( SHOW_LINE_SIZE );
+	appendNumber( instruction->index , SHOW_INDEX_WIDTH );
+	appendText( "  " , 0 );
+	if( ( name = getName( instruction ) ) == NULL ){
+		appendText( "?" , 0 );
+	}
+	else if( instruction->imp == FLOW_CONTROL && instruction->p_label != NULL ){
+		appendText( name , SHOW_NAME_WIDTH );
+		appendLabel( instruction->p_label );
+		if( instruction->jump != NULL && instruction->c_control != LABEL_DEFINE ){
+			reserve( SHOW_LINE_SIZE );
+			appendText( " -> " , 0 );
+			appendNumber( instruction->jump->index , 0 );
+		}
+	}
+	else if( ( instruction->imp == STACK && ( instruction->c_stack == PUSH_NUMBER || instruction->c_stack == N_COPY || instruction->c_stack == N_SLIDE ) )
+	|| ( instruction->imp == HEAP && ( instruction->c_heap == TO_VARIABLE || instruction->c_heap == VARIABLE_TO_STACK ) ) ){
+		appendText( name , SHOW_NAME_WIDTH );
+		appendNumber( instruction->p_value , 0 );
+	}
+	else{
+		appendText( name , 0 );
 	}
+	text[used++] = '\n';
 	return;
 }
 
-static void showFlowControl( Instruction *instruction ){
-	switch( instruction->c_control ){
-		case LABEL_DEFINE:
-			fprintf( stdout , "%-20s: %s" , "label define" , instruction->p_label );
-			break;
+static const char *getName( Instruction *instruction ){
+	switch( instruction->imp ){
+		case STACK:
+			return instruction->c_stack <= N_SLIDE ? stackNames[instruction->c_stack] : NULL;
 
-		case CALL_ROUTINE:
-			fprintf( stdout , "%-20s: %s" , "call sub routine" , instruction->p_label );
-			break;
+		case OPERATION:
+			return instruction->c_operation <= MODULO ? operationNames[instruction->c_operation] : NULL;
 
-		case JUMP:
-			fprintf( stdout , "%-20s: %s" , "jump" , instruction->p_label );
-			break;
+		case HEAP:
+			return instruction->c_heap <= BLOCK_COPY ? heapNames[instruction->c_heap] : NULL;
 
-		case ZERO_JUMP:
-			fprintf( stdout , "%-20s: %s" , "if zero jump" , instruction->p_label );
-			break;
+		case FLOW_CONTROL:
+			return instruction->c_control <= TAIL_CALL ? controlNames[instruction->c_control] : NULL;
 
-		case MINUS_JUMP:
-			fprintf( stdout , "%-20s: %s" , "if minus jump" , instruction->p_label );
-			break;
+		case IO:
+			return instruction->c_io <= PUT_STRING ? ioNames[instruction->c_io] : NULL;
 
-		case END_ROUTINE:
-			fprintf( stdout , "%-20s" , "end sub routine" );
-			break;
+		default:
+			return NULL;
+	}
+}
 
-		case FINISH:
-			fprintf( stdout , "%-20s" , "finish" );
-			break;
+static void reserve( size_t size ){
+	if( SHOW_BUFFER_SIZE - used < size ){
+		flush();
 	}
 	return;
 }
 
-static void showIO( Instruction *instruction ){
-	switch( instruction->c_io ){
-		case PUT_CHAR:
-			fprintf( stdout , "%-20s" , "put charactor" );
-			break;
-
-		case PUT_NUMBER:
-			fprintf( stdout , "%-20s" , "put number" );
-			break;
+static void appendText( const char *value , int width ){
+	while( *value != '\0' ){
+		text[used++] = *value++;
+		width--;
+	}
+	while( 0 < width-- ){
+		text[used++] = ' ';
+	}
+	return;
+}
 
-		case GET_CHAR:
-			fprintf( stdout , "%-20s" , "get charactor" );
-			break;
+static void appendNumber( long value , int width ){
+	char digits[24];
+	unsigned long magnitude = value < 0 ? 0UL - ( unsigned long ) value : ( unsigned long ) value;
+	int count = 0;
+	do{
+		digits[count++] = ( char ) ( '0' + magnitude % 10 );
+		magnitude /= 10;
+	} while( magnitude != 0 );
+	if( value < 0 ){
+		digits[count++] = '-';
+	}
+	while( count < width-- ){
+		text[used++] = ' ';
+	}
+	while( 0 < count ){
+		text[used++] = digits[--count];
+	}
+	return;
+}
 
-		case GET_NUMBER:
-			fprintf( stdout , "%-20s" , "get number" );
-			break;
+static void appendLabel( const char *label ){
+	static const char hexadecimal[] = "0123456789abcdef";
+	unsigned char character;
+	for( ; *label != '\0' ; label++ ){
+		reserve( 4 );
+		character = ( unsigned char ) *label;
+		if( 0x20 < character && character < 0x7F && character != '\\' ){
+			text[used++] = ( char ) character;
+		}
+		else{
+			text[used++] = '\\';
+			text[used++] = 'x';
+			text[used++] = hexadecimal[character >> 4];
+			text[used++] = hexadecimal[character & 0x0F];
+		}
+	}
+	reserve( SHOW_LINE_SIZE );
+	return;
+}
 
-		default:
-			break;
+static void flush( void ){
+	if( 0 < used ){
+		fwrite( text , sizeof( char ) , used , stream );
+		used = 0;
 	}
 	return;
 }
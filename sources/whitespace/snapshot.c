@@ -0,0 +1,480 @@
+//
+//  snapshot.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "whitespace.h"
+
+/**
+ * スナップショットファイルの識別子
+ */
+#define SNAPSHOT_MAGIC "KWSSNAP1"
+
+/**
+ * スタックとヒープを配置するファイル位置の境界
+ * ページサイズの異なる環境でもそのまま割り当てられるように大きめに取る
+ */
+#define SNAPSHOT_ALIGNMENT 65536
+
+/**
+ * スナップショットファイルの先頭に書き込む情報
+ * 各領域の位置はファイル先頭からのバイト数で保持する
+ */
+struct{
+	char magic[8];				// スナップショットファイルの識別子
+	unsigned long hash;			// 命令セットのハッシュ値
+	long instructionCount;		// 命令数
+	long current;				// 次に実行する命令の通し番号 命令が無い場合は -1
+	long callCount;				// 呼び出しスタックに積まれた戻り先の個数
+	long stackCount;			// スタックに積まれた値の個数
+	long heapCount;				// ヒープの値の個数
+	long variableCount;			// 固定スロットの数
+	long inputOffset;			// プログラムが入力から読み込んだバイト数
+	long outputOffset;			// プログラムが出力に書き込んだバイト数
+	long callPosition;			// 呼び出しスタックの位置
+	long variablePosition;		// 固定スロットの位置
+	long stackPosition;			// スタックの位置
+	long heapPosition;			// ヒープの位置
+} typedef SnapshotHeader;
+
+/**
+ * 命令の通し番号から命令を引くための表
+ */
+static Instruction **instructions = NULL;
+
+/**
+ * 命令数
+ */
+static long instructionCount = 0;
+
+/**
+ * 命令セットのハッシュ値
+ */
+static unsigned long programHash = 0;
+
+/**
+ * スナップショットを書き込むファイルのパス
+ */
+static const char *snapshotPath = NULL;
+
+/**
+ * スナップショットを書き込む命令数の間隔
+ * 0 の場合はシグナルを受けた時のみ書き込む
+ */
+static long snapshotInterval = 0;
+
+/**
+ * シグナルによりスナップショットの書き込みが要求されている場合に 0 以外
+ */
+static volatile sig_atomic_t requested = 0;
+
+/**
+ * スナップショットを書き込んだ後に終了する場合に 0 以外
+ */
+static volatile sig_atomic_t terminated = 0;
+
+/**
+ * スナップショットの書き込みを要求するシグナルを受ける
+ * @param number
+ *	シグナル番号
+ */
+static void handler( int number );
+
+/**
+ * 現在の実行状態をスナップショットファイルに書き込み、終了が要求されている場合は終了する
+ */
+static void checkpoint( void );
+
+/**
+ * 入力を待っている間にシグナルを受けた場合に、要求されていればスナップショットを書き込む
+ * 入力命令を実行する前の状態を書き込むため、復元すると同じ入力命令から読み直す
+ */
+static void interrupt( void );
+
+/**
+ * 命令セットのハッシュ値を求める
+ * 命令の種類・パラメータ・分岐先を命令の並び順に取り込む
+ * @return
+ *	ハッシュ値
+ */
+static unsigned long hash( void );
+
+/**
+ * ハッシュ値にバイト列を取り込む
+ * @param value
+ *	取り込む前のハッシュ値
+ * @param data
+ *	取り込むバイト列
+ * @param size
+ *	取り込むバイト数
+ * @return
+ *	取り込んだ後のハッシュ値
+ */
+static unsigned long mix( unsigned long value , const void *data , size_t size );
+
+/**
+ * 命令の通し番号を取得する
+ * @param instruction
+ *	命令
+ * @return
+ *	通し番号 命令が無い場合は -1
+ */
+static long getIndex( Instruction *instruction );
+
+/**
+ * 現在の実行状態をスナップショットファイルに書き込む
+ * 一時ファイルに書き込んでから置き換えるため、途中で中断しても前回のスナップショットは残る
+ */
+static void writeSnapshot( void );
+
+/**
+ * ファイル位置を境界に揃える
+ * @param position
+ *	ファイル位置
+ * @return
+ *	境界に揃えたファイル位置
+ */
+static long align( long position );
+
+/**
+ * ファイルの指定した位置にデータを書き込む
+ * @param file
+ *	書き込むファイル
+ * @param position
+ *	書き込む位置
+ * @param data
+ *	書き込むデータ
+ * @param size
+ *	書き込むバイト数
+ * @return
+ *	書き込みに成功した場合に true を返す
+ */
+static bool writeAt( FILE *file , long position , const void *data , size_t size );
+
+/**
+ * スナップショットファイルの領域を割り当てる
+ * @param descriptor
+ *	スナップショットファイル
+ * @param position
+ *	領域の位置
+ * @param count
+ *	領域の値の個数
+ * @param mapped
+ *	割り当てたバイト数が格納される
+ * @return
+ *	割り当てた領域 値が無い場合は NULL
+ */
+static long *map( int descriptor , long position , long count , size_t *mapped );
+
+/**
+ * 入力からプログラムが読み込んだ分を読み飛ばす
+ * @param offset
+ *	読み飛ばすバイト数
+ */
+static void skipInput( long offset );
+
+/**
+ * エラーメッセージを表示してプログラムを終了する
+ * @param message
+ *	表示するメッセージ
+ */
+static void error( char *message );
+
+
+
+void setSnapshot( Instruction *instruction , const char *path , long interval ){
+	struct sigaction action;
+	Instruction *position;
+	long index = 0;
+	for( position = instruction ; position != NULL ; position = position->next ){
+		position->index = ( int ) index++;
+	}
+	instructionCount = index;
+	if( ( instructions = ( Instruction ** ) malloc( sizeof( Instruction * ) * ( instructionCount + 1 ) ) ) == NULL ){
+		error( "snapshot: out of memory error" );
+	}
+	for( position = instruction , index = 0 ; position != NULL ; position = position->next ){
+		instructions[index++] = position;
+	}
+	programHash = hash();
+	snapshotPath = path;
+	snapshotInterval = interval;
+	if( path != NULL ){
+		memset( &action , 0 , sizeof( action ) );
+		action.sa_handler = handler;
+		// 入力を待っている間も書き込めるよう、読み込みを再開させずに interrupt で処理する
+		action.sa_flags = 0;
+		sigemptyset( &action.sa_mask );
+		sigaction( SIGUSR1 , &action , NULL );
+		sigaction( SIGTERM , &action , NULL );
+		getMachine()->interrupt = interrupt;
+	}
+	return;
+}
+
+void executeSnapshot( Instruction *instruction ){
+	Machine *machine = getMachine();
+	long remain = snapshotInterval;
+	machine->current = instruction;
+	while( true ){
+		while( machine->current != NULL ){
+			if( snapshotPath != NULL && ( requested || ( 0 < snapshotInterval && --remain == 0 ) ) ){
+				checkpoint();
+				remain = snapshotInterval;
+			}
+			if( baseProcess( machine->current ) ){
+				return;
+			}
+		}
+		if( machine->callPointer == 0 ){
+			break;
+		}
+		machine->current = machine->calls[--machine->callPointer];
+	}
+	return;
+}
+
+Instruction *restoreSnapshot( const char *path ){
+	Machine *machine = getMachine();
+	SnapshotHeader header;
+	long index , *calls;
+	int descriptor;
+	if( ( descriptor = open( path , O_RDONLY ) ) < 0 ){
+		error( "snapshot: open file error" );
+	}
+	if( pread( descriptor , &header , sizeof( header ) , 0 ) != sizeof( header ) || memcmp( header.magic , SNAPSHOT_MAGIC , sizeof( header.magic ) ) != 0 ){
+		error( "snapshot: illegal snapshot file" );
+	}
+	if( header.hash != programHash || header.instructionCount != instructionCount || header.variableCount != machine->variableCount ){
+		error( "snapshot: snapshot does not match the program" );
+	}
+	if( header.current < -1 || instructionCount <= header.current ){
+		error( "snapshot: illegal snapshot file" );
+	}
+
+	stackClear();
+	machine->stack = map( descriptor , header.stackPosition , header.stackCount , &machine->stackMapped );
+	machine->stackAllocation = machine->stackMapped / sizeof( long );
+	machine->stackPointer = ( int ) header.stackCount;
+	if( machine->heap != NULL ){
+		free( machine->heap );
+	}
+	machine->heap = map( descriptor , header.heapPosition , header.heapCount , &machine->heapMapped );
+	machine->heapAllocation = machine->heapMapped / sizeof( long );
+
+	if( 0 < header.callCount ){
+		if( ( calls = ( long * ) malloc( sizeof( long ) * header.callCount ) ) == NULL ){
+			error( "snapshot: out of memory error" );
+		}
+		if( pread( descriptor , calls , sizeof( long ) * header.callCount , header.callPosition ) != sizeof( long ) * header.callCount ){
+			error( "snapshot: read file error" );
+		}
+		for( index = 0 ; index < header.callCount ; index++ ){
+			if( calls[index] < -1 || instructionCount <= calls[index] ){
+				error( "snapshot: illegal snapshot file" );
+			}
+			pushCall( calls[index] < 0 ? NULL : instructions[calls[index]] );
+		}
+		free( calls );
+	}
+	if( 0 < header.variableCount
+	&& pread( descriptor , machine->variables , sizeof( long ) * header.variableCount , header.variablePosition ) != sizeof( long ) * header.variableCount ){
+		error( "snapshot: read file error" );
+	}
+	close( descriptor );
+
+	skipInput( header.inputOffset );
+	machine->inputOffset = header.inputOffset;
+	machine->outputOffset = header.outputOffset;
+	fprintf( stderr , "snapshot: resume at instruction %ld ( input %ld bytes , output %ld bytes )\n" , header.current , header.inputOffset , header.outputOffset );
+	return header.current < 0 ? NULL : instructions[header.current];
+}
+
+void snapshotClear( void ){
+	if( instructions != NULL ){
+		free( instructions );
+		instructions = NULL;
+	}
+	instructionCount = 0;
+	snapshotPath = NULL;
+	getMachine()->interrupt = NULL;
+	return;
+}
+
+static void handler( int number ){
+	requested = 1;
+	if( number == SIGTERM ){
+		terminated = 1;
+	}
+	return;
+}
+
+static void checkpoint( void ){
+	writeSnapshot();
+	requested = 0;
+	if( terminated ){
+		fflush( getMachine()->output );
+		exit( EXIT_FAILURE );
+	}
+	return;
+}
+
+static void interrupt( void ){
+	if( requested ){
+		checkpoint();
+	}
+	return;
+}
+
+static unsigned long hash( void ){
+	unsigned long value = 14695981039346656037UL;
+	Instruction *instruction;
+	Idiom *idiom;
+	long index , jump , back;
+	for( index = 0 ; index < instructionCount ; index++ ){
+		instruction = instructions[index];
+		jump = getIndex( instruction->jump );
+		value = mix( value , &instruction->imp , sizeof( instruction->imp ) );
+		value = mix( value , &instruction->command , sizeof( instruction->command ) );
+		if( instruction->imp == FLOW_CONTROL && instruction->p_label != NULL ){
+			value = mix( value , instruction->p_label , strlen( instruction->p_label ) + 1 );
+		}
+		else if( ( instruction->imp == HEAP && ( instruction->c_heap == BLOCK_FILL || instruction->c_heap == BLOCK_COPY ) )
+		|| ( instruction->imp == IO && instruction->c_io == PUT_STRING ) ){
+			// 実行毎に変わる領域のアドレスではなく、ループの形を混ぜる
+			idiom = instruction->p_idiom;
+			back = getIndex( idiom->back );
+			value = mix( value , &idiom->depth , sizeof( idiom->depth ) );
+			value = mix( value , &idiom->counter , sizeof( idiom->counter ) );
+			value = mix( value , &idiom->counterOffset , sizeof( idiom->counterOffset ) );
+			value = mix( value , &idiom->step , sizeof( idiom->step ) );
+			value = mix( value , &idiom->negative , sizeof( idiom->negative ) );
+			value = mix( value , &idiom->destination , sizeof( idiom->destination ) );
+			value = mix( value , &idiom->destinationOffset , sizeof( idiom->destinationOffset ) );
+			value = mix( value , &idiom->copy , sizeof( idiom->copy ) );
+			value = mix( value , &idiom->source , sizeof( idiom->source ) );
+			value = mix( value , &idiom->sourceOffset , sizeof( idiom->sourceOffset ) );
+			value = mix( value , &back , sizeof( back ) );
+		}
+		else if( instruction->imp != FLOW_CONTROL ){
+			value = mix( value , &instruction->p_value , sizeof( instruction->p_value ) );
+		}
+		value = mix( value , &jump , sizeof( jump ) );
+	}
+	return value;
+}
+
+static unsigned long mix( unsigned long value , const void *data , size_t size ){
+	const unsigned char *byte = ( const unsigned char * ) data;
+	while( size-- ){
+		value ^= *byte++;
+		value *= 1099511628211UL;
+	}
+	return value;
+}
+
+static long getIndex( Instruction *instruction ){
+	return instruction == NULL ? -1 : instruction->index;
+}
+
+static void writeSnapshot( void ){
+	Machine *machine = getMachine();
+	SnapshotHeader header;
+	char temporary[BUFFER_SIZE];
+	long index , *calls = NULL;
+	FILE *file;
+	bool success;
+
+	memset( &header , 0 , sizeof( header ) );
+	memcpy( header.magic , SNAPSHOT_MAGIC , sizeof( header.magic ) );
+	header.hash = programHash;
+	header.instructionCount = instructionCount;
+	header.current = getIndex( machine->current );
+	header.callCount = machine->callPointer;
+	header.stackCount = machine->stackPointer;
+	header.heapCount = ( long ) machine->heapAllocation;
+	header.variableCount = machine->variableCount;
+	header.inputOffset = machine->inputOffset;
+	header.outputOffset = machine->outputOffset;
+	header.callPosition = sizeof( header );
+	header.variablePosition = header.callPosition + sizeof( long ) * header.callCount;
+	header.stackPosition = align( header.variablePosition + sizeof( long ) * header.variableCount );
+	header.heapPosition = align( header.stackPosition + sizeof( long ) * header.stackCount );
+
+	if( 0 < header.callCount ){
+		if( ( calls = ( long * ) malloc( sizeof( long ) * header.callCount ) ) == NULL ){
+			error( "snapshot: out of memory error" );
+		}
+		for( index = 0 ; index < header.callCount ; index++ ){
+			calls[index] = getIndex( machine->calls[index] );
+		}
+	}
+
+	snprintf( temporary , sizeof( temporary ) , "%s.tmp" , snapshotPath );
+	if( ( file = fopen( temporary , "wb" ) ) == NULL ){
+		error( "snapshot: open file error" );
+	}
+	success = writeAt( file , 0 , &header , sizeof( header ) )
+	&& writeAt( file , header.callPosition , calls , sizeof( long ) * header.callCount )
+	&& writeAt( file , header.variablePosition , machine->variables , sizeof( long ) * header.variableCount )
+	&& writeAt( file , header.stackPosition , machine->stack , sizeof( long ) * header.stackCount )
+	&& writeAt( file , header.heapPosition , machine->heap , sizeof( long ) * header.heapCount )
+	&& fflush( file ) == 0 && fsync( fileno( file ) ) == 0;
+	if( fclose( file ) != 0 || ! success || rename( temporary , snapshotPath ) != 0 ){
+		error( "snapshot: write file error" );
+	}
+	if( calls != NULL ){
+		free( calls );
+	}
+	fprintf( stderr , "snapshot: checkpoint at instruction %ld\n" , header.current );
+	return;
+}
+
+static long align( long position ){
+	return ( position + SNAPSHOT_ALIGNMENT - 1 ) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+static bool writeAt( FILE *file , long position , const void *data , size_t size ){
+	if( size == 0 ){
+		return true;
+	}
+	return fseek( file , position , SEEK_SET ) == 0 && fwrite( data , 1 , size , file ) == size;
+}
+
+static long *map( int descriptor , long position , long count , size_t *mapped ){
+	void *area;
+	if( count <= 0 ){
+		*mapped = 0;
+		return NULL;
+	}
+	if( position % SNAPSHOT_ALIGNMENT != 0 ){
+		error( "snapshot: illegal snapshot file" );
+	}
+	*mapped = sizeof( long ) * count;
+	if( ( area = mmap( NULL , *mapped , PROT_READ | PROT_WRITE , MAP_PRIVATE , descriptor , position ) ) == MAP_FAILED ){
+		error( "snapshot: map file error" );
+	}
+	return ( long * ) area;
+}
+
+static void skipInput( long offset ){
+	FILE *input = getMachine()->input;
+	if( offset <= 0 || fseek( input , offset , SEEK_CUR ) == 0 ){
+		return;
+	}
+	while( 0 < offset-- && fgetc( input ) != EOF );
+	return;
+}
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	exit( EXIT_FAILURE );
+}
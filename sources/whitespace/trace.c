@@ -0,0 +1,702 @@
+//
+//  trace.c
+//  whitespace
+//
+//  Created by kuroneko on 2026/10/19.
+//  Copyright (c) 2026年 kuroneko. All rights reserved.
+//
+
+#include "whitespace.h"
+
+/**
+ * 後方ジャンプ先へ何回ジャンプしたらトレースの記録を始めるか
+ */
+#define TRACE_THRESHOLD 64
+
+/**
+ * 1つのトレースに記録する命令数の上限
+ * 超えた場合は記録を諦め、そのジャンプ先は以後記録しない
+ */
+#define TRACE_LENGTH_LIMIT 512
+
+/**
+ * トレースの命令
+ */
+enum{
+	TRACE_PUSH ,					// 即値をスタックに積む
+	TRACE_DUPLICATE ,				// スタックの1個目の値を積む
+	TRACE_COPY ,					// スタックのn個目の値を積む
+	TRACE_SWAP ,					// スタックの1個目と2個目の値を入れ替える
+	TRACE_DROP ,					// スタックの1個目の値を削除する
+	TRACE_SLIDE ,					// スタックの1個目の値を残してn個取り除く
+	TRACE_ADDTION ,					// 足し算
+	TRACE_SUBTRACTION ,				// 引き算
+	TRACE_MULTIPLICATION ,			// 掛け算
+	TRACE_DIVISION ,				// 割り算
+	TRACE_MODULO ,					// 余剰
+	TRACE_ADDTION_CONSTANT ,		// 即値との足し算
+	TRACE_SUBTRACTION_CONSTANT ,	// 即値との引き算
+	TRACE_MULTIPLICATION_CONSTANT ,	// 即値との掛け算
+	TRACE_DIVISION_CONSTANT ,		// 即値との割り算
+	TRACE_MODULO_CONSTANT ,			// 即値との余剰
+	TRACE_HEAP_STORE ,				// ヒープに値を保存する
+	TRACE_HEAP_LOAD ,				// ヒープの値を積む
+	TRACE_HEAP_LOAD_CONSTANT ,		// 即値のアドレスのヒープの値を積む
+	TRACE_VARIABLE_STORE ,			// 固定スロットに値を保存する
+	TRACE_VARIABLE_LOAD ,			// 固定スロットの値を積む
+	TRACE_FALLBACK ,				// 元の命令をスタックマシンとして実行する
+	TRACE_GUARD_ZERO ,				// スタックの1個目が0でなければトレースを抜ける
+	TRACE_GUARD_NOT_ZERO ,			// スタックの1個目が0ならトレースを抜ける
+	TRACE_GUARD_MINUS ,				// スタックの1個目が負でなければトレースを抜ける
+	TRACE_GUARD_NOT_MINUS ,			// スタックの1個目が負ならトレースを抜ける
+	TRACE_CHARGE ,					// 分岐までに一続きに実行した命令数を消費する
+	TRACE_LOOP						// トレースの先頭に戻る
+} typedef TraceCode;
+
+/**
+ * トレースの命令を保持する構造体
+ */
+struct{
+	TraceCode code;				// トレースの命令
+	long value;					// 即値・スタックの位置・固定スロットの番号
+	Instruction *instruction;	// 元の命令 ガードが失敗した場合はこの命令から実行を続ける
+} typedef TraceInstruction;
+
+/**
+ * ループの先頭から先頭に戻るまでの経路を記録したトレース
+ */
+struct{
+	Instruction *head;			// ループの先頭の命令
+	TraceInstruction *code;		// トレースの命令列
+	int length;					// トレースの命令数
+	int need;					// 実行を始めるのに必要なスタックの値の個数
+	int grow;					// 実行中にスタックが伸びる値の個数の最大
+} typedef Trace;
+
+/**
+ * 命令の通し番号から、その命令で始まるトレースを引くための表
+ */
+static Trace **traces = NULL;
+
+/**
+ * 命令の通し番号毎の後方ジャンプ先になった回数
+ * 記録を諦めた命令は負の値になる
+ */
+static int *counters = NULL;
+
+/**
+ * 命令の総数
+ */
+static int instructionCount = 0;
+
+/**
+ * 記録中のトレースの先頭の命令
+ * 記録していない場合は NULL
+ */
+static Instruction *head = NULL;
+
+/**
+ * 記録中のトレースの命令列
+ */
+static TraceInstruction *buffer = NULL;
+
+/**
+ * 記録中のトレースの命令数
+ */
+static int bufferLength = 0;
+
+/**
+ * 記録中のトレースの命令列の確保サイズ
+ */
+static int bufferAllocation = 0;
+
+/**
+ * 実行中の仮想マシン
+ */
+static Machine *machine = NULL;
+
+/**
+ * 後方ジャンプ先の回数を数え、トレースがあれば実行する
+ * @param instruction
+ *	後方ジャンプ先の命令
+ */
+static void enter( Instruction *instruction );
+
+/**
+ * 実行した命令をトレースに記録する
+ * ループの先頭に戻った場合はトレースを完成させる
+ * @param instruction
+ *	実行した命令
+ */
+static void record( Instruction *instruction );
+
+/**
+ * トレースの命令を追加する
+ * 返した命令は次に emit を呼び出すまでの間だけ有効となる
+ * @param code
+ *	追加する命令
+ * @param instruction
+ *	元の命令
+ * @return
+ *	追加した命令
+ */
+static TraceInstruction *emit( TraceCode code , Instruction *instruction );
+
+/**
+ * 直前に記録した命令が即値を積む命令であれば取り除く
+ * @param value
+ *	取り除いた命令の即値が格納される
+ * @return
+ *	取り除いた場合に true を返す
+ */
+static bool takeConstant( long *value );
+
+/**
+ * 記録したトレースを完成させる
+ */
+static void finish( void );
+
+/**
+ * 記録を諦め、記録中のループの先頭は以後記録しない
+ */
+static void abandon( void );
+
+/**
+ * トレースを実行する
+ * ガードが失敗するかスタックが足りない場合に、Machine の current に続きの命令を設定して戻る
+ * @param trace
+ *	実行するトレース
+ */
+static void run( Trace *trace );
+
+/**
+ * 記録したトレースを破棄する
+ */
+static void clear( void );
+
+/**
+ * プログラムの実行時エラーを通知する
+ */
+static void error( char *message );
+
+
+
+void executeTrace( Instruction *instruction ){
+	Instruction *current , *position;
+	// 前回の実行が途中で中断されていても、記録途中のトレースを持ち越さない
+	clear();
+	machine = getMachine();
+	machine->discard = clear;
+	for( position = instruction ; position != NULL ; position = position->next ){
+		if( instructionCount <= position->index ){
+			instructionCount = position->index + 1;
+		}
+	}
+	traces = ( Trace ** ) calloc( instructionCount + 1 , sizeof( Trace * ) );
+	counters = ( int * ) calloc( instructionCount + 1 , sizeof( int ) );
+	if( traces == NULL || counters == NULL ){
+		error( "trace: out of memory error" );
+	}
+	machine->current = instruction;
+	while( true ){
+		while( ( current = machine->current ) != NULL ){
+			if( baseProcess( current ) ){
+				clear();
+				return;
+			}
+			if( head != NULL ){
+				record( current );
+			}
+			else if( current->imp == FLOW_CONTROL && current->jump != NULL && machine->current == current->jump && current->jump->index <= current->index
+			&& ( current->c_control == JUMP || current->c_control == ZERO_JUMP || current->c_control == MINUS_JUMP ) ){
+				enter( current->jump );
+			}
+		}
+		if( machine->callPointer == 0 ){
+			break;
+		}
+		machine->current = machine->calls[--machine->callPointer];
+	}
+	clear();
+	return;
+}
+
+static void enter( Instruction *instruction ){
+	if( traces[instruction->index] != NULL ){
+		run( traces[instruction->index] );
+	}
+	else if( 0 <= counters[instruction->index] && ++counters[instruction->index] == TRACE_THRESHOLD ){
+		head = instruction;
+		bufferLength = 0;
+	}
+	return;
+}
+
+static void record( Instruction *instruction ){
+	long value;
+	bool taken = machine->current == instruction->jump && instruction->jump != instruction->next;
+	switch( instruction->imp ){
+		case STACK:
+			switch( instruction->c_stack ){
+				case PUSH_NUMBER:
+					emit( TRACE_PUSH , instruction )->value = instruction->p_value;
+					break;
+
+				case TOP_COPY:
+					emit( TRACE_DUPLICATE , instruction );
+					break;
+
+				case N_COPY:
+					// FALL THROUGH
+
+				case N_SLIDE:
+					if( instruction->p_value < 0 ){
+						abandon();
+						return;
+					}
+					emit( instruction->c_stack == N_COPY ? TRACE_COPY : TRACE_SLIDE , instruction )->value = instruction->p_value;
+					break;
+
+				case PUSH_EXCHANGE:
+					emit( TRACE_SWAP , instruction );
+					break;
+
+				case TOP_DESTRUCTION:
+					emit( TRACE_DROP , instruction );
+					break;
+
+				default:
+					abandon();
+					return;
+			}
+			break;
+
+		case OPERATION:
+			// 即値を積んでからの演算は即値との演算にまとめる
+			if( takeConstant( &value ) ){
+				emit( TRACE_ADDTION_CONSTANT + instruction->c_operation , instruction )->value = value;
+			}
+			else{
+				emit( TRACE_ADDTION + instruction->c_operation , instruction );
+			}
+			break;
+
+		case HEAP:
+			switch( instruction->c_heap ){
+				case TO_ADDRESS:
+					emit( TRACE_HEAP_STORE , instruction );
+					break;
+
+				case TO_STACK:
+					if( takeConstant( &value ) ){
+						emit( TRACE_HEAP_LOAD_CONSTANT , instruction )->value = value;
+					}
+					else{
+						emit( TRACE_HEAP_LOAD , instruction );
+					}
+					break;
+
+				case TO_VARIABLE:
+					emit( TRACE_VARIABLE_STORE , instruction )->value = instruction->p_value;
+					break;
+
+				case VARIABLE_TO_STACK:
+					emit( TRACE_VARIABLE_LOAD , instruction )->value = instruction->p_value;
+					break;
+
+				case BLOCK_FILL:
+				case BLOCK_COPY:
+					emit( TRACE_FALLBACK , instruction );
+					break;
+
+				default:
+					abandon();
+					return;
+			}
+			break;
+
+		case IO:
+			emit( TRACE_FALLBACK , instruction );
+			break;
+
+		case FLOW_CONTROL:
+			switch( instruction->c_control ){
+				case LABEL_DEFINE:
+					break;
+
+				case JUMP:
+					taken = true;
+					break;
+
+				case ZERO_JUMP:
+					emit( taken ? TRACE_GUARD_ZERO : TRACE_GUARD_NOT_ZERO , instruction );
+					break;
+
+				case MINUS_JUMP:
+					emit( taken ? TRACE_GUARD_MINUS : TRACE_GUARD_NOT_MINUS , instruction );
+					break;
+
+				default:
+					// サブルーチンを跨ぐ経路は記録しない
+					abandon();
+					return;
+			}
+			if( taken && instruction->c_control != LABEL_DEFINE ){
+				emit( TRACE_CHARGE , instruction );
+			}
+			break;
+
+		default:
+			abandon();
+			return;
+	}
+	if( machine->current == head ){
+		finish();
+	}
+	else if( machine->current == NULL || TRACE_LENGTH_LIMIT <= bufferLength ){
+		abandon();
+	}
+	return;
+}
+
+static TraceInstruction *emit( TraceCode code , Instruction *instruction ){
+	if( bufferAllocation <= bufferLength ){
+		bufferAllocation += BUFFER_SIZE;
+		if( ( buffer = ( TraceInstruction * ) realloc( buffer , sizeof( TraceInstruction ) * bufferAllocation ) ) == NULL ){
+			error( "trace: out of memory error" );
+		}
+	}
+	TraceInstruction *trace = &buffer[bufferLength++];
+	trace->code = code;
+	trace->value = 0;
+	trace->instruction = instruction;
+	return trace;
+}
+
+static bool takeConstant( long *value ){
+	if( bufferLength == 0 || buffer[bufferLength - 1].code != TRACE_PUSH ){
+		return false;
+	}
+	*value = buffer[--bufferLength].value;
+	return true;
+}
+
+static void finish( void ){
+	Trace *trace;
+	TraceInstruction *code;
+	int depth = 0 , pops , pushes;
+	emit( TRACE_LOOP , head );
+	if( ( trace = ( Trace * ) calloc( 1 , sizeof( Trace ) ) ) == NULL
+	|| ( trace->code = ( TraceInstruction * ) malloc( sizeof( TraceInstruction ) * bufferLength ) ) == NULL ){
+		error( "trace: out of memory error" );
+	}
+	memcpy( trace->code , buffer , sizeof( TraceInstruction ) * bufferLength );
+	trace->length = bufferLength;
+	trace->head = head;
+	// 途中でスタックを確認しなくて済むよう、必要な値の個数と伸びる個数を求めておく
+	for( code = trace->code ; code->code != TRACE_LOOP ; code++ ){
+		switch( code->code ){
+			case TRACE_PUSH:
+			case TRACE_HEAP_LOAD_CONSTANT:
+			case TRACE_VARIABLE_LOAD:
+				pops = 0;
+				pushes = 1;
+				break;
+
+			case TRACE_DUPLICATE:
+				pops = 1;
+				pushes = 2;
+				break;
+
+			case TRACE_COPY:
+				pops = ( int ) code->value + 1;
+				pushes = pops + 1;
+				break;
+
+			case TRACE_SLIDE:
+				pops = ( int ) code->value + 1;
+				pushes = 1;
+				break;
+
+			case TRACE_SWAP:
+				pops = pushes = 2;
+				break;
+
+			case TRACE_ADDTION:
+			case TRACE_SUBTRACTION:
+			case TRACE_MULTIPLICATION:
+			case TRACE_DIVISION:
+			case TRACE_MODULO:
+				pops = 2;
+				pushes = 1;
+				break;
+
+			case TRACE_HEAP_STORE:
+				pops = 2;
+				pushes = 0;
+				break;
+
+			case TRACE_FALLBACK:
+				if( code->instruction->imp == HEAP || code->instruction->c_io == PUT_STRING ){
+					// まとめて実行する命令は深さを変えずにスタックの値を書き換える
+					pops = pushes = code->instruction->p_idiom->depth;
+				}
+				else{
+					pops = 1;
+					pushes = code->instruction->c_io == GET_CHAR || code->instruction->c_io == GET_NUMBER ? 1 : 0;
+				}
+				break;
+
+			case TRACE_DROP:
+			case TRACE_VARIABLE_STORE:
+			case TRACE_GUARD_ZERO:
+			case TRACE_GUARD_NOT_ZERO:
+			case TRACE_GUARD_MINUS:
+			case TRACE_GUARD_NOT_MINUS:
+				pops = 1;
+				pushes = 0;
+				break;
+
+			case TRACE_CHARGE:
+				pops = pushes = 0;
+				break;
+
+			default:
+				pops = pushes = 1;
+				break;
+		}
+		if( trace->need < pops - depth ){
+			trace->need = pops - depth;
+		}
+		depth += pushes - pops;
+		if( trace->grow < depth ){
+			trace->grow = depth;
+		}
+	}
+	traces[head->index] = trace;
+	head = NULL;
+	return;
+}
+
+static void abandon( void ){
+	counters[head->index] = -1;
+	head = NULL;
+	return;
+}
+
+static void run( Trace *trace ){
+	TraceInstruction *code;
+	long *stack , value;
+	int pointer = machine->stackPointer;
+	while( true ){
+		// 足りない場合は元の命令で実行し、スタックの拡張やエラーはスタックマシンに任せる
+		if( pointer < trace->need || machine->stackAllocation < pointer + trace->grow ){
+			machine->current = trace->head;
+			return;
+		}
+		stack = machine->stack;
+		for( code = trace->code ; ; code++ ){
+			switch( code->code ){
+				case TRACE_PUSH:
+					stack[pointer++] = code->value;
+					continue;
+
+				case TRACE_DUPLICATE:
+					stack[pointer] = stack[pointer - 1];
+					pointer++;
+					continue;
+
+				case TRACE_COPY:
+					stack[pointer] = stack[pointer - code->value - 1];
+					pointer++;
+					continue;
+
+				case TRACE_SWAP:
+					value = stack[pointer - 1];
+					stack[pointer - 1] = stack[pointer - 2];
+					stack[pointer - 2] = value;
+					continue;
+
+				case TRACE_DROP:
+					pointer--;
+					continue;
+
+				case TRACE_SLIDE:
+					value = stack[pointer - 1];
+					pointer -= ( int ) code->value;
+					stack[pointer - 1] = value;
+					continue;
+
+				case TRACE_ADDTION:
+					pointer--;
+					stack[pointer - 1] += stack[pointer];
+					continue;
+
+				case TRACE_SUBTRACTION:
+					pointer--;
+					stack[pointer - 1] -= stack[pointer];
+					continue;
+
+				case TRACE_MULTIPLICATION:
+					pointer--;
+					stack[pointer - 1] *= stack[pointer];
+					continue;
+
+				case TRACE_DIVISION:
+					pointer--;
+					stack[pointer - 1] /= stack[pointer];
+					continue;
+
+				case TRACE_MODULO:
+					pointer--;
+					stack[pointer - 1] %= stack[pointer];
+					continue;
+
+				case TRACE_ADDTION_CONSTANT:
+					stack[pointer - 1] += code->value;
+					continue;
+
+				case TRACE_SUBTRACTION_CONSTANT:
+					stack[pointer - 1] -= code->value;
+					continue;
+
+				case TRACE_MULTIPLICATION_CONSTANT:
+					stack[pointer - 1] *= code->value;
+					continue;
+
+				case TRACE_DIVISION_CONSTANT:
+					stack[pointer - 1] /= code->value;
+					continue;
+
+				case TRACE_MODULO_CONSTANT:
+					stack[pointer - 1] %= code->value;
+					continue;
+
+				case TRACE_HEAP_STORE:
+					pointer -= 2;
+					machine->stackPointer = pointer;
+					setHeapValue( ( int ) stack[pointer] , stack[pointer + 1] );
+					continue;
+
+				case TRACE_HEAP_LOAD:
+					machine->stackPointer = pointer;
+					stack[pointer - 1] = getHeapValue( ( int ) stack[pointer - 1] );
+					continue;
+
+				case TRACE_HEAP_LOAD_CONSTANT:
+					machine->stackPointer = pointer;
+					stack[pointer++] = getHeapValue( ( int ) code->value );
+					continue;
+
+				case TRACE_VARIABLE_STORE:
+					if( machine->heapAllocation < machine->variableLimit ){
+						machine->stackPointer = pointer;
+						setVariableValue( code->value , stack[--pointer] );
+					}
+					else{
+						machine->variables[code->value] = stack[--pointer];
+					}
+					continue;
+
+				case TRACE_VARIABLE_LOAD:
+					if( machine->heapAllocation < machine->variableLimit ){
+						machine->stackPointer = pointer;
+						stack[pointer++] = getVariableValue( code->value );
+					}
+					else{
+						stack[pointer++] = machine->variables[code->value];
+					}
+					continue;
+
+				case TRACE_FALLBACK:
+					machine->stackPointer = pointer;
+					baseProcess( code->instruction );
+					pointer = machine->stackPointer;
+					stack = machine->stack;
+					continue;
+
+				case TRACE_GUARD_ZERO:
+					if( stack[pointer - 1] != 0 ){
+						break;
+					}
+					pointer--;
+					continue;
+
+				case TRACE_GUARD_NOT_ZERO:
+					if( stack[pointer - 1] == 0 ){
+						break;
+					}
+					pointer--;
+					continue;
+
+				case TRACE_GUARD_MINUS:
+					if( 0 <= stack[pointer - 1] ){
+						break;
+					}
+					pointer--;
+					continue;
+
+				case TRACE_GUARD_NOT_MINUS:
+					if( stack[pointer - 1] < 0 ){
+						break;
+					}
+					pointer--;
+					continue;
+
+				case TRACE_CHARGE:
+					if( machine->governed ){
+						machine->stackPointer = pointer;
+						chargeFuel( code->instruction , code->instruction->jump );
+					}
+					continue;
+
+				case TRACE_LOOP:
+					break;
+
+				default:
+					error( "trace: illegal code" );
+					break;
+			}
+			break;
+		}
+		if( code->code != TRACE_LOOP ){
+			// ガードが失敗した分岐命令は値を残したままスタックマシンで実行し直す
+			machine->stackPointer = pointer;
+			machine->current = code->instruction;
+			return;
+		}
+		machine->stackPointer = pointer;
+	}
+}
+
+static void clear( void ){
+	int index;
+	if( traces != NULL ){
+		for( index = 0 ; index < instructionCount ; index++ ){
+			if( traces[index] != NULL ){
+				free( traces[index]->code );
+				free( traces[index] );
+			}
+		}
+		free( traces );
+		traces = NULL;
+	}
+	if( counters != NULL ){
+		free( counters );
+		counters = NULL;
+	}
+	instructionCount = 0;
+	if( buffer != NULL ){
+		free( buffer );
+		buffer = NULL;
+	}
+	bufferLength = bufferAllocation = 0;
+	head = NULL;
+	return;
+}
+
+static void error( char *message ){
+	fputs( message , stderr );
+	fputc( '\n' , stderr );
+	halt( HALT_ERROR );
+}
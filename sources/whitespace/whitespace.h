@@ -13,23 +13,237 @@
 	#include <stdlib.h>
 	#include <string.h>
 	#include <stdbool.h>
+	#include <setjmp.h>
 
 	/**
 	 * ファイル読込時のオプション
 	 */
 	#define FILE_OPTION "-f"
 
+	/**
+	 * 命令セットを最適化してから実行するオプション
+	 */
+	#define OPTIMIZE_OPTION "--optimize"
+
+	/**
+	 * 小さなサブルーチンを呼び出し箇所に展開するオプション
+	 * --inline=<展開するサブルーチンの命令数の上限> の形式で指定する
+	 */
+	#define INLINE_OPTION "--inline="
+
+	/**
+	 * 逆アセンブル結果を標準出力に書き込み、プログラムは実行しないオプション
+	 */
+	#define DISASSEMBLE_OPTION "--disassemble"
+
+	/**
+	 * 逆アセンブル結果をファイルに書き込んでからプログラムを実行するオプション
+	 * --disassemble=<ファイル> の形式で指定する
+	 */
+	#define DISASSEMBLE_FILE_OPTION "--disassemble="
+
+	/**
+	 * 読込みや実行の経過を標準エラー出力に表示するオプション
+	 */
+	#define VERBOSE_OPTION "--verbose"
+
+	/**
+	 * 実行方式を指定するオプション
+	 * --engine=<実行方式> の形式で指定する
+	 */
+	#define ENGINE_OPTION "--engine="
+
+	/**
+	 * スタックマシンとして命令を1つずつ実行する方式
+	 */
+	#define STACK_ENGINE "stack"
+
+	/**
+	 * 基本ブロック毎にレジスタ形式の中間表現へ変換して実行する方式
+	 */
+	#define REGISTER_ENGINE "register"
+
+	/**
+	 * スタックマシンとして実行しながら頻繁に実行されるループの経路をトレースとして記録し、
+	 * 分岐をガードに置き換えた命令列として実行する方式
+	 */
+	#define TRACE_ENGINE "trace"
+
+	/**
+	 * スタックの上から2個までの値をレジスタに持ったまま、キャッシュの状態毎に分けた命令として実行する方式
+	 */
+	#define CACHE_ENGINE "cache"
+
+	/**
+	 * 実行せずに x86-64 Linux の静的な実行ファイルを書き出すオプション
+	 * --emit=<実行ファイル> の形式で指定する
+	 */
+	#define EMIT_OPTION "--emit="
+
+	/**
+	 * 実行状態のスナップショットを書き込むオプション
+	 * --checkpoint=<スナップショットファイル> の形式で指定する
+	 * SIGUSR1 を受けると書き込み、SIGTERM を受けると書き込んでから終了する
+	 */
+	#define CHECKPOINT_OPTION "--checkpoint="
+
+	/**
+	 * スナップショットを書き込む間隔を指定するオプション
+	 * --checkpoint-interval=<命令数> の形式で指定する
+	 */
+	#define CHECKPOINT_INTERVAL_OPTION "--checkpoint-interval="
+
+	/**
+	 * スナップショットから実行を再開するオプション
+	 * --restore=<スナップショットファイル> の形式で指定する
+	 */
+	#define RESTORE_OPTION "--restore="
+
+	/**
+	 * 複数の入力ファイルについて、最初の入力命令までの実行を共有してプログラムを実行するオプション
+	 * --batch=<入力ファイル> の形式で入力ファイル毎に指定する
+	 * 入力ファイル毎の出力は <入力ファイル>.out に書き込む
+	 */
+	#define BATCH_OPTION "--batch="
+
+	/**
+	 * 解析済みの命令セットを保持したまま Unix ドメインソケットで実行要求を受け付けるオプション
+	 * --serve=<ソケットのパス> の形式で指定する
+	 */
+	#define SERVE_OPTION "--serve="
+
+	/**
+	 * 実行要求を処理するワーカーや、バッチで同時に実行するプロセスの数を指定するオプション
+	 * --workers=<ワーカーの数> の形式で指定する
+	 */
+	#define WORKER_OPTION "--workers="
+
+	/**
+	 * ワーカーの数の初期値
+	 */
+	#define DEFAULT_WORKER_COUNT 4
+
+	/**
+	 * ワーカーを、接続毎の仮想マシンを切り替えながら実行するイベントループとして動作させるオプション
+	 * --quantum=<命令数> の形式で指定し、指定した命令数を実行する毎に他の接続に切り替える
+	 * 入力が届いていない入力命令では入力が届くまで他の接続を実行する
+	 * スタックマシンとしてのみ実行できる
+	 */
+	#define QUANTUM_OPTION "--quantum="
+
+	/**
+	 * 1回の実行要求で受け付けるプログラムの最大バイト数
+	 */
+	#define SERVER_PROGRAM_LIMIT ( 64 * 1024 * 1024 )
+
+	/**
+	 * 実行要求を受け付けているサーバーにプログラムを送って実行するオプション
+	 * --connect=<ソケットのパス> の形式で指定する
+	 * 標準入力はプログラムの入力として送られ、プログラムの出力は標準出力に書き込まれる
+	 */
+	#define CONNECT_OPTION "--connect="
+
+	/**
+	 * 実行できる命令数を制限するオプション
+	 * --fuel=<命令数> の形式で指定する
+	 * 後方への分岐とサブルーチンの呼び出しの時点で、直前に消費してから実行した命令数をまとめて消費する
+	 */
+	#define FUEL_OPTION "--fuel="
+
+	/**
+	 * ヒープのサイズを制限するオプション
+	 * --heap-limit=<バイト数> の形式で指定する
+	 */
+	#define HEAP_LIMIT_OPTION "--heap-limit="
+
+	/**
+	 * ヒープをファイルに割り当てるオプション
+	 * --heap-file=<ヒープファイル> の形式で指定する
+	 * ファイルが既にある場合はその内容をヒープの初期値とし、終了後もファイルに残す
+	 */
+	#define HEAP_FILE_OPTION "--heap-file="
+
+	/**
+	 * ヒープを一時ファイルに割り当てるオプション
+	 * --heap-swap=<ディレクトリ> の形式で指定する
+	 * 一時ファイルは作成してすぐに削除するため、終了後には残らない
+	 */
+	#define HEAP_SWAP_OPTION "--heap-swap="
+
+	/**
+	 * スタックの深さを制限するオプション
+	 * --stack-limit=<値の個数> の形式で指定する
+	 */
+	#define STACK_LIMIT_OPTION "--stack-limit="
+
+	/**
+	 * サブルーチン呼び出しの深さを制限するオプション
+	 * --call-limit=<呼び出しの深さ> の形式で指定する
+	 */
+	#define CALL_LIMIT_OPTION "--call-limit="
+
+	/**
+	 * 実行時間を制限するオプション
+	 * --time-limit=<ミリ秒> の形式で指定する
+	 * 入力を待っている間に上限に達した場合も中断する
+	 */
+	#define TIME_LIMIT_OPTION "--time-limit="
+
+	/**
+	 * サブルーチン呼び出しの経路毎に実行した命令数を数え、終了時に畳み込んだ呼び出し経路として書き出すオプション
+	 * --profile=<ファイル> の形式で指定する
+	 * 実行方式の指定に関わらずスタックマシンとして実行する
+	 */
+	#define PROFILE_OPTION "--profile="
+
+	/**
+	 * 実行中の命令を一定間隔で標本として記録し、終了時に頻繁に実行された命令とラベルをエラー出力に書き出すオプション
+	 * --sample-profile=<1秒あたりの標本数> の形式で指定する
+	 * 実行方式を問わず使えるが、スタックマシン以外では分岐先やブロックの最初の命令に標本をまとめる
+	 */
+	#define SAMPLE_PROFILE_OPTION "--sample-profile="
+
+	/**
+	 * 読み込みと実行のそれぞれでハードウェアカウンタを計測し、命令あたりの値をエラー出力に書き出すオプション
+	 * カウンタを開けない環境では計測せずにそのまま実行する
+	 * 実行した命令数はスタックマシンとして実行した場合だけ数える
+	 */
+	#define PERF_COUNTERS_OPTION "--perf-counters"
+
+	/**
+	 * プログラムを全て解析せずに実行を始め、各基本ブロックを最初に実行する時に解析するオプション
+	 * スタックマシンとしてのみ実行でき、最適化や逆アセンブル、ハードウェアカウンタの計測とは併用できない
+	 */
+	#define LAZY_OPTION "--lazy"
+
+	/**
+	 * 制限に達して実行を中断した場合の終了ステータス
+	 */
+	#define LIMIT_EXIT_STATUS 3
+
 	/**
 	 * 文字入力を受け付ける場合等で使用するバッファサイズ
 	 */
 	#define BUFFER_SIZE 1024
 
+	/**
+	 * long を10進数で表した文字列の最大の長さ
+	 * -9223372036854775808 の長さ
+	 */
+	#define NUMBER_LENGTH 20
+
 	/**
 	 * ヒープ領域の確保サイズ
 	 * 足りなくなったら、このサイズを追加して更に確保する
 	 */
 	#define HEAP_ALLOCATION_SIZE 256
 
+	/**
+	 * ヒープをファイルに割り当てた場合の確保サイズ
+	 * ファイルは疎なため、書き込むまでは伸ばした分の領域を使わない
+	 */
+	#define HEAP_FILE_ALLOCATION_SIZE ( 64 * 1024 )
+
 	/**
 	 * スタック領域の確保サイズ
 	 * 足りなくなったら、このサイズを追加して更に確保する
@@ -74,8 +288,12 @@
 	 * ヒープアクセスコマンド
 	 */
 	enum{
-		TO_ADDRESS ,	// ヒープに値を保存する
-		TO_STACK		// ヒープの値をスタックにプッシュする
+		TO_ADDRESS ,		// ヒープに値を保存する
+		TO_STACK ,			// ヒープの値をスタックにプッシュする
+		TO_VARIABLE ,		// 固定スロットに割り当てたヒープに値を保存する
+		VARIABLE_TO_STACK ,	// 固定スロットに割り当てたヒープの値をスタックにプッシュする
+		BLOCK_FILL ,		// 直後のヒープを埋めるループを、抜ける直前の繰り返しまでまとめて実行する
+		BLOCK_COPY			// 直後のヒープを複写するループを、抜ける直前の繰り返しまでまとめて実行する
 	} typedef Heap;
 
 	/**
@@ -88,7 +306,9 @@
 		ZERO_JUMP ,		// スタックの1個目が0の場合にジャンプ
 		MINUS_JUMP ,	// スタックの1個目が負の場合にジャンプ
 		END_ROUTINE ,	// サブルーチン終了
-		FINISH			// プログラム終了
+		FINISH ,		// プログラム終了
+		TAIL_CALL ,		// 末尾位置のサブルーチン呼び出し サブルーチン内ではジャンプとして実行する
+		LAZY_BLOCK		// 遅延読み込みでまだ解析していない基本ブロック 最初に実行する時に解析した命令に置き換える
 	} typedef Control;
 
 	/**
@@ -98,7 +318,8 @@
 		PUT_CHAR ,		// スタックの1個目の値を文字として出力
 		PUT_NUMBER ,	// スタックの1個目の値を数値として出力
 		GET_CHAR ,		// 入力された文字をスタックの1個目の値のアドレスに保存
-		GET_NUMBER		// 入力された数値をスタックの1個目の値のアドレスに保存
+		GET_NUMBER ,	// 入力された数値をスタックの1個目の値のアドレスに保存
+		PUT_STRING		// 直後のヒープの文字列を出力するループを、抜ける直前の繰り返しまでまとめて実行する
 	} typedef IOControl;
 
 	/**
@@ -116,9 +337,12 @@
 		union{
 			long value;				// 数値パラメータ
 			char *label;			// ラベル
+			struct idiom *idiom;	// まとめて実行するループの形
 		} parameter;
 		struct instruction *next;	// 次の命令
 		struct instruction *jump;	// ジャンプ時やサブルーチン呼び出し時に実行する命令
+		int index;					// プログラム先頭からの命令の通し番号
+		struct instruction *labels;	// 実行する命令の並びから取り除いた直前のラベル定義 next を辿るとこの命令に至る
 	} typedef Instruction;
 
 	// Instruction のエイリアス
@@ -129,16 +353,106 @@
 	#define c_io command.io
 	#define p_value parameter.value
 	#define p_label parameter.label
+	#define p_idiom parameter.idiom
 	// ここまで
 
+	/**
+	 * まとめて実行するループの形を保持する構造体
+	 * スタックの位置はループの先頭でのスタックの上からの位置で、0 がスタックの1個目の値を表す
+	 * 位置の値に差分を足した値を、回数・アドレス・書き込む値として使用する
+	 */
+	struct idiom{
+		int depth;					// ループが参照するスタックの深さ
+		int counter;				// 残り回数を判定する値の位置 文字列の出力では使用しない
+		long counterOffset;			// 残り回数を判定する値の差分
+		int step;					// 1回の繰り返しで残り回数を判定する値に足される値
+		bool negative;				// 負の場合にループを抜ける場合は true 0 の場合に抜ける場合は false
+		int destination;			// 書き込むアドレスの位置
+		long destinationOffset;		// 書き込むアドレスの差分
+		bool copy;					// 複写の場合に true 埋める場合は false
+		int source;					// 読み込むアドレスか埋める値の位置 埋める値が定数の場合は -1
+		long sourceOffset;			// 読み込むアドレスか埋める値の差分
+		struct instruction *back;	// ループの先頭へ戻る命令 命令数の消費に使用する
+	} typedef Idiom;
+
+
+	/**
+	 * 実行を中断した理由
+	 */
+	enum{
+		HALT_NONE ,		// 中断していない
+		HALT_ERROR ,	// 実行時エラー
+		HALT_FUEL ,		// 実行できる命令数を使い切った
+		HALT_HEAP ,		// ヒープのサイズの上限に達した
+		HALT_STACK ,	// スタックの深さの上限に達した
+		HALT_CALL ,		// サブルーチン呼び出しの深さの上限に達した
+		HALT_TIME		// 実行時間の上限に達した
+	} typedef Halt;
+
+	/**
+	 * 実行時の資源の上限を保持する構造体
+	 * 0 の場合は制限しない
+	 */
+	struct{
+		long fuel;				// 実行できる命令数
+		size_t heap;			// ヒープのバイト数
+		size_t stack;			// スタックに積める値の個数
+		size_t call;			// サブルーチン呼び出しの深さ
+		long milliseconds;		// 実行時間
+	} typedef Limit;
+
+	/**
+	 * 仮想マシンの実行状態を保持する構造体
+	 */
+	struct{
+		Instruction *current;		// 現在参照している命令
+		long *heap;					// ヒープ
+		size_t heapAllocation;		// ヒープの確保容量
+		size_t heapMapped;			// スナップショットから割り当てたヒープのバイト数
+		int heapDescriptor;			// ヒープを割り当てたファイルの記述子
+		bool heapBacked;			// ヒープをファイルに割り当てている場合は true
+		long *stack;				// スタック
+		size_t stackAllocation;		// スタックの確保容量
+		size_t stackMapped;			// スナップショットから割り当てたスタックのバイト数
+		int stackPointer;			// スタックの現在の参照位置
+		Instruction **calls;		// サブルーチンの戻り先を積む呼び出しスタック
+		size_t callAllocation;		// 呼び出しスタックの確保容量
+		int callPointer;			// 呼び出しスタックの現在の参照位置
+		long *variables;			// 固定スロットに割り当てたヒープ
+		int *variableAt;			// ヒープのアドレスから固定スロットを引くための表
+		int *variableAddresses;		// 固定スロット毎に割り当てたヒープのアドレス
+		int variableLimit;			// 固定スロットに割り当てたアドレスの上限
+		int variableCount;			// 固定スロットの数
+		FILE *input;				// プログラムの入力
+		FILE *output;				// プログラムの出力
+		long inputOffset;			// プログラムが入力から読み込んだバイト数
+		long outputOffset;			// プログラムが出力に書き込んだバイト数
+		Limit limit;				// 資源の上限
+		long fuel;					// 残りの実行できる命令数
+		int entry;					// 最後に分岐してから一続きに実行している命令の最初の番号
+		bool governed;				// 実行できる命令数か実行時間を制限している場合に true
+		jmp_buf *escape;			// 実行を中断した時の戻り先
+		void ( *discard )( void );	// 実行を中断した時に実行方式が保持している状態を破棄する関数
+		void ( *interrupt )( void );	// 入力の読み込みがシグナルで中断した時に呼び出す関数
+	} typedef Machine;
+
 
 	// prepare.c
 
 	/**
 	 * 読み込んだプログラムを破棄する
+	 * ラベルの対応表も破棄される
 	 */
 	void programClear( void );
 
+	/**
+	 * 命令セットの作成に失敗した場合に、プログラムを終了せずに戻る戻り先を設定する
+	 * 戻る前に作成中の命令セットとラベルの対応表は破棄される
+	 * @param escape
+	 *	戻り先 NULL の場合は失敗した時点でプログラムを終了する
+	 */
+	void setRescue( jmp_buf *escape );
+
 	/**
 	 * プログラムの読込みを行う
 	 * @param source
@@ -164,13 +478,71 @@
 	 */
 	Instruction *getInstruction( void );
 
+	/**
+	 * 読み込んだプログラムを実行しながら解析する命令セットを取得する
+	 * 事前の走査ではラベル定義の位置だけを記録し、各基本ブロックは最初に実行する時に解析する
+	 * ジャンプ先はブロックを解析する時にラベル定義の位置の未解析の命令に結び付ける
+	 * 実行を終えるまでプログラムを破棄してはならない
+	 * @return
+	 *	最初に実行する未解析の命令
+	 */
+	Instruction *getLazyInstruction( void );
+
+	/**
+	 * 未解析の命令から次の分岐までを解析し、未解析の命令をその最初の命令に置き換える
+	 * @param instruction
+	 *	未解析の命令
+	 * @return
+	 *	解析した最初の命令 プログラムの終わりの場合は NULL
+	 */
+	Instruction *decodeBlock( Instruction *instruction );
+
+	/**
+	 * 命令セットのジャンプ先を最終的に実行する命令に張り替える
+	 * ジャンプ先や次の命令がラベル定義の場合はその次の命令に、無条件ジャンプの場合はそのジャンプ先に張り替え、
+	 * ラベル定義は実行する命令の並びから取り除いて直後の命令の labels に残す
+	 * 最適化を全て終えてから呼び出す
+	 * @param instruction
+	 *	張り替える命令セット
+	 * @return
+	 *	最初に実行する命令
+	 */
+	Instruction *linkInstruction( Instruction *instruction );
+
 	/**
 	 * 命令セットを開放する
+	 * 命令とラベルは命令セット毎の領域に確保しているため、他の命令セットを残したまままとめて開放される
 	 * @param instruction
 	 *	開放する命令セット
 	 */
 	void freeInstruction( Instruction *instruction );
 
+	/**
+	 * 空の命令を1つ確保する
+	 * 命令は freeInstruction でまとめて開放される
+	 * @return
+	 *	確保した命令
+	 */
+	Instruction *createInstruction( void );
+
+	/**
+	 * 命令に付随する領域を確保する
+	 * 領域は freeInstruction でまとめて開放される
+	 * @param size
+	 *	確保するバイト数
+	 * @return
+	 *	0 で初期化した領域
+	 */
+	void *createArea( size_t size );
+
+	/**
+	 * 命令を1つ命令セットから切り離す
+	 * 命令の領域は freeInstruction でまとめて開放される
+	 * @param instruction
+	 *	開放する命令
+	 */
+	void destroyInstruction( Instruction *instruction );
+
 	/**
 	 * ラベルから命令を取得する
 	 * @param label
@@ -190,24 +562,573 @@
 	 */
 	void execute( Instruction *instruction );
 
+	/**
+	 * 命令を1つ実行する
+	 * 実行後に次に実行する命令が Machine の current に設定される
+	 * @param instruction
+	 *	実行する命令
+	 * @return
+	 *	プログラムが終了の場合に true を返す
+	 */
+	bool baseProcess( Instruction *instruction );
+
+	/**
+	 * 仮想マシンの実行状態を取得する
+	 * @return
+	 *	仮想マシンの実行状態
+	 */
+	Machine *getMachine( void );
+
+	/**
+	 * プログラムの入出力に使用するストリームを設定する
+	 * @param input
+	 *	プログラムの入力
+	 * @param output
+	 *	プログラムの出力
+	 */
+	void setStream( FILE *input , FILE *output );
+
+	/**
+	 * 資源の上限を設定する
+	 * 実行時間の計測もここから開始する
+	 * @param limit
+	 *	資源の上限
+	 */
+	void setLimit( Limit *limit );
+
+	/**
+	 * 実行を中断できるようにしてプログラムを実行する
+	 * 資源の上限に達した場合や実行時エラーの場合は終了せずに中断した理由を返す
+	 * 中断した場合は、実行方式が Machine の discard に設定した関数で途中の状態を破棄する
+	 * @param engine
+	 *	プログラムを実行する関数
+	 * @param instruction
+	 *	最初に実行する命令
+	 * @return
+	 *	中断した理由 最後まで実行した場合は HALT_NONE
+	 */
+	Halt executeGoverned( void ( *engine )( Instruction * ) , Instruction *instruction );
+
+	/**
+	 * 後方への分岐とサブルーチンの呼び出しで、直前に消費してから実行した命令数を消費し、実行時間を確認する
+	 * Machine の governed が true の場合に、分岐やサブルーチンの呼び出しと終了で移動する時に呼び出す
+	 * @param instruction
+	 *	分岐する命令
+	 * @param target
+	 *	移動先の命令 プログラムの終わりの場合は NULL
+	 */
+	void chargeFuel( Instruction *instruction , Instruction *target );
+
+	/**
+	 * 指定した命令数を消費し、実行時間を確認する
+	 * 一続きの命令の区切りは変えない
+	 * @param count
+	 *	消費する命令数
+	 */
+	void consumeFuel( long count );
+
+	/**
+	 * 実行を中断する
+	 * executeGoverned の外で呼び出された場合は集計を表示してプログラムを終了する
+	 * @param reason
+	 *	中断した理由
+	 */
+	void halt( Halt reason );
+
+	/**
+	 * 実行を中断した理由と資源の使用量を標準エラー出力に表示する
+	 * @param reason
+	 *	中断した理由
+	 */
+	void reportHalt( Halt reason );
+
+	/**
+	 * スタックに指定した個数の値を積めるだけの領域を確保する
+	 * @param count
+	 *	追加で積む値の個数
+	 */
+	void reserveStack( int count );
+
+	/**
+	 * サブルーチンの戻り先を呼び出しスタックに積む
+	 * @param instruction
+	 *	サブルーチン終了時に実行する命令
+	 */
+	void pushCall( Instruction *instruction );
+
+	/**
+	 * ヒープに値を設定する
+	 * @param address
+	 *	値を保存するヒープのアドレス
+	 * @param value
+	 *	ヒープに保存する値
+	 */
+	void setHeapValue( int address , long value );
+
+	/**
+	 * ヒープから値を取得する
+	 * @param address
+	 *	値を取得するヒープのアドレス
+	 * @return
+	 *	取得した値
+	 */
+	long getHeapValue( int address );
+
+	/**
+	 * 固定スロットに値を設定する
+	 * 割り当てたアドレスまでヒープを確保していない場合は setHeapValue と同じくヒープを確保し、上限を確認する
+	 * Machine の heapAllocation が variableLimit 以上であれば、variables に直接書き込んでよい
+	 * @param slot
+	 *	固定スロットの番号
+	 * @param value
+	 *	保存する値
+	 */
+	void setVariableValue( int slot , long value );
+
+	/**
+	 * 固定スロットの値を取得する
+	 * 割り当てたアドレスまでヒープを確保していない場合は getHeapValue と同じくエラーとする
+	 * Machine の heapAllocation が variableLimit 以上であれば、variables から直接読み込んでよい
+	 * @param slot
+	 *	固定スロットの番号
+	 * @return
+	 *	取得した値
+	 */
+	long getVariableValue( int slot );
+
+	/**
+	 * ヒープの指定したアドレスを固定スロットに割り当てる
+	 * 割り当てたアドレスへ計算したアドレスでアクセスした場合も固定スロットが参照される
+	 * @param addresses
+	 *	割り当てるアドレス
+	 *	n 番目のアドレスが n 番目の固定スロットに割り当てられる
+	 * @param count
+	 *	割り当てるアドレスの個数
+	 */
+	void setVariable( long *addresses , int count );
+
+	/**
+	 * ヒープを疎なファイルに割り当てる
+	 * アドレス空間を予約して共有で割り当て、ヒープが伸びる時はファイルを伸ばすだけにする
+	 * 実行前に呼び出す
+	 * @param path
+	 *	ヒープファイル temporary の場合は一時ファイルを作成するディレクトリ
+	 * @param temporary
+	 *	一時ファイルを作成してすぐに削除する場合は true
+	 *	false の場合は既存のファイルの内容をヒープの初期値とし、終了後もファイルに残す
+	 */
+	void setHeapFile( const char *path , bool temporary );
+
 	/**
 	 * プログラムの実行により確保されたスタックを破棄する
+	 * 呼び出しスタックも破棄される
 	 */
 	void stackClear( void );
 
 	/**
 	 * プログラムの実行により確保されたヒープを破棄する
+	 * 固定スロットも破棄される
+	 * ヒープをファイルに割り当てている場合は固定スロットの値をファイルに書き戻してから閉じる
 	 */
 	void heapClear( void );
 
 
+	// register.c
+
+	/**
+	 * 命令セットを基本ブロック毎にレジスタ形式の中間表現へ変換して実行する
+	 * @param instruction
+	 *	実行する命令セット
+	 */
+	void executeRegister( Instruction *instruction );
+
+
+	// trace.c
+
+	/**
+	 * スタックマシンとして実行し、頻繁に実行されるループはトレースとして記録して実行する
+	 * 後方ジャンプ先毎に回数を数え、一定回数に達したら次に先頭へ戻るまでの経路を記録する
+	 * @param instruction
+	 *	実行する命令セット
+	 */
+	void executeTrace( Instruction *instruction );
+
+
+	// cache.c
+
+	/**
+	 * スタックの上から2個までの値をレジスタに持ったまま命令セットを実行する
+	 * 命令とレジスタに持っている値の個数の組毎に処理を分け、スタックへの読み書きを減らす
+	 * @param instruction
+	 *	実行する命令セット
+	 */
+	void executeCache( Instruction *instruction );
+
+
+	// profile.c
+
+	/**
+	 * サブルーチン呼び出しの経路を辿りながらスタックマシンとして実行し、経路毎に実行した命令数を数える
+	 * @param instruction
+	 *	実行する命令セット
+	 */
+	void executeProfile( Instruction *instruction );
+
+	/**
+	 * 数えた命令数を畳み込んだ呼び出し経路として書き出す
+	 * 1行に1経路ずつ、根から順にラベルを ; で区切り、空白に続けて命令数を書き込む
+	 * 直接の再帰は1つのラベルにまとめる
+	 * 実行を中断した場合もそれまでに数えた命令数を書き出す
+	 * @param path
+	 *	書き込み先のファイル
+	 */
+	void writeProfile( const char *path );
+
+
+	// sample.c
+
+	/**
+	 * 実行中の命令を標本として記録し始める
+	 * プロセスが消費した CPU 時間で周期的に割り込み、割り込み時点で実行中の命令と呼び出しの深さを記録する
+	 * @param instruction
+	 *	実行する命令セット
+	 * @param frequency
+	 *	1秒あたりの標本数
+	 */
+	void startSample( Instruction *instruction , long frequency );
+
+	/**
+	 * 標本の記録を止め、頻繁に実行された命令とラベルを書き出す
+	 * @param output
+	 *	書き込み先
+	 */
+	void reportSample( FILE *output );
+
+
+	// perf.c
+
+	/**
+	 * ハードウェアカウンタを開く
+	 * 開けなかったカウンタは計測しない 1つも開けなかった場合はその旨をエラー出力に書き出す
+	 */
+	void openCounters( void );
+
+	/**
+	 * 開いたハードウェアカウンタを 0 から計測し始める
+	 */
+	void startCounters( void );
+
+	/**
+	 * ハードウェアカウンタの計測を止め、値と命令あたりの値を書き出す
+	 * 1つも計測できなかった場合は何も書き出さない
+	 * @param phase
+	 *	計測した処理の名前
+	 * @param count
+	 *	計測中に処理した命令数 数えていない場合は 0
+	 * @param output
+	 *	書き込み先
+	 */
+	void reportCounters( const char *phase , long count , FILE *output );
+
+	/**
+	 * ハードウェアカウンタを閉じる
+	 */
+	void closeCounters( void );
+
+	/**
+	 * 実行した命令数を数えながらスタックマシンとして実行する
+	 * @param instruction
+	 *	実行する命令セット
+	 */
+	void executeCounted( Instruction *instruction );
+
+	/**
+	 * executeCounted で実行した命令数を取得する
+	 * 実行を中断した場合はそれまでに実行した命令数になる 実行していない場合は 0
+	 * @return
+	 *	実行した命令数
+	 */
+	long getExecutedCount( void );
+
+
+	// emit.c
+
+	/**
+	 * 命令セットを機械語に変換し、外部のツールを使わずに x86-64 Linux の静的な実行ファイルとして書き出す
+	 * スタック・ヒープ・入出力は実行ファイルに埋め込んだ小さな実行時ルーチンとシステムコールで扱う
+	 * 命令数や資源の制限は行わない
+	 * @param instruction
+	 *	変換する命令セット linkInstruction で張り替えたもの
+	 * @param path
+	 *	書き出す実行ファイル
+	 */
+	void emitExecutable( Instruction *instruction , const char *path );
+
+
+	// number.c
+
+	/**
+	 * 数値を %ld と同じ10進数の文字列に変換する
+	 * 終端文字は書き込まない
+	 * @param value
+	 *	変換する数値
+	 * @param destination
+	 *	NUMBER_LENGTH バイト以上の書き込み先
+	 * @return
+	 *	書き込んだ文字数
+	 */
+	int formatNumber( long value , char *destination );
+
+	/**
+	 * 10進数の文字列を数値に変換する
+	 * 先頭と末尾の空白は読み飛ばし、数字以外の文字が現れた所で変換を終える
+	 * long の範囲を超える場合は LONG_MAX か LONG_MIN に飽和する
+	 * @param text
+	 *	変換する文字列
+	 * @param value
+	 *	変換した数値が格納される 数字が無い場合は 0
+	 * @return
+	 *	文字列全体が範囲内の1つの数値だった場合は true
+	 */
+	bool parseNumber( const char *text , long *value );
+
+
+	// batch.c
+
+	/**
+	 * 最初の入力命令に達するまで1度だけ実行し、その実行状態を入力ファイル毎に複製したプロセスで残りを実行する
+	 * 複製は fork によるため、スタックやヒープは書き込まれるまで各プロセスで共有される
+	 * 入力命令までと残りはどちらもスタックマシンとして実行する
+	 * @param instruction
+	 *	実行する命令セット
+	 * @param inputs
+	 *	入力ファイル
+	 * @param count
+	 *	入力ファイルの数
+	 * @param workers
+	 *	同時に実行するプロセスの数
+	 * @param limit
+	 *	実行時の資源の上限 入力ファイル毎の残りの実行には改めて適用する
+	 * @return
+	 *	終了ステータス 失敗した入力ファイルがあれば最初に終わったものの終了ステータス
+	 */
+	int executeBatch( Instruction *instruction , const char **inputs , int count , int workers , Limit *limit );
+
+
+	// inline.c
+
+	/**
+	 * フロー制御を含まない小さなサブルーチンを呼び出し箇所に展開する
+	 * 展開したサブルーチンは標準エラー出力に表示される
+	 * @param instruction
+	 *	展開する命令セット
+	 * @param budget
+	 *	展開するサブルーチンの命令数の上限
+	 * @return
+	 *	展開した命令セット
+	 */
+	Instruction *inlineRoutine( Instruction *instruction , int budget );
+
+
+	// fold.c
+
+	/**
+	 * 定数として分かっているスタックの値をブロックを跨いで追跡し、演算と条件分岐を畳み込む
+	 * @param instruction
+	 *	畳み込む命令セット
+	 * @return
+	 *	畳み込んだ命令セット
+	 */
+	Instruction *foldConstant( Instruction *instruction );
+
+
+	// promote.c
+
+	/**
+	 * 即値のアドレスでアクセスしているヒープを固定スロットに割り当て、アクセスする命令を書き換える
+	 * @param instruction
+	 *	書き換える命令セット
+	 * @return
+	 *	書き換えた命令セット
+	 */
+	Instruction *promoteHeap( Instruction *instruction );
+
+
+	// idiom.c
+
+	/**
+	 * ヒープの複写・ヒープを埋める・文字列の出力を行う決まった形のループを探し、
+	 * ループの先頭にまとめて実行する命令を挿入する
+	 * 挿入した命令は抜ける直前の繰り返しまでを実行し、最後の繰り返しは元のループが実行する
+	 * @param instruction
+	 *	書き換える命令セット
+	 * @return
+	 *	書き換えた命令セット
+	 */
+	Instruction *recognizeIdiom( Instruction *instruction );
+
+	/**
+	 * ループをまとめて実行する
+	 * ヒープが足りない場合などは途中で止め、残りは元のループに任せる
+	 * @param instruction
+	 *	まとめて実行する命令
+	 */
+	void executeIdiom( Instruction *instruction );
+
+
+	// snapshot.c
+
+	/**
+	 * スナップショットを扱う命令セットを設定する
+	 * 命令の通し番号は命令の並び順に振り直される
+	 * @param instruction
+	 *	実行する命令セット
+	 * @param path
+	 *	スナップショットを書き込むファイルのパス
+	 *	NULL の場合は書き込まない
+	 * @param interval
+	 *	スナップショットを書き込む命令数の間隔
+	 *	0 の場合はシグナルを受けた時のみ書き込む
+	 */
+	void setSnapshot( Instruction *instruction , const char *path , long interval );
+
+	/**
+	 * スナップショットを書き込みながらスタックマシンとしてプログラムを実行する
+	 * @param instruction
+	 *	最初に実行する命令
+	 */
+	void executeSnapshot( Instruction *instruction );
+
+	/**
+	 * スナップショットから実行状態を復元する
+	 * スタックとヒープはスナップショットファイルをそのまま割り当てる
+	 * 入力はプログラムが読み込んだ分だけ読み飛ばす
+	 * @param path
+	 *	スナップショットファイルのパス
+	 * @return
+	 *	次に実行する命令
+	 */
+	Instruction *restoreSnapshot( const char *path );
+
+	/**
+	 * スナップショットに使用した領域を破棄する
+	 */
+	void snapshotClear( void );
+
+
+	// server.c
+
+	/**
+	 * 実行要求を受け付けるサーバーとして動作する
+	 * 事前に起動したワーカーが要求を処理し、ソースコードのハッシュ値毎に命令セットを保持する
+	 * 終了したワーカーは起動し直される
+	 * @param path
+	 *	待ち受けるソケットのパス
+	 * @param workers
+	 *	ワーカーの数
+	 * @param engine
+	 *	実行方式
+	 * @param optimize
+	 *	命令セットを最適化する場合に true
+	 * @param budget
+	 *	展開するサブルーチンの命令数の上限
+	 * @param quantum
+	 *	接続を切り替えながら実行する場合に1回に実行する命令数
+	 *	0 の場合はワーカー毎に1つずつ要求を処理する
+	 * @param limit
+	 *	要求毎の資源の上限
+	 * @return
+	 *	終了ステータス
+	 */
+	int serve( const char *path , int workers , const char *engine , bool optimize , int budget , long quantum , Limit *limit );
+
+	/**
+	 * ワーカーが保持している命令セットを取得し、仮想マシンを初期化して固定スロットを割り当てる
+	 * 保持していない場合は作成して保持する
+	 * @param source
+	 *	ソースコード 保持する場合以外は開放される
+	 * @param length
+	 *	ソースコードのバイト数
+	 * @param value
+	 *	ソースコードのハッシュ値が格納される
+	 * @param hit
+	 *	保持していた命令セットを使用した場合に true が格納される
+	 * @return
+	 *	命令セット ラベルが定義されていないなどで命令セットを作成できなかった場合は NULL
+	 */
+	Instruction *loadServed( char *source , size_t length , unsigned long *value , bool *hit );
+
+	/**
+	 * 処理を終えた要求を統計に加えて標準エラー出力に表示する
+	 * 実行を終えた命令セットは、保持する数の上限を超えていれば開放できるようになる
+	 * @param program
+	 *	loadServed で取得した命令セット 取得できなかった場合は NULL
+	 * @param value
+	 *	ソースコードのハッシュ値
+	 * @param hit
+	 *	保持していた命令セットを使用した場合に true
+	 * @param elapsed
+	 *	要求の処理に掛かったマイクロ秒
+	 */
+	void finishServed( Instruction *program , unsigned long value , bool hit , long elapsed );
+
+	/**
+	 * サーバーにプログラムを送って実行する
+	 * @param path
+	 *	サーバーのソケットのパス
+	 * @param file
+	 *	プログラムのファイル
+	 * @return
+	 *	終了ステータス
+	 */
+	int connectServer( const char *path , FILE *file );
+
+
+	// schedule.c
+
+	/**
+	 * 接続毎の仮想マシンを切り替えながら実行するイベントループとして、接続を受け付けて処理し続ける
+	 * 入力が届いていない入力命令に達したタスクや、指定した命令数を実行したタスクは他のタスクに切り替える
+	 * 各タスクはスタックマシンとして実行する
+	 * @param listener
+	 *	接続を待ち受けるソケット
+	 * @param count
+	 *	1回に実行する命令数
+	 * @param limit
+	 *	タスク毎の資源の上限 実行時間は接続を受け付けてからの時間で、タスクを切り替える時に確認する
+	 */
+	void schedule( int listener , long count , Limit *limit );
+
+
 	// show.c
 
 	/**
 	 * プログラムの逆アセンブルを行う
+	 * 1行に1命令ずつ、通し番号・命令名・パラメータを書き込む
+	 * ジャンプやサブルーチン呼び出しはラベルに続けてジャンプ先の通し番号を書き込む
 	 * @param instruction
 	 *	逆アセンブルを行う命令セット
+	 * @param output
+	 *	逆アセンブル結果の書き込み先
+	 */
+	void disassemble( Instruction *instruction , FILE *output );
+
+	/**
+	 * ラベルを逆アセンブル結果と同じ表記で書き込む
+	 * @param label
+	 *	ラベル
+	 * @param output
+	 *	書き込み先
+	 */
+	void writeLabel( const char *label , FILE *output );
+
+	/**
+	 * 1つの命令を逆アセンブル結果と同じ表記で1行に書き込む
+	 * @param instruction
+	 *	書き込む命令
+	 * @param output
+	 *	書き込み先
 	 */
-	void disassemble( Instruction *instruction );
+	void writeInstruction( Instruction *instruction , FILE *output );
 
 #endif